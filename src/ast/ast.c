@@ -30,23 +30,21 @@
 #include "util/logger.h"
 
 /**
- * Allocate an AST node, add it onto the translation unit's allocation list,
- * set up marks
+ * Allocate a zeroed AST node from the translation unit's arena, set up marks
  *
  * @param tunit The translation unit
  * @param mark The location of the node
  * @param loc location to store the result
  */
-#define ALLOC_NODE(list, mark, loc)             \
-    do {                                        \
-        (loc) = ecalloc(1, sizeof(*(loc)));     \
-        sl_append(list, &(loc)->heap_link);     \
-        (loc)->mark = mark;                     \
+#define ALLOC_NODE(tunit, mark, loc)                            \
+    do {                                                        \
+        (loc) = arena_alloc(&(tunit)->arena, sizeof(*(loc)));   \
+        (loc)->mark = mark;                                     \
     } while(0)
 
-type_t *ast_type_create(trans_unit_t *tunit, fmark_t *mark, type_type_t type) {
+type_t *ast_type_create(trans_unit_t *tunit, fmark_t mark, type_type_t type) {
     type_t *node;
-    ALLOC_NODE(&tunit->types, mark, node);
+    ALLOC_NODE(tunit, mark, node);
     node->type = type;
 
     switch (type) {
@@ -69,6 +67,7 @@ type_t *ast_type_create(trans_unit_t *tunit, fmark_t *mark, type_type_t type) {
         sl_init(&node->struct_params.decls, offsetof(decl_t, link));
         node->struct_params.esize = -1;
         node->struct_params.ealign = -1;
+        node->struct_params.complete_seq = 0;
         break;
     case TYPE_ENUM:
         sl_init(&node->enum_params.ids, offsetof(decl_node_t, link));
@@ -92,9 +91,9 @@ type_t *ast_type_create(trans_unit_t *tunit, fmark_t *mark, type_type_t type) {
     return node;
 }
 
-expr_t *ast_expr_create(trans_unit_t *tunit, fmark_t *mark, expr_type_t type) {
+expr_t *ast_expr_create(trans_unit_t *tunit, fmark_t mark, expr_type_t type) {
     expr_t *node;
-    ALLOC_NODE(&tunit->exprs, mark, node);
+    ALLOC_NODE(tunit, mark, node);
     node->type = type;
 
     switch (type) {
@@ -112,6 +111,7 @@ expr_t *ast_expr_create(trans_unit_t *tunit, fmark_t *mark, expr_type_t type) {
         break;
     case EXPR_INIT_LIST:
         vec_init(&node->init_list.exprs, 0);
+        sl_append(&tunit->exprs, &node->heap_link);
         break;
 
     case EXPR_VOID:
@@ -121,6 +121,7 @@ expr_t *ast_expr_create(trans_unit_t *tunit, fmark_t *mark, expr_type_t type) {
     case EXPR_CONST_INT:
     case EXPR_CONST_FLOAT:
     case EXPR_CONST_STR:
+    case EXPR_EMBED:
     case EXPR_BIN:
     case EXPR_UNARY:
     case EXPR_COND:
@@ -142,25 +143,25 @@ expr_t *ast_expr_create(trans_unit_t *tunit, fmark_t *mark, expr_type_t type) {
     return node;
 }
 
-decl_node_t *ast_decl_node_create(trans_unit_t *tunit, fmark_t *mark) {
+decl_node_t *ast_decl_node_create(trans_unit_t *tunit, fmark_t mark) {
     decl_node_t *node;
-    ALLOC_NODE(&tunit->decl_nodes, mark, node);
+    ALLOC_NODE(tunit, mark, node);
 
     return node;
 }
 
-decl_t *ast_decl_create(trans_unit_t *tunit, fmark_t *mark) {
+decl_t *ast_decl_create(trans_unit_t *tunit, fmark_t mark) {
     decl_t *node;
-    ALLOC_NODE(&tunit->decls, mark, node);
+    ALLOC_NODE(tunit, mark, node);
 
     sl_init(&node->decls, offsetof(decl_node_t, link));
 
     return node;
 }
 
-stmt_t *ast_stmt_create(trans_unit_t *tunit, fmark_t *mark, stmt_type_t type) {
+stmt_t *ast_stmt_create(trans_unit_t *tunit, fmark_t mark, stmt_type_t type) {
     stmt_t *node;
-    ALLOC_NODE(&tunit->stmts, mark, node);
+    ALLOC_NODE(tunit, mark, node);
     node->type = type;
 
     switch (type) {
@@ -170,6 +171,10 @@ stmt_t *ast_stmt_create(trans_unit_t *tunit, fmark_t *mark, stmt_type_t type) {
 
     case STMT_COMPOUND:
         sl_init(&node->compound.stmts, offsetof(stmt_t, link));
+        sl_append(&tunit->stmts, &node->heap_link);
+        break;
+    case STMT_FOR:
+        sl_append(&tunit->stmts, &node->heap_link);
         break;
 
     case STMT_NOP:
@@ -180,7 +185,6 @@ stmt_t *ast_stmt_create(trans_unit_t *tunit, fmark_t *mark, stmt_type_t type) {
     case STMT_IF:
     case STMT_DO:
     case STMT_WHILE:
-    case STMT_FOR:
     case STMT_GOTO:
     case STMT_CONTINUE:
     case STMT_BREAK:
@@ -195,12 +199,15 @@ stmt_t *ast_stmt_create(trans_unit_t *tunit, fmark_t *mark, stmt_type_t type) {
     return node;
 }
 
-gdecl_t *ast_gdecl_create(trans_unit_t *tunit, fmark_t *mark,
+gdecl_t *ast_gdecl_create(trans_unit_t *tunit, fmark_t mark,
                           gdecl_type_t type) {
     gdecl_t *node;
-    ALLOC_NODE(&tunit->gdecl_nodes, mark, node);
+    ALLOC_NODE(tunit, mark, node);
     node->type = type;
 
+    // The parser may turn any gdecl into a function definition later
+    sl_append(&tunit->gdecl_nodes, &node->heap_link);
+
     static const ht_params_t s_gdecl_ht_params = {
         0,                              // Size estimate
         offsetof(stmt_t, label.label),  // Offset of key
@@ -229,18 +236,27 @@ trans_unit_t *ast_trans_unit_create(bool dummy) {
     sl_init(&node->gdecls, offsetof(gdecl_t, link));
     if (dummy) {
         // Don't insert primitive types if dummy
-        tt_init(&node->typetab, (void *)node);
-        node->typetab.last = NULL;
+        tt_init_empty(&node->typetab);
+        node->bindings = NULL;
     } else {
         tt_init(&node->typetab, NULL);
+        node->bindings = emalloc(sizeof(tt_bindings_t));
+        tt_bindings_init(node->bindings);
     }
 
+    arena_init(&node->arena);
+
+    static const ht_params_t s_lazy_ht_params = {
+        0,                                  // Size estimate
+        offsetof(gdecl_t, fdefn.lazy.name), // Offset of key
+        offsetof(gdecl_t, fdefn.lazy.link), // Offset of ht link
+        ind_str_hash,                       // Hash function
+        ind_str_eq,                         // void string compare
+    };
+    ht_init(&node->lazy_fdefns, &s_lazy_ht_params);
     sl_init(&node->gdecl_nodes, offsetof(gdecl_t, heap_link));
     sl_init(&node->stmts, offsetof(stmt_t, heap_link));
-    sl_init(&node->decls, offsetof(decl_t, heap_link));
-    sl_init(&node->decl_nodes, offsetof(decl_node_t, heap_link));
     sl_init(&node->exprs, offsetof(expr_t, heap_link));
-    sl_init(&node->types, offsetof(type_t, heap_link));
 
     return node;
 }
@@ -249,48 +265,19 @@ void ast_destroy(trans_unit_t *trans_unit) {
     if (trans_unit == NULL) {
         return;
     }
+    if (trans_unit->bindings != NULL) {
+        tt_bindings_destroy(trans_unit->bindings);
+        free(trans_unit->bindings);
+    }
     tt_destroy(&trans_unit->typetab);
+    ht_destroy(&trans_unit->lazy_fdefns);
     SL_DESTROY_FUNC(&trans_unit->gdecl_nodes, ast_gdecl_destroy);
     SL_DESTROY_FUNC(&trans_unit->stmts, ast_stmt_destroy);
-    SL_DESTROY_FUNC(&trans_unit->decls, ast_decl_destroy);
-    SL_DESTROY_FUNC(&trans_unit->decl_nodes, ast_decl_node_destroy);
     SL_DESTROY_FUNC(&trans_unit->exprs, ast_expr_destroy);
-    SL_DESTROY_FUNC(&trans_unit->types, ast_type_destroy);
+    arena_destroy(&trans_unit->arena);
     free(trans_unit);
 }
 
-void ast_type_destroy(type_t *type) {
-    switch (type->type) {
-    case TYPE_VOID:
-    case TYPE_BOOL:
-    case TYPE_CHAR:
-    case TYPE_SHORT:
-    case TYPE_INT:
-    case TYPE_LONG:
-    case TYPE_LONG_LONG:
-    case TYPE_FLOAT:
-    case TYPE_DOUBLE:
-    case TYPE_LONG_DOUBLE:
-    case TYPE_VA_LIST:
-        assert(false && "These should be statically allocated");
-        break;
-    case TYPE_STRUCT:
-    case TYPE_UNION:
-    case TYPE_ENUM:
-    case TYPE_TYPEDEF:
-    case TYPE_MOD:
-    case TYPE_PAREN:
-    case TYPE_FUNC:
-    case TYPE_ARR:
-    case TYPE_PTR:
-    case TYPE_STATIC_ASSERT:
-        break;
-    default:
-        assert(false);
-    }
-    free(type);
-}
-
 void ast_expr_destroy(expr_t *expr) {
     switch (expr->type) {
     case EXPR_INIT_LIST:
@@ -304,6 +291,7 @@ void ast_expr_destroy(expr_t *expr) {
     case EXPR_CONST_INT:
     case EXPR_CONST_FLOAT:
     case EXPR_CONST_STR:
+    case EXPR_EMBED:
     case EXPR_BIN:
     case EXPR_UNARY:
     case EXPR_COND:
@@ -323,15 +311,6 @@ void ast_expr_destroy(expr_t *expr) {
     default:
         assert(false);
     }
-    free(expr);
-}
-
-void ast_decl_node_destroy(decl_node_t *decl_node) {
-    free(decl_node);
-}
-
-void ast_decl_destroy(decl_t *decl) {
-    free(decl);
 }
 
 void ast_stmt_destroy(stmt_t *stmt) {
@@ -364,7 +343,6 @@ void ast_stmt_destroy(stmt_t *stmt) {
     default:
         assert(false);
     }
-    free(stmt);
 }
 
 void ast_gdecl_destroy(gdecl_t *gdecl) {
@@ -377,7 +355,6 @@ void ast_gdecl_destroy(gdecl_t *gdecl) {
     default:
         assert(false);
     }
-    free(gdecl);
 }
 
 void struct_iter_init(type_t *type, struct_iter_t *iter) {
@@ -27,7 +27,9 @@
 #include "ast/type_table.h"
 
 #include <stdarg.h>
+#include <stdatomic.h>
 
+#include "util/arena.h"
 #include "util/file_mark.h"
 #include "util/slist.h"
 #include "util/util.h"
@@ -141,7 +143,7 @@ typedef enum type_type_t {
  */
 struct type_t {
     sl_link_t heap_link;         /**< Allocation Link */
-    fmark_t *mark;               /**< File mark */
+    fmark_t mark;               /**< File mark */
     type_type_t type;            /**< Type of type type */
     bool typechecked;
 
@@ -152,6 +154,7 @@ struct type_t {
             void *trans_state;
             size_t esize;        /**< Cached size. -1 if unassigned */
             size_t ealign;       /**< Cached align. -1 if unassigned */
+            size_t complete_seq; /**< File scope point of the definition */
         } struct_params;
 
         struct {
@@ -249,6 +252,7 @@ typedef enum expr_type_t {
     EXPR_CONST_INT,   /**< Constant integral type */
     EXPR_CONST_FLOAT, /**< Constant floating point type */
     EXPR_CONST_STR,   /**< Constant string type */
+    EXPR_EMBED,       /**< Bytes of a file from #embed */
     EXPR_BIN,         /**< Binary Operation */
     EXPR_UNARY,       /**< Unary Operation */
     EXPR_COND,        /**< Conditional Operator */
@@ -278,7 +282,7 @@ typedef struct designator_list_t {
 struct expr_t {
     sl_link_t heap_link;            /**< Allocation Link */
     sl_link_t link;                 /**< Storage link */
-    fmark_t *mark;                  /**< File mark */
+    fmark_t mark;                  /**< File mark */
     expr_type_t type;               /**< Expression type */
     type_t *etype;                  /**< Type of the expression */
 
@@ -301,6 +305,11 @@ struct expr_t {
             };
         } const_val;
 
+        struct {                    /**< #embed paramaters */
+            char *data;             /**< Bytes of the file */
+            size_t len;             /**< Number of bytes */
+        } embed;
+
         struct {                    /**< Binary operation */
             oper_t op;              /**< Type of operation */
             expr_t *expr1;          /**< Expr 1 */
@@ -391,9 +400,8 @@ struct expr_t {
  * e.g. int foo, *bar; foo and *bar are the decl nodes
  */
 typedef struct decl_node_t {
-    sl_link_t heap_link; /**< Allocation Link */
     sl_link_t link;      /**< Storage link */
-    fmark_t *mark;       /**< File mark */
+    fmark_t mark;       /**< File mark */
     type_t *type;        /**< Type of variable */
     char *id;            /**< Name of variable */
     expr_t *expr;        /**< Expression to assign, bitfield bits for struct/union */
@@ -403,9 +411,8 @@ typedef struct decl_node_t {
  * A declaration
  */
 struct decl_t {
-    sl_link_t heap_link; /**< Allocation Link */
     sl_link_t link;      /**< Storage link */
-    fmark_t *mark;       /**< File mark */
+    fmark_t mark;       /**< File mark */
     type_t *type;        /**< Type of variable */
     slist_t decls;       /**< List of declarations (decl_node_t) */
 };
@@ -450,7 +457,7 @@ typedef enum stmt_type_t {
 struct stmt_t {
     sl_link_t heap_link;          /**< Allocation Link */
     sl_link_t link;               /**< Storage link */
-    fmark_t *mark;                /**< File mark */
+    fmark_t mark;                /**< File mark */
     stmt_type_t type;             /**< Type of statement */
 
     union {
@@ -550,14 +557,24 @@ typedef enum gdecl_type_t {
 struct gdecl_t {
     sl_link_t heap_link;     /**< Allocation Link */
     sl_link_t link;          /**< Storage Link */
-    fmark_t *mark;           /**< File mark */
+    fmark_t mark;           /**< File mark */
     gdecl_type_t type;       /**< Type of gdecl */
     struct decl_t *decl;     /**< Declaration */
     union {
         struct {             /**< Function definition parameters */
-            stmt_t *stmt;    /**< Function body */
+            stmt_t *stmt;    /**< Function body, NULL if not parsed yet */
             htable_t labels; /**< Labels in function */
             slist_t gotos;   /**< Goto statements in function */
+            struct {         /**< Deferred body parsing */
+                sl_link_t link;   /**< Link in the unit's lazy_fdefns */
+                char *name;       /**< Name of the function */
+                vec_iter_t body;  /**< Tokens starting at the body's LBRACE */
+                typetab_t *typetab; /**< Scope the body is parsed in */
+                size_t scope_limit; /**< tt_file_seq when it was deferred */
+                size_t check_limit; /**< tt_file_seq when it was checked */
+                bool on_use;      /**< Only parsed if referenced */
+                atomic_bool referenced; /**< Whether the body was requested */
+            } lazy;
         } fdefn;
     };
 };
@@ -569,12 +586,15 @@ struct gdecl_t {
 typedef struct trans_unit_t {
     slist_t gdecls;     /**< List of gdecl in compilation unit */
     typetab_t typetab;  /**< Types defined at top level */
-    slist_t gdecl_nodes; /**< (gdecl_t) */
-    slist_t stmts;      /**< (stmt_t) */
-    slist_t decls;      /**< (decl_t) */
-    slist_t decl_nodes; /**< (decl_node_t) */
-    slist_t exprs;      /**< (exprs_t) */
-    slist_t types;      /**< (types_t) */
+    arena_t arena;      /**< Storage for all of the unit's nodes */
+    htable_t lazy_fdefns; /**< (gdecl_t) Functions with unparsed bodies */
+    tt_bindings_t *bindings; /**< The parser's typedef bindings. NULL to
+                                  search the scopes instead */
+
+    // Nodes which own memory outside of the arena, to release on destruction
+    slist_t gdecl_nodes; /**< (gdecl_t) All gdecls, for label tables */
+    slist_t stmts;      /**< (stmt_t) Statements with scopes */
+    slist_t exprs;      /**< (exprs_t) Initializer lists */
 } trans_unit_t;
 
 typedef struct struct_iter_t {
@@ -585,17 +605,17 @@ typedef struct struct_iter_t {
     decl_node_t *node;
 } struct_iter_t;
 
-type_t *ast_type_create(trans_unit_t *tunit, fmark_t *mark, type_type_t type);
+type_t *ast_type_create(trans_unit_t *tunit, fmark_t mark, type_type_t type);
 
-expr_t *ast_expr_create(trans_unit_t *tunit, fmark_t *mark, expr_type_t type);
+expr_t *ast_expr_create(trans_unit_t *tunit, fmark_t mark, expr_type_t type);
 
-decl_node_t *ast_decl_node_create(trans_unit_t *tunit, fmark_t *mark);
+decl_node_t *ast_decl_node_create(trans_unit_t *tunit, fmark_t mark);
 
-decl_t *ast_decl_create(trans_unit_t *tunit, fmark_t *mark);
+decl_t *ast_decl_create(trans_unit_t *tunit, fmark_t mark);
 
-stmt_t *ast_stmt_create(trans_unit_t *tunit, fmark_t *mark, stmt_type_t type);
+stmt_t *ast_stmt_create(trans_unit_t *tunit, fmark_t mark, stmt_type_t type);
 
-gdecl_t *ast_gdecl_create(trans_unit_t *tunit, fmark_t *mark,
+gdecl_t *ast_gdecl_create(trans_unit_t *tunit, fmark_t mark,
                           gdecl_type_t type);
 
 trans_unit_t *ast_trans_unit_create(bool dummy);
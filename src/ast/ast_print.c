@@ -67,6 +67,11 @@ void ast_gdecl_print(gdecl_t *gdecl) {
     ast_decl_print(gdecl->decl, TYPE_VOID, 0, NULL, NULL);
     switch (gdecl->type) {
     case GDECL_FDEFN:
+        // Bodies which were never needed are not parsed
+        if (gdecl->fdefn.stmt == NULL) {
+            printf(";");
+            break;
+        }
         printf("\n");
         ast_stmt_print(gdecl->fdefn.stmt, 0);
         break;
@@ -435,6 +440,12 @@ void ast_expr_print(expr_t *expr, int indent, char **dest, size_t *remain) {
         ast_directed_print(dest, remain, "\"%s\"",
                            expr->const_val.str_val);
         break;
+    case EXPR_EMBED:
+        for (size_t i = 0; i < expr->embed.len; ++i) {
+            ast_directed_print(dest, remain, i == 0 ? "%u" : ",%u",
+                               (unsigned char)expr->embed.data[i]);
+        }
+        break;
     case EXPR_BIN:
         ast_expr_print(expr->bin.expr1, 0, dest, remain);
         ast_directed_print(dest, remain, " ");
@@ -26,42 +26,21 @@
 #define PRINT_BUF_SIZE 4096
 
 /**
- * Destroys a type_t that is not on a decl_node
- *
- * @param type Object to destroy
- */
-void ast_type_destroy(type_t *type);
-
-/**
- * Destroys a expr_t.
+ * Releases memory an expr_t owns outside of the arena
  *
  * @param expr Object to destroy
  */
 void ast_expr_destroy(expr_t *expr);
 
 /**
- * Destroys a decl_node_t.
- *
- * @param decl_node Object to destroy
- */
-void ast_decl_node_destroy(decl_node_t *decl_node);
-
-/**
- * Destroys a decl_t.
- *
- * @param decl Object to destroy
- */
-void ast_decl_destroy(decl_t *decl);
-
-/**
- * Destroys a stmt_t.
+ * Releases memory a stmt_t owns outside of the arena
  *
  * @param stmt Object to destroy
  */
 void ast_stmt_destroy(stmt_t *stmt);
 
 /**
- * Destroys a gdecl_t.
+ * Releases memory a gdecl_t owns outside of the arena
  *
  * @param gdecl Object to destroy
  */
@@ -24,19 +24,16 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdalign.h>
+#include <stdint.h>
 
 #include "ast/ast.h"
 
 #include "util/logger.h"
+#include "util/string_store.h"
 #include "util/util.h"
 
-#define PRIM_TYPE_FILE "<primitive_type>"
-
-static fmark_t s_prim_type_mark =
-    FMARK_LIT(NULL, PRIM_TYPE_FILE, PRIM_TYPE_FILE, 0, 0);
-
 #define TYPE_LITERAL(typename, type) \
-    { SL_LINK_LIT, &s_prim_type_mark, typename, true, { } }
+    { SL_LINK_LIT, FMARK_PRIM_TYPE, typename, true, { } }
 
 static type_t stt_void        = TYPE_LITERAL(TYPE_VOID       , void       );
 static type_t stt_bool        = TYPE_LITERAL(TYPE_BOOL       , _Bool      );
@@ -52,19 +49,19 @@ static type_t stt_long_double = TYPE_LITERAL(TYPE_LONG_DOUBLE, long double);
 // TODO1: This isn't portable
 // size_t is unsigned long.
 static type_t stt_size_t = {
-    SL_LINK_LIT, &s_prim_type_mark, TYPE_MOD, true,
+    SL_LINK_LIT, FMARK_PRIM_TYPE, TYPE_MOD, true,
     { .mod = { TMOD_UNSIGNED, NULL, NULL, 0, &stt_long } }
 };
 
 static type_t stt_va_list = TYPE_LITERAL(TYPE_VA_LIST, va_list);
 
 static type_t stt_implicit_func = {
-    SL_LINK_LIT, &s_prim_type_mark, TYPE_FUNC, true,
+    SL_LINK_LIT, FMARK_PRIM_TYPE, TYPE_FUNC, true,
     { .func = { &stt_int, SLIST_LIT(offsetof(decl_t, link)), false } }
 };
 
 static type_t stt_implicit_func_ptr = {
-    SL_LINK_LIT, &s_prim_type_mark, TYPE_PTR, true,
+    SL_LINK_LIT, FMARK_PRIM_TYPE, TYPE_PTR, true,
     { .ptr = { &stt_implicit_func, TMOD_NONE } }
 };
 
@@ -87,7 +84,8 @@ type_t * const tt_implicit_func = &stt_implicit_func;
 type_t * const tt_implicit_func_ptr = &stt_implicit_func_ptr;
 
 #define TYPE_TAB_LITERAL_ENTRY(type, type_str)                  \
-    { SL_LINK_LIT, type_str, NULL, TT_PRIM , &stt_ ## type, { } }
+    { SL_LINK_LIT, type_str, NULL, TT_PRIM , &stt_ ## type, { }, NULL, \
+      SL_LINK_LIT, 0 }
 
 /**
  * Table of primative types
@@ -107,10 +105,7 @@ static typetab_entry_t s_prim_types[] = {
     TYPE_TAB_LITERAL_ENTRY(va_list,     "__builtin_va_list"),
 };
 
-void tt_init(typetab_t *tt, typetab_t *last) {
-    assert(tt != NULL);
-    tt->last = last;
-
+static void tt_init_tables(typetab_t *tt) {
     static const ht_params_t params = {
         0,                               // Size estimate
         offsetof(typetab_entry_t, key),  // Offset of key
@@ -119,8 +114,31 @@ void tt_init(typetab_t *tt, typetab_t *last) {
         ind_str_eq                           // void string compare
     };
 
+    tt->owner = tt;
+    tt->next_seq = 1; // Primitive types are 0, so they're never hidden
+    tt->current = tt;
     ht_init(&tt->types, &params);
     ht_init(&tt->compound_types, &params);
+}
+
+void tt_init(typetab_t *tt, typetab_t *last) {
+    assert(tt != NULL);
+    tt->last = last;
+    tt->depth = last == NULL ? 0 : last->depth + 1;
+    sl_init(&tt->entries, offsetof(typetab_entry_t, scope_link));
+
+    // Blocks nested in a function use the tables of its outermost block
+    if (last != NULL && last->last != NULL) {
+        tt->owner = last->owner;
+        tt->types.buckets = NULL;
+        tt->types.nbuckets = 0;
+        tt->compound_types.buckets = NULL;
+        tt->compound_types.nbuckets = 0;
+        tt->next_seq = 0;
+        tt->current = NULL;
+        return;
+    }
+    tt_init_tables(tt);
 
     // Initialize top level table with primitive types
     if (last == NULL) {
@@ -133,28 +151,109 @@ void tt_init(typetab_t *tt, typetab_t *last) {
     }
 }
 
-static void typetab_entry_destroy(typetab_entry_t *entry) {
-    switch (entry->entry_type) {
-    case TT_PRIM:
-        // Ignore primitive types, they are in static memory
-        return;
-    case TT_COMPOUND:
-    case TT_TYPEDEF:
-    case TT_VAR:
-    case TT_ENUM_ID:
-        break;
-    default:
-        assert(false);
-    }
-    free(entry);
+void tt_init_empty(typetab_t *tt) {
+    assert(tt != NULL);
+    tt->last = NULL;
+    tt->depth = 0;
+    sl_init(&tt->entries, offsetof(typetab_entry_t, scope_link));
+    tt_init_tables(tt);
 }
 
 void tt_destroy(typetab_t *tt) {
     assert(tt != NULL);
-    // This order is important. types may point to typedef_bases,
-    // typedef_bases may point to compound types
-    HT_DESTROY_FUNC(&tt->types, typetab_entry_destroy);
-    HT_DESTROY_FUNC(&tt->compound_types, typetab_entry_destroy);
+    // Entries are owned by the scope they are declared in. Primitive types
+    // are in static memory, and not in any scope's entries
+    SL_DESTROY_FUNC(&tt->entries, free);
+    if (tt->owner == tt) {
+        ht_destroy(&tt->types);
+        ht_destroy(&tt->compound_types);
+    }
+}
+
+/**
+ * Returns true if scope is tt or encloses it
+ */
+static bool tt_in_scope(typetab_t *tt, typetab_t *scope) {
+    while (tt->depth > scope->depth) {
+        tt = tt->last;
+    }
+    return tt == scope;
+}
+
+/**
+ * Makes an entry the innermost binding of its key in the owner's tables
+ */
+static status_t tt_push_binding(typetab_t *owner, typetab_entry_t *entry) {
+    htable_t *ht = entry->entry_type == TT_COMPOUND ?
+        &owner->compound_types : &owner->types;
+    entry->shadow = ht_remove(ht, &entry->key);
+    status_t status = ht_insert(ht, &entry->link);
+    if (status != CCC_OK && entry->shadow != NULL) {
+        ht_insert(ht, &entry->shadow->link);
+    }
+    return status;
+}
+
+/**
+ * Binds the names of the scopes between outer and tt, outermost first
+ */
+static void tt_bind_scopes(typetab_t *outer, typetab_t *tt) {
+    if (tt == outer) {
+        return;
+    }
+    tt_bind_scopes(outer, tt->last);
+    SL_FOREACH(cur, &tt->entries) {
+        status_t status = tt_push_binding(tt->owner,
+                                          GET_ELEM(&tt->entries, cur));
+        assert(status == CCC_OK);
+    }
+}
+
+/**
+ * Unbinds the names of a scope. The scope must be the current one
+ */
+static void tt_unbind_scope(typetab_t *tt) {
+    SL_FOREACH(cur, &tt->entries) {
+        typetab_entry_t *entry = GET_ELEM(&tt->entries, cur);
+        htable_t *ht = entry->entry_type == TT_COMPOUND ?
+            &tt->owner->compound_types : &tt->owner->types;
+        typetab_entry_t *removed = ht_remove(ht, &entry->key);
+        assert(removed == entry);
+        if (entry->shadow != NULL) {
+            status_t status = ht_insert(ht, &entry->shadow->link);
+            assert(status == CCC_OK);
+        }
+    }
+}
+
+/**
+ * Makes tt the current scope of its owner, leaving the scopes which don't
+ * enclose it and entering the ones between
+ */
+static void tt_make_current(typetab_t *tt) {
+    typetab_t *owner = tt->owner;
+    typetab_t *cur = owner->current;
+    if (cur == tt) {
+        return;
+    }
+
+    // Leave scopes until reaching one which encloses tt
+    typetab_t *enclosing = tt;
+    while (enclosing->depth > cur->depth) {
+        enclosing = enclosing->last;
+    }
+    while (cur->depth > enclosing->depth) {
+        tt_unbind_scope(cur);
+        cur = cur->last;
+    }
+    while (cur != enclosing) {
+        tt_unbind_scope(cur);
+        cur = cur->last;
+        enclosing = enclosing->last;
+    }
+
+    tt_bind_scopes(cur, tt);
+    owner->current = tt;
 }
 
 status_t tt_insert(typetab_t *tt, type_t *type, tt_type_t tt_type, char *name,
@@ -164,21 +263,28 @@ status_t tt_insert(typetab_t *tt, type_t *type, tt_type_t tt_type, char *name,
     assert(name != NULL);
 
     status_t status = CCC_OK;
+    htable_t *ht = tt_type == TT_COMPOUND ?
+        &tt->owner->compound_types : &tt->owner->types;
+
+    // Only the names of the scopes enclosing tt are bound, innermost first
+    tt_make_current(tt);
+    typetab_entry_t *first = ht_lookup(ht, &name);
+    if (first != NULL && first->typetab == tt) {
+        return CCC_DUPLICATE;
+    }
+
     typetab_entry_t *new_entry = ecalloc(1, sizeof(typetab_entry_t));
 
     new_entry->type = type;
     new_entry->entry_type = tt_type;
     new_entry->key = name;
     new_entry->typetab = tt;
+    new_entry->seq = tt->owner->next_seq++;
 
-    if (tt_type == TT_COMPOUND) {
-        status = ht_insert(&tt->compound_types, &new_entry->link);
-    } else {
-        status = ht_insert(&tt->types, &new_entry->link);
-    }
-    if (status != CCC_OK) {
+    if (CCC_OK != (status = tt_push_binding(tt->owner, new_entry))) {
         goto fail;
     }
+    sl_append(&tt->entries, &new_entry->scope_link);
 
     if (entry) {
         *entry = new_entry;
@@ -190,24 +296,142 @@ fail:
     return status;
 }
 
-typetab_entry_t *tt_lookup(typetab_t *tt, char *key) {
-    for (;tt != NULL; tt = tt->last) {
-        typetab_entry_t *result;
-        if (NULL != (result = ht_lookup(&tt->types, &key))) {
-            return result;
+/**
+ * Finds the innermost binding of key visible from tt
+ *
+ * @param tt Scope to lookup from
+ * @param key Key to lookup with
+ * @param compound Whether to lookup a tag
+ * @param limit File scope entries from this sequence on are ignored
+ */
+static typetab_entry_t *tt_lookup_helper(typetab_t *tt, char *key,
+                                         bool compound, size_t limit) {
+    // One probe per function, then the file scope
+    for (; tt != NULL; tt = tt->owner->last) {
+        // From a scope enclosing the current one, the names of the scopes in
+        // between are skipped instead of unbound
+        if (!tt_in_scope(tt->owner->current, tt)) {
+            tt_make_current(tt);
+        }
+        htable_t *ht = compound ? &tt->owner->compound_types :
+            &tt->owner->types;
+
+        for (typetab_entry_t *cur = ht_lookup(ht, &key); cur != NULL;
+             cur = cur->shadow) {
+            if (cur->typetab->depth > tt->depth ||
+                (cur->typetab->last == NULL && cur->seq >= limit)) {
+                continue;
+            }
+            return cur;
         }
     }
 
     return NULL;
 }
 
+typetab_entry_t *tt_lookup(typetab_t *tt, char *key) {
+    return tt_lookup_helper(tt, key, false, SIZE_MAX);
+}
+
 typetab_entry_t *tt_lookup_compound(typetab_t *tt, char *key) {
-    for (;tt != NULL; tt = tt->last) {
-        typetab_entry_t *result;
-        if (NULL != (result = ht_lookup(&tt->compound_types, &key))) {
-            return result;
-        }
+    return tt_lookup_helper(tt, key, true, SIZE_MAX);
+}
+
+size_t tt_file_seq(typetab_t *tt) {
+    while (tt->last != NULL) {
+        tt = tt->last;
     }
+    return tt->next_seq;
+}
 
-    return NULL;
+size_t tt_file_advance(typetab_t *tt) {
+    while (tt->last != NULL) {
+        tt = tt->last;
+    }
+    return tt->next_seq++;
+}
+
+typetab_entry_t *tt_lookup_before(typetab_t *tt, char *key, size_t limit) {
+    return tt_lookup_helper(tt, key, false, limit);
+}
+
+typetab_entry_t *tt_lookup_compound_before(typetab_t *tt, char *key,
+                                           size_t limit) {
+    return tt_lookup_helper(tt, key, true, limit);
+}
+
+/**
+ * Hash of a name from the string store, which is its address
+ */
+static uint32_t tt_name_hash(const void *key) {
+    uint64_t addr = (uintptr_t)*(char * const *)key;
+    return (uint32_t)(addr >> 4) ^ (uint32_t)(addr >> 36);
+}
+
+/**
+ * Names from the string store are equal if they are the same string
+ */
+static bool tt_name_eq(const void *key1, const void *key2) {
+    return *(char * const *)key1 == *(char * const *)key2;
+}
+
+void tt_bindings_init(tt_bindings_t *bindings) {
+    static const ht_params_t params = {
+        0,                              // Size estimate
+        offsetof(ht_ptr_elem_t, key),   // Offset of key
+        offsetof(ht_ptr_elem_t, link),  // Offset of ht link
+        tt_name_hash,                   // Hash function
+        tt_name_eq,                     // Pointer compare
+    };
+
+    ht_init(&bindings->names, &params);
+    vec_init(&bindings->log, 0);
+}
+
+void tt_bindings_destroy(tt_bindings_t *bindings) {
+    HT_DESTROY_FUNC(&bindings->names, free);
+    vec_destroy(&bindings->log);
+}
+
+/**
+ * Binds a name to a typedef, recording the typedef it had in the undo log
+ */
+static void tt_bind_name(tt_bindings_t *bindings, char *name,
+                         typetab_entry_t *entry) {
+    ht_ptr_elem_t *elem = ht_lookup(&bindings->names, &name);
+    if (elem == NULL) {
+        elem = emalloc(sizeof(*elem));
+        elem->key = name;
+        elem->val = NULL;
+        status_t status = ht_insert(&bindings->names, &elem->link);
+        assert(status == CCC_OK);
+    }
+    vec_push_back(&bindings->log, elem);
+    vec_push_back(&bindings->log, elem->val);
+    elem->val = entry;
+}
+
+void tt_bind(tt_bindings_t *bindings, typetab_entry_t *entry) {
+    tt_bind_name(bindings, entry->key, entry);
+}
+
+void tt_unbind(tt_bindings_t *bindings, size_t mark) {
+    while (vec_size(&bindings->log) > mark) {
+        typetab_entry_t *hidden = vec_pop_back(&bindings->log);
+        ht_ptr_elem_t *elem = vec_pop_back(&bindings->log);
+        elem->val = hidden;
+    }
+}
+
+void tt_bind_prims(tt_bindings_t *bindings) {
+    // The static entries are shared, so their names are interned here
+    for (size_t i = 0; i < STATIC_ARRAY_LEN(s_prim_types); ++i) {
+        tt_bind_name(bindings, sstore_lookup(s_prim_types[i].key),
+                     &s_prim_types[i]);
+    }
+}
+
+typetab_entry_t *tt_binding(tt_bindings_t *bindings, char *name) {
+    ht_ptr_elem_t *elem = ht_lookup(&bindings->names, &name);
+    return elem == NULL ? NULL : elem->val;
 }
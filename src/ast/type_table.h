@@ -25,15 +25,33 @@
 
 #include "util/htable.h"
 #include "util/util.h"
+#include "util/vector.h"
 
 struct type_t;
 struct decl_t;
 struct decl_node_t;
 
+/**
+ * A scope. The file scope and the outermost block of each function hold flat
+ * tables of the names declared in them and all of their nested scopes, so
+ * entering a block allocates nothing and a lookup probes at most one table per
+ * function.
+ *
+ * The tables of a function only bind the names of the scopes enclosing its
+ * current scope. Looking up or inserting in another scope of the function
+ * first unbinds the names of the scopes being left and binds those of the
+ * scopes being entered, so walking the function's scopes in order costs time
+ * linear in its names.
+ */
 typedef struct typetab_t {
-    struct typetab_t *last;
-    htable_t types;
-    htable_t compound_types;
+    struct typetab_t *last;  /**< Enclosing scope, NULL at file scope */
+    struct typetab_t *owner; /**< Scope holding the tables used by this one */
+    size_t depth;            /**< Number of enclosing scopes */
+    slist_t entries;         /**< (typetab_entry_t) Names declared here */
+    htable_t types;          /**< Only in owners. Innermost binding of names */
+    htable_t compound_types; /**< Only in owners. Same for tags */
+    size_t next_seq;         /**< Only in owners. Sequence of the next entry */
+    struct typetab_t *current; /**< Only in owners. Innermost bound scope */
 } typetab_t;
 
 typedef enum tt_type_t {
@@ -58,6 +76,9 @@ typedef struct typetab_entry_t {
         long long enum_val; /**< Value of an enumeration type */
         bool struct_defined;
     };
+    struct typetab_entry_t *shadow; /**< Binding of key this one hides */
+    sl_link_t scope_link;           /**< Link in typetab's entries */
+    size_t seq;                     /**< Order of insertion in the owner */
 } typetab_entry_t;
 
 extern struct type_t * const tt_void;
@@ -87,6 +108,13 @@ extern struct type_t * const tt_implicit_func_ptr;
  */
 void tt_init(typetab_t *tt, typetab_t *last);
 
+/**
+ * Initalizes a top level type table without the primitive types
+ *
+ * @param tt Type table to initialize
+ */
+void tt_init_empty(typetab_t *tt);
+
 /**
  * Destroys a type table
  *
@@ -132,4 +160,103 @@ typetab_entry_t *tt_lookup(typetab_t *tt, char *key);
  */
 typetab_entry_t *tt_lookup_compound(typetab_t *tt, char *key);
 
+/**
+ * Returns the point reached by the file scope of a type table, for use with
+ * tt_lookup_before
+ *
+ * @param tt Type table in the file scope to take the point of
+ * @return Sequence of the next name declared at file scope
+ */
+size_t tt_file_seq(typetab_t *tt);
+
+/**
+ * Returns the point reached by the file scope of a type table, and moves the
+ * file scope past it. Used to order events other than declarations with names
+ *
+ * @param tt Type table in the file scope to take the point of
+ * @return Point which is before everything declared afterwards
+ */
+size_t tt_file_advance(typetab_t *tt);
+
+/**
+ * Looks up a type in the type table, ignoring names declared at file scope
+ * after a point. Used to parse a function body after the rest of the file
+ *
+ * @param tt Type table to lookup in
+ * @param key Key to lookup with
+ * @param limit Point from tt_file_seq. Later file scope names are ignored
+ * @return Returns pointer to type table entry, or NULL if it doesn't exist
+ */
+typetab_entry_t *tt_lookup_before(typetab_t *tt, char *key, size_t limit);
+
+/**
+ * Looks up a compound type in the type table, ignoring tags declared at file
+ * scope after a point
+ *
+ * @param tt Type table to lookup in
+ * @param key Key to lookup with
+ * @param limit Point from tt_file_seq. Later file scope tags are ignored
+ * @return Returns pointer to type table entry, or NULL if it doesn't exist
+ */
+typetab_entry_t *tt_lookup_compound_before(typetab_t *tt, char *key,
+                                           size_t limit);
+
+/**
+ * The typedef each identifier names where the parser is, so telling whether an
+ * identifier is a type takes one probe. Names are keyed by their pointer from
+ * the string store.
+ */
+typedef struct tt_bindings_t {
+    htable_t names; /**< (ht_ptr_elem_t) Typedef bound to each name */
+    vec_t log;      /**< Undo log. Pairs of a name's element and its typedef */
+} tt_bindings_t;
+
+/**
+ * Initializes the parser's typedef bindings, with no names bound
+ *
+ * @param bindings The bindings to initialize
+ */
+void tt_bindings_init(tt_bindings_t *bindings);
+
+/**
+ * Destroys the parser's typedef bindings
+ *
+ * @param bindings The bindings to destroy
+ */
+void tt_bindings_destroy(tt_bindings_t *bindings);
+
+/**
+ * Makes a typedef the parser's binding of its name, so it can be found with
+ * tt_binding
+ *
+ * @param bindings The bindings to record it in
+ * @param entry The typedef. Its key must be from the string store
+ */
+void tt_bind(tt_bindings_t *bindings, typetab_entry_t *entry);
+
+/**
+ * Restores the bindings hidden since the undo log had a given size. Used when
+ * leaving a scope.
+ *
+ * @param bindings The bindings to restore
+ * @param mark Size of the bindings' log to restore to
+ */
+void tt_unbind(tt_bindings_t *bindings, size_t mark);
+
+/**
+ * Binds the names of the primitive types
+ *
+ * @param bindings The bindings to record them in
+ */
+void tt_bind_prims(tt_bindings_t *bindings);
+
+/**
+ * Returns the typedef the parser has bound to an identifier
+ *
+ * @param bindings The parser's bindings
+ * @param name The identifier. Must be from the string store
+ * @return The typedef or primitive type entry, NULL if none
+ */
+typetab_entry_t *tt_binding(tt_bindings_t *bindings, char *name);
+
 #endif /* _TYPE_TABLE_H_ */
@@ -112,6 +112,7 @@ typedef enum ir_const_type_t {
     IR_CONST_NULL,
     IR_CONST_STRUCT,
     IR_CONST_STR,
+    IR_CONST_BYTES,
     IR_CONST_ARR,
     IR_CONST_ZERO,
     IR_CONST_UNDEF,
@@ -229,6 +230,10 @@ struct ir_expr_t {
                 slist_t struct_val; /**< (ir_expr_t) */
                 char *str_val;
                 slist_t arr_val; /**< (ir_expr_t) */
+                struct {
+                    char *data; /**< Leading bytes of the i8 array */
+                    size_t len; /**< Number of bytes, the rest are zero */
+                } bytes_val;
             };
         } const_params;
 
@@ -308,6 +308,28 @@ void ir_expr_print(FILE *stream, ir_expr_t *expr, bool recurse) {
             fprintf(stream, "\\00\"");
             break;
         }
+        case IR_CONST_BYTES: {
+            assert(expr->const_params.type->type == IR_TYPE_ARR);
+            size_t nelems = expr->const_params.type->arr.nelems;
+            size_t len = expr->const_params.bytes_val.len;
+            assert(len <= nelems);
+
+            fprintf(stream, " c\"");
+            unsigned char *data =
+                (unsigned char *)expr->const_params.bytes_val.data;
+            for (size_t i = 0; i < len; ++i) {
+                if (isprint(data[i]) && data[i] != '"' && data[i] != '\\') {
+                    putc(data[i], stream);
+                } else {
+                    fprintf(stream, "\\%.2X", data[i]);
+                }
+            }
+            for (size_t i = len; i < nelems; ++i) {
+                fprintf(stream, "\\00");
+            }
+            fprintf(stream, "\"");
+            break;
+        }
         case IR_CONST_ARR: {
             fprintf(stream, "[ ");
             assert(expr->const_params.type->type == IR_TYPE_ARR);
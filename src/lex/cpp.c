@@ -26,6 +26,7 @@
 #include "cpp.h"
 #include "cpp_priv.h"
 #include "cpp_directives.h"
+#include "cpp_pch.h"
 
 #include <assert.h>
 #include <time.h>
@@ -103,21 +104,242 @@ static struct {
     { "__TIME__", CPP_MACRO_TIME }
 };
 
-extern void cpp_iter_skip_space(vec_iter_t *iter);
+static const ht_params_t s_macro_params = {
+    STATIC_ARRAY_LEN(s_predef_macros), // Size estimate
+    offsetof(cpp_macro_t, name),         // Offset of key
+    offsetof(cpp_macro_t, link),         // Offset of ht link
+    ind_str_hash,                        // Hash function
+    ind_str_eq,                          // void string compare
+};
 
-status_t cpp_state_init(cpp_state_t *cs, token_man_t *token_man,
-                        lexer_t *lexer) {
-    status_t status = CCC_OK;
+/**
+ * Macros defined before any file is processed. They are lexed and defined
+ * once, and shared by every file.
+ */
+typedef struct cpp_predef_t {
+    bool initialized;  /**< Whether the macros have been defined */
+    status_t status;   /**< Status of defining the macros */
+    symtab_t symtab;   /**< Symbol table for lexing the macros */
+    token_man_t token_man; /**< Owns the tokens of the macros */
+    lexer_t lexer;     /**< Lexer for the macros */
+    htable_t macros;   /**< char * -> cpp_macro_t */
+} cpp_predef_t;
+
+static cpp_predef_t s_predef;
+
+static const ht_params_t s_shared_params = {
+    0,                                      // Size estimate
+    offsetof(cpp_shared_file_t, id),        // Offset of key
+    offsetof(cpp_shared_file_t, link),      // Offset of ht link
+    fdir_id_hash,                           // Hash function
+    fdir_id_eq,                             // Identity compare
+};
+
+/**
+ * Included files, lexed once and shared by every file processed
+ */
+typedef struct cpp_shared_t {
+    bool initialized;      /**< Whether the table has been created */
+    symtab_t symtab;       /**< Symbol table for lexing the files */
+    token_man_t token_man; /**< Owns the tokens of the files */
+    lexer_t lexer;         /**< Lexer for the files */
+    htable_t files;        /**< fdir_id_t -> cpp_shared_file_t */
+} cpp_shared_t;
+
+static cpp_shared_t s_shared;
 
-    static const ht_params_t params = {
-        STATIC_ARRAY_LEN(s_predef_macros), // Size estimate
-        offsetof(cpp_macro_t, name),         // Offset of key
-        offsetof(cpp_macro_t, link),         // Offset of ht link
-        ind_str_hash,                        // Hash function
-        ind_str_eq,                          // void string compare
-    };
+/**
+ * Defines the predefined macros if they haven't been already
+ */
+static status_t cpp_predef_init(void) {
+    if (s_predef.initialized) {
+        return s_predef.status;
+    }
+    s_predef.initialized = true;
+    s_predef.status = CCC_OK;
+
+    // Empty while the macros are defined in a state of their own
+    ht_init(&s_predef.macros, &s_macro_params);
+    st_init(&s_predef.symtab, true);
+    token_man_init(&s_predef.token_man);
+    lexer_init(&s_predef.lexer, &s_predef.token_man, &s_predef.symtab);
+
+    cpp_state_t cs;
+    status_t status = cpp_state_init(&cs, &s_predef.token_man,
+                                     &s_predef.lexer);
+
+    // Add special macros
+    for (size_t i = 0;
+         status == CCC_OK && i < STATIC_ARRAY_LEN(s_special_macros); ++i) {
+        status = cpp_macro_define(&cs, s_special_macros[i].name,
+                                  s_special_macros[i].type, false);
+    }
+
+    // Add default macros
+    for (size_t i = 0;
+         status == CCC_OK && i < STATIC_ARRAY_LEN(s_predef_macros); ++i) {
+        status = cpp_macro_define(&cs, s_predef_macros[i], CPP_MACRO_BASIC,
+                                  false);
+    }
 
-    ht_init(&cs->macros, &params);
+    for (size_t i = 0; status == CCC_OK && i < vec_size(&optman.macros); ++i) {
+        char *macro = vec_get(&optman.macros, i);
+        status = cpp_macro_define(&cs, macro, CPP_MACRO_BASIC, false);
+    }
+
+    // The state's macros become the predefined macros
+    ht_destroy(&s_predef.macros);
+    s_predef.macros = cs.macros;
+    ht_init(&cs.macros, &s_macro_params);
+    cpp_state_destroy(&cs);
+
+    s_predef.status = status;
+    return status;
+}
+
+static void cpp_shared_file_destroy(cpp_shared_file_t *shared) {
+    vec_destroy(&shared->file.tokens);
+    VEC_FOREACH(cur, &shared->gaps) {
+        free(vec_get(&shared->gaps, cur));
+    }
+    vec_destroy(&shared->gaps);
+    free(shared);
+}
+
+/**
+ * Returns the shared tokens of an included file, creating them if the file
+ * hasn't been included before. Returns NULL if lexing the file failed before,
+ * so the file is lexed privately and the errors are reported again.
+ */
+static cpp_shared_file_t *cpp_shared_file(fdir_entry_t *entry) {
+    if (!s_shared.initialized) {
+        st_init(&s_shared.symtab, true);
+        token_man_init(&s_shared.token_man);
+        lexer_init(&s_shared.lexer, &s_shared.token_man, &s_shared.symtab);
+        ht_init(&s_shared.files, &s_shared_params);
+        s_shared.initialized = true;
+    }
+
+    // Files are shared by identity, whichever path they're included by
+    fdir_entry_t *file = entry->file;
+    cpp_shared_file_t *shared = ht_lookup(&s_shared.files, &file->id);
+    if (shared != NULL) {
+        return shared->file.status == CCC_OK ? shared : NULL;
+    }
+
+    shared = emalloc(sizeof(*shared));
+    shared->id = file->id;
+    ts_init(&shared->file.stream, file->buf, file->end, file->mark);
+    vec_init(&shared->file.tokens, 0);
+    shared->file.status = CCC_OK;
+    shared->file.shared = NULL;
+    vec_init(&shared->gaps, 0);
+    ht_insert(&s_shared.files, &shared->link);
+
+    return shared;
+}
+
+/**
+ * Returns the group skipped before the token at idx of a shared file, or NULL
+ * if there is none
+ */
+static cpp_file_gap_t *cpp_shared_gap(cpp_shared_file_t *shared, size_t idx) {
+    size_t lo = 0;
+    size_t hi = vec_size(&shared->gaps);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        cpp_file_gap_t *gap = vec_get(&shared->gaps, mid);
+        if (gap->idx == idx) {
+            return gap;
+        }
+        if (gap->idx < idx) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Appends the next line of a shared file onto file's tokens, lexing it if no
+ * file has needed it yet. If the line follows a group skipped by the file
+ * which lexed it, but the group is active here, file switches to lexing the
+ * rest privately.
+ *
+ * @return false if the shared file has no more lines
+ */
+static bool cpp_shared_next_line(cpp_state_t *cs, cpp_file_t *file) {
+    cpp_shared_file_t *shared = file->shared;
+    cpp_file_t *sfile = &shared->file;
+    size_t idx = vec_size(&file->tokens);
+
+    if (idx == vec_size(&sfile->tokens)) {
+        if (sfile->status != CCC_OK || ts_peek(&sfile->stream) == EOF) {
+            file->status = sfile->status;
+            return false;
+        }
+
+        // Only the directive ending the group matters when ignoring
+        if (cs->ignore) {
+            cpp_file_gap_t *gap = emalloc(sizeof(*gap));
+            gap->idx = idx;
+            gap->stream = sfile->stream;
+            lexer_skip_group(&sfile->stream);
+            if (ts_pos(&sfile->stream) != ts_pos(&gap->stream)) {
+                vec_push_back(&shared->gaps, gap);
+            } else {
+                free(gap);
+            }
+        }
+        sfile->status = lexer_lex_line(&s_shared.lexer, &sfile->stream,
+                                       &sfile->tokens);
+        file->status = sfile->status;
+    } else if (!cs->ignore) {
+        cpp_file_gap_t *gap = cpp_shared_gap(shared, idx);
+        if (gap != NULL) {
+            file->stream = gap->stream;
+            file->shared = NULL;
+            return true;
+        }
+    }
+
+    size_t end = vec_size(&sfile->tokens);
+    for (size_t cur = idx; cur < end; ++cur) {
+        token_t *token = vec_get(&sfile->tokens, cur);
+        if (cur > idx && token->startLine) {
+            break;
+        }
+        vec_push_back(&file->tokens, token);
+    }
+
+    return true;
+}
+
+void cpp_predef_destroy(void) {
+    cpp_pch_destroy();
+    if (s_shared.initialized) {
+        HT_DESTROY_FUNC(&s_shared.files, cpp_shared_file_destroy);
+        lexer_destroy(&s_shared.lexer);
+        token_man_destroy(&s_shared.token_man);
+        st_destroy(&s_shared.symtab);
+        s_shared.initialized = false;
+    }
+    if (!s_predef.initialized) {
+        return;
+    }
+
+    HT_DESTROY_FUNC(&s_predef.macros, cpp_macro_destroy);
+    st_destroy(&s_predef.symtab);
+    lexer_destroy(&s_predef.lexer);
+    token_man_destroy(&s_predef.token_man);
+    s_predef.initialized = false;
+}
+
+status_t cpp_state_init(cpp_state_t *cs, token_man_t *token_man,
+                        lexer_t *lexer) {
+    ht_init(&cs->macros, &s_macro_params);
     vec_init(&cs->search_path, STATIC_ARRAY_LEN(s_search_path));
 
     cs->filename = NULL;
@@ -134,6 +356,12 @@ status_t cpp_state_init(cpp_state_t *cs, token_man_t *token_man,
     cs->in_param = false;
     cs->last_top_token = NULL;
     cs->expand_level = 0;
+    cs->output = NULL;
+    cs->file = NULL;
+    cs->file_mark = FMARK_NONE;
+    cs->printer = NULL;
+    cs->deps = NULL;
+    cs->once = str_set_empty();
 
     // Add search path from command line options
     VEC_FOREACH(cur, &optman.include_paths) {
@@ -145,33 +373,7 @@ status_t cpp_state_init(cpp_state_t *cs, token_man_t *token_man,
         vec_push_back(&cs->search_path, s_search_path[i]);
     }
 
-    // Add special macros
-    for (size_t i = 0; i < STATIC_ARRAY_LEN(s_special_macros); ++i) {
-        if (CCC_OK !=
-            (status = cpp_macro_define(cs, s_special_macros[i].name,
-                                       s_special_macros[i].type, false))) {
-            return status;
-        }
-    }
-
-    // Add default macros
-    for (size_t i = 0; i < STATIC_ARRAY_LEN(s_predef_macros); ++i) {
-        if (CCC_OK !=
-            (status = cpp_macro_define(cs, s_predef_macros[i], CPP_MACRO_BASIC,
-                                       false))) {
-            return status;
-        }
-    }
-
-    VEC_FOREACH(cur, &optman.macros) {
-        char *macro = vec_get(&optman.macros, cur);
-        if (CCC_OK != (status = cpp_macro_define(cs, macro, CPP_MACRO_BASIC,
-                                                 false))) {
-            return status;
-        }
-    }
-
-    return CCC_OK;
+    return cpp_predef_init();
 }
 
 void cpp_macro_destroy(cpp_macro_t *macro) {
@@ -181,120 +383,165 @@ void cpp_macro_destroy(cpp_macro_t *macro) {
 
     vec_destroy(&macro->stream);
     vec_destroy(&macro->params);
+    free(macro->ops);
     free(macro);
 }
 
+cpp_macro_t *cpp_macro_lookup(cpp_state_t *cs, char *name) {
+    cpp_macro_t *macro = ht_lookup(&cs->macros, &name);
+    if (macro == NULL) {
+        macro = cpp_pch_lookup(name);
+    }
+    if (macro == NULL) {
+        macro = ht_lookup(&s_predef.macros, &name);
+    }
+
+    return macro == NULL || macro->type == CPP_MACRO_UNDEF ? NULL : macro;
+}
+
+void cpp_macro_undef(cpp_state_t *cs, char *name) {
+    cpp_macro_destroy(ht_remove(&cs->macros, &name));
+    if (cpp_pch_lookup(name) == NULL &&
+        ht_lookup(&s_predef.macros, &name) == NULL) {
+        return;
+    }
+
+    // Shared macros are hidden instead of removed
+    cpp_macro_t *macro = emalloc(sizeof(*macro));
+    macro->name = name;
+    macro->mark = FMARK_BUILT_IN;
+    vec_init(&macro->stream, 0);
+    vec_init(&macro->params, 0);
+    macro->num_params = -1;
+    macro->type = CPP_MACRO_UNDEF;
+    macro->ops = NULL;
+    macro->num_ops = 0;
+
+    status_t status = ht_insert(&cs->macros, &macro->link);
+    assert(status == CCC_OK);
+}
+
 void cpp_macro_inst_destroy(cpp_macro_inst_t *macro_inst) {
-    SL_FOREACH(cur, &macro_inst->args) {
-        cpp_macro_param_t *param = GET_ELEM(&macro_inst->args, cur);
-        vec_destroy(&param->stream);
+    if (macro_inst->args == NULL) {
+        return;
     }
 
-    SL_DESTROY_FUNC(&macro_inst->args, free);
+    for (int i = 0; i < macro_inst->macro->num_params; ++i) {
+        if (macro_inst->args[i].is_expanded) {
+            vec_destroy(&macro_inst->args[i].expanded);
+        }
+    }
+    free(macro_inst->args);
 }
 
 void cpp_state_destroy(cpp_state_t *cs) {
     HT_DESTROY_FUNC(&cs->macros, cpp_macro_destroy);
     vec_destroy(&cs->search_path);
+    str_set_destroy(cs->once);
 }
 
-token_t *cpp_iter_advance(vec_iter_t *iter, bool skip_space) {
+token_t *cpp_iter_advance(vec_iter_t *iter) {
     if (!vec_iter_has_next(iter)) {
         return NULL;
     }
-    token_t *cur = vec_iter_advance(iter);
-    if (skip_space) {
-        cpp_iter_skip_space(iter);
-    }
-
-    return cur;
+    return vec_iter_advance(iter);
 }
 
-token_t *cpp_iter_lookahead(vec_iter_t *iter, size_t lookahead) {
-    vec_iter_t temp;
-    memcpy(&temp, iter, sizeof(temp));
+bool cpp_iter_has_next(cpp_state_t *cs, vec_iter_t *iter) {
+    cpp_file_t *file = cs->file;
+    if (file == NULL || iter->vec != &file->tokens) {
+        return vec_iter_has_next(iter);
+    }
+
+    while (!vec_iter_has_next(iter) && file->status == CCC_OK) {
+        if (file->shared != NULL) {
+            if (!cpp_shared_next_line(cs, file)) {
+                break;
+            }
+            continue;
+        }
+        if (ts_peek(&file->stream) == EOF) {
+            break;
+        }
 
-    while (vec_iter_has_next(&temp) && lookahead--) {
-        cpp_iter_advance(&temp, true);
+        // Only the directive ending the group matters when ignoring
+        if (cs->ignore) {
+            lexer_skip_group(&file->stream);
+        }
+        file->status = lexer_lex_line(cs->lexer, &file->stream,
+                                      &file->tokens);
     }
 
-    return vec_iter_has_next(&temp) ? vec_iter_get(&temp) : NULL;
+    return vec_iter_has_next(iter);
 }
 
-token_t *cpp_next_nonspace(vec_iter_t *iter, bool inplace) {
-    vec_iter_t temp;
-    vec_iter_t *ts;
-    if (inplace) {
-        ts = iter;
-    } else {
-        memcpy(&temp, iter, sizeof(temp));
-        ts = &temp;
+token_t *cpp_iter_lookahead(vec_iter_t *iter, size_t lookahead) {
+    size_t off = iter->off + lookahead;
+    return off < vec_size(iter->vec) ? vec_get(iter->vec, off) : NULL;
+}
+
+void cpp_join_strings(cpp_state_t *cs, vec_t *output) {
+    size_t end = vec_size(output);
+    size_t begin = end;
+    while (begin > 0 &&
+           ((token_t *)vec_get(output, begin - 1))->type == STRING) {
+        --begin;
+    }
+    if (end - begin < 2) {
+        return;
     }
 
-    cpp_iter_advance(ts, true); // Go to next token
+    string_builder_t sb;
+    sb_init(&sb, 0);
 
-    for (; vec_iter_has_next(ts); cpp_iter_advance(ts, false)) {
-        token_t *token = vec_iter_get(ts);
-        switch (token->type) {
-        case SPACE:
-        case NEWLINE:
-            break;
-        default:
-            return token;
-        }
+    for (size_t i = begin; i < end; ++i) {
+        token_t *token = vec_get(output, i);
+        sb_append_len(&sb, token->str_val, strlen(token->str_val));
     }
 
-    return NULL;
+    token_t *concat = token_copy(cs->token_man, vec_get(output, begin));
+    concat->str_val = sstore_lookup(sb_buf(&sb));
+    sb_destroy(&sb);
+
+    vec_resize(output, begin);
+    vec_push_back(output, concat);
 }
 
 void cpp_stream_append(cpp_state_t *cs, vec_t *output, token_t *token) {
 
-    // Look for strings to concatenate
-    size_t len;
-    if (token->type == STRING && (len = vec_size(output)) > 0) {
-        // Find last non space token
-        token_t *tail = NULL;
-        for (; len > 0; --len) {
-            tail = vec_get(output, len - 1);
-            if (tail->type != SPACE && tail->type != NEWLINE) {
-                break;
-            }
+    // Report lexer errors once they reach the final output
+    if (output == cs->output) {
+        switch (token->type) {
+        case TOK_WARN:
+            logger_log(token->mark, LOG_WARN, token->str_val);
+            return;
+        case TOK_ERR:
+            logger_log(token->mark, LOG_ERR, token->str_val);
+            return;
+        default:
+            break;
         }
 
-        // Combine them if last one was a string
-        if (len != 0 && tail->type == STRING) {
-            do {
-                tail = vec_pop_back(output);
-            } while (tail->type == SPACE || tail->type == NEWLINE);
-
-            string_builder_t sb;
-            sb_init(&sb, 0);
-
-            token_t *concat = token_copy(cs->token_man, tail);
-
-            sb_append_printf(&sb, "%s", tail->str_val);
-            sb_append_printf(&sb, "%s", token->str_val);
-
-            concat->str_val = sstore_lookup(sb_buf(&sb));
-
-            sb_destroy(&sb);
+        if (cs->printer != NULL) {
+            cpp_print_token(cs->printer, token, cs->file_mark);
+            return;
+        }
 
-            token = concat;
+        // Adjacent strings are concatenated once their run ends
+        if (token->type != STRING) {
+            cpp_join_strings(cs, output);
         }
     }
 
     vec_push_back(output, token);
 }
 
-size_t cpp_skip_line(vec_iter_t *ts, bool skip_newline) {
+size_t cpp_skip_line(vec_iter_t *ts) {
     size_t skipped = 0;
 
-    for (; vec_iter_has_next(ts); cpp_iter_advance(ts, false)) {
+    for (; vec_iter_has_next(ts); cpp_iter_advance(ts)) {
         token_t *token = vec_iter_get(ts);
-        if (token->type == NEWLINE) {
-            if (skip_newline) {
-                cpp_iter_advance(ts, false);
-            }
+        if (token->type == TOKEN_EOF) {
             break;
         }
         ++skipped;
@@ -325,8 +572,6 @@ bool cpp_macro_equal(cpp_macro_t *m1, cpp_macro_t *m2) {
     }
 
     vec_iter_t stream1 = { &m1->stream, 0 }, stream2 = { &m2->stream, 0 };
-    cpp_iter_skip_space(&stream1);
-    cpp_iter_skip_space(&stream2);
     while (vec_iter_has_next(&stream1) && vec_iter_has_next(&stream2)) {
         token_t *t1 = vec_iter_get(&stream1);
         token_t *t2 = vec_iter_get(&stream2);
@@ -334,8 +579,8 @@ bool cpp_macro_equal(cpp_macro_t *m1, cpp_macro_t *m2) {
             return false;
         }
 
-        cpp_iter_advance(&stream1, true);
-        cpp_iter_advance(&stream2, true);
+        cpp_iter_advance(&stream1);
+        cpp_iter_advance(&stream2);
     }
 
     if (vec_iter_has_next(&stream1) || vec_iter_has_next(&stream2)) {
@@ -345,23 +590,77 @@ bool cpp_macro_equal(cpp_macro_t *m1, cpp_macro_t *m2) {
     return true;
 }
 
-vec_t *cpp_macro_inst_lookup(cpp_macro_inst_t *inst, char *arg_name) {
-    SL_FOREACH(cur, &inst->args) {
-        cpp_macro_param_t *param = GET_ELEM(&inst->args, cur);
-        if (strcmp(param->name, arg_name) == 0) {
-            return &param->stream;
+/**
+ * Returns the index of the parameter named name, or -1 if there is none
+ */
+static int cpp_macro_param_idx(cpp_macro_t *macro, token_t *token) {
+    if (token->type != ID) {
+        return -1;
+    }
+
+    for (int i = 0; i < macro->num_params; ++i) {
+        char *param = vec_get(&macro->params, i);
+
+        // NULL param denotes vararg
+        if (strcmp(param == NULL ? VARARG_NAME : param, token->id_name) == 0) {
+            return i;
         }
     }
 
-    return NULL;
+    return -1;
+}
+
+status_t cpp_macro_compile(cpp_macro_t *macro) {
+    vec_t *stream = &macro->stream;
+    size_t size = vec_size(stream);
+    macro->ops = size == 0 ? NULL : emalloc(size * sizeof(cpp_macro_op_t));
+    macro->num_ops = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        token_t *token = vec_get(stream, i);
+        token_t *next = i + 1 < size ? vec_get(stream, i + 1) : NULL;
+        cpp_macro_op_t *op = &macro->ops[macro->num_ops++];
+        op->idx = i;
+        op->param = -1;
+
+        if (token->type == HASH && macro->num_params != -1) {
+            if (next == NULL ||
+                -1 == (op->param = cpp_macro_param_idx(macro, next))) {
+                token_t *param = next == NULL ? token : next;
+                logger_log(param->mark, LOG_ERR,
+                           "'#' is not followed by a macro parameter");
+                return CCC_ESYNTAX;
+            }
+            op->type = CPP_OP_STRINGIFY;
+            ++i;
+        } else if (token->type == HASHHASH) {
+            if (i == 0 || next == NULL) {
+                logger_log(token->mark, LOG_ERR, "'##' cannot appear at "
+                           "either end of a macro expansion");
+                return CCC_ESYNTAX;
+            }
+            op->idx = i + 1;
+            op->param = cpp_macro_param_idx(macro, next);
+            op->type = op->param == -1 ? CPP_OP_PASTE : CPP_OP_PASTE_PARAM;
+            ++i;
+        } else if (-1 != (op->param = cpp_macro_param_idx(macro, token))) {
+            op->type = next != NULL && next->type == HASHHASH ?
+                CPP_OP_PARAM_RAW : CPP_OP_PARAM;
+        } else {
+            op->type = CPP_OP_TOKEN;
+        }
+    }
+
+    return CCC_OK;
 }
 
 status_t cpp_macro_define(cpp_state_t *cs, char *string,
                           cpp_macro_type_t type, bool has_eq) {
     status_t status = CCC_OK;
     tstream_t stream;
-    ts_init(&stream, string, string + strlen(string), COMMAND_LINE_FILENAME,
-            NULL);
+    char *end = string + strlen(string);
+    ts_init(&stream, string, end,
+            fmark_register(COMMAND_LINE_FILENAME, string, end));
     vec_t tokens;
     vec_init(&tokens, 0);
 
@@ -379,93 +678,289 @@ fail:
     return status;
 }
 
-status_t cpp_process(token_man_t *token_man, lexer_t *lexer, char *filepath,
-                     vec_t *output) {
+/**
+ * Preprocesses a file into output, or prints it if printer is non NULL. If
+ * pch_path is non NULL, the file is written to it as a precompiled header.
+ */
+static status_t cpp_process_helper(token_man_t *token_man, lexer_t *lexer,
+                                   char *filepath, vec_t *output,
+                                   cpp_printer_t *printer, vec_t *deps,
+                                   char *pch_path) {
     status_t status = CCC_OK;
-    vec_t temp;
-    vec_init(&temp, vec_size(output));
 
     cpp_state_t cs;
     if (CCC_OK != (status = cpp_state_init(&cs, token_man, lexer))) {
         goto fail;
     }
     cs.cur_filename = filepath;
-
-    if (CCC_OK != (status = cpp_process_file(&cs, filepath, &temp))) {
+    cs.output = output;
+    cs.printer = printer;
+    cs.deps = deps;
+
+    // The precompiled header comes before the file
+    if (optman.include_pch != NULL &&
+        CCC_OK != (status = cpp_pch_include(&cs, optman.include_pch,
+                                            output))) {
         goto fail;
     }
 
-    // Do post processing
-    VEC_FOREACH(cur, &temp) {
-        token_t *token = vec_get(&temp, cur);
-        switch (token->type) {
-            // Filter out spaces
-        case SPACE:
-        case NEWLINE: break;
-
-            // Report lexer errors
-        case TOK_WARN: logger_log(token->mark, LOG_WARN, token->str_val); break;
-        case TOK_ERR: logger_log(token->mark, LOG_ERR, token->str_val); break;
+    if (CCC_OK != (status = cpp_process_file(&cs, filepath, output))) {
+        goto fail;
+    }
+    cpp_join_strings(&cs, output);
 
-        default:
-            vec_push_back(output, token);
-        }
+    if (pch_path != NULL) {
+        status = cpp_pch_write(&cs, output, pch_path);
     }
 
 fail:
-    vec_destroy(&temp);
     cpp_state_destroy(&cs);
     return status;
 }
 
+status_t cpp_process(token_man_t *token_man, lexer_t *lexer, char *filepath,
+                     vec_t *output, vec_t *deps) {
+    return cpp_process_helper(token_man, lexer, filepath, output, NULL, deps,
+                              NULL);
+}
+
+status_t cpp_preprocess(token_man_t *token_man, lexer_t *lexer,
+                        char *filepath, FILE *file, vec_t *deps) {
+    vec_t output;
+    vec_init(&output, 0);
+
+    cpp_printer_t printer;
+    cpp_printer_init(&printer, file);
+
+    status_t status = cpp_process_helper(token_man, lexer, filepath, &output,
+                                         &printer, deps, NULL);
+    status_t print_status = cpp_printer_destroy(&printer);
+    if (status == CCC_OK) {
+        status = print_status;
+    }
+
+    vec_destroy(&output);
+    return status;
+}
+
+status_t cpp_write_pch(token_man_t *token_man, lexer_t *lexer,
+                       char *filepath, char *pch_path, vec_t *deps) {
+    vec_t output;
+    vec_init(&output, 0);
+    status_t status = cpp_process_helper(token_man, lexer, filepath, &output,
+                                         NULL, deps, pch_path);
+    vec_destroy(&output);
+    return status;
+}
+
 status_t cpp_process_file(cpp_state_t *cs, char *filename, vec_t *output) {
     status_t status = CCC_OK;
     char *filename_save = cs->filename;
     cs->filename = filename;
 
-    vec_t file_tokens;
-    vec_init(&file_tokens, 0);
+    cpp_file_t *file_save = cs->file;
+    fmark_t file_mark_save = cs->file_mark;
+
+    // Tokens are lexed as they are needed by cpp_iter_has_next
+    cpp_file_t file;
+    vec_init(&file.tokens, 0);
+    file.status = CCC_OK;
 
     fdir_entry_t *entry;
     if (CCC_OK != (status = fdir_insert(filename, &entry))) {
         goto fail;
     }
 
-    tstream_t stream;
-    ts_init(&stream, entry->buf, entry->end, entry->filename, NULL);
-
-    if (CCC_OK != (status = lexer_lex_stream(cs->lexer, &stream,
-                                             &file_tokens))) {
-        goto fail;
+    // Included files are shared with the other files processed. The file
+    // being processed is only lexed once, so it is lexed privately
+    ts_init(&file.stream, entry->buf, entry->end, entry->mark);
+    file.shared = file_save != NULL ? cpp_shared_file(entry) : NULL;
+    cs->file = &file;
+    if (cs->printer != NULL) {
+        cpp_print_enter(cs->printer, fmark_filename(entry->mark));
     }
 
-    vec_iter_t iter = { &file_tokens, 0 };
-    cpp_iter_skip_space(&iter);
+    vec_iter_t iter = { &file.tokens, 0 };
     if (CCC_OK != (status = cpp_expand(cs, &iter, output))) {
         goto fail;
     }
+    if (CCC_OK != (status = file.status)) {
+        goto fail;
+    }
+
+    if (!entry->file->guard_set) {
+        entry->file->guard = cpp_find_guard(&file.tokens);
+        entry->file->guard_set = true;
+    }
+
+    if (cs->printer != NULL) {
+        cpp_print_leave(cs->printer, file_mark_save);
+    }
 
 fail:
-    vec_destroy(&file_tokens);
+    vec_destroy(&file.tokens);
+    cs->file = file_save;
+    cs->file_mark = file_mark_save;
     cs->filename = filename_save;
     return status;
 }
 
+/**
+ * Returns true if path is in one of the default system include directories
+ */
+static bool cpp_is_system_path(char *path) {
+    for (size_t i = 0; i < STATIC_ARRAY_LEN(s_search_path); ++i) {
+        char *dir = s_search_path[i];
+        if (*dir == '\0') {
+            continue;
+        }
+
+        // Relative directories are relative to ccc, as in the search
+        char *rest = path;
+        if (*dir != '/' && *dir != '.') {
+            if (strncmp(rest, optman.ccc_path, optman.ccc_path_len) != 0 ||
+                rest[optman.ccc_path_len] != '/') {
+                continue;
+            }
+            rest += optman.ccc_path_len + 1;
+        }
+
+        size_t len = strlen(dir);
+        if (strncmp(rest, dir, len) == 0 && rest[len] == '/') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void cpp_add_dep(cpp_state_t *cs, char *path) {
+    path = sstore_lookup(path);
+
+    // Paths are interned, so they can be compared by address
+    VEC_FOREACH(cur, cs->deps) {
+        if (vec_get(cs->deps, cur) == path) {
+            return;
+        }
+    }
+    if (!cpp_is_system_path(path)) {
+        vec_push_back(cs->deps, path);
+    }
+}
+
+bool cpp_include_skip(cpp_state_t *cs, fdir_entry_t *entry) {
+    // Both are properties of the file, whichever path it was included by
+    fdir_entry_t *file = entry->file;
+    if (str_set_mem(cs->once, file->filename)) {
+        return true;
+    }
+
+    return file->guard != NULL &&
+        cpp_macro_lookup(cs, file->guard) != NULL;
+}
+
+/**
+ * Returns true if token is a # starting a line followed by a directive named
+ * name
+ */
+static bool cpp_is_directive(vec_t *tokens, size_t idx, const char *name) {
+    if (idx + 1 >= vec_size(tokens)) {
+        return false;
+    }
+    token_t *hash = vec_get(tokens, idx);
+    token_t *dir = vec_get(tokens, idx + 1);
+
+    if (hash->type != HASH || !hash->startLine || dir->startLine) {
+        return false;
+    }
+
+    // Some directive names such as if and else are keywords
+    const char *dir_name = dir->type == ID ? dir->id_name :
+        token_type_str(dir->type);
+    return strcmp(dir_name, name) == 0;
+}
+
+/**
+ * Returns the token at idx if it has the given type and is on the same line
+ * as the preceding tokens. NULL otherwise
+ */
+static token_t *cpp_guard_token(vec_t *tokens, size_t idx, token_type_t type) {
+    if (idx >= vec_size(tokens)) {
+        return NULL;
+    }
+    token_t *token = vec_get(tokens, idx);
+
+    return token->type == type && !token->startLine ? token : NULL;
+}
+
+char *cpp_find_guard(vec_t *tokens) {
+    size_t len = vec_size(tokens);
+    token_t *name = NULL;
+    size_t idx = 0;
+
+    if (cpp_is_directive(tokens, 0, "ifndef")) {
+        // #ifndef X
+        name = cpp_guard_token(tokens, 2, ID);
+        idx = 3;
+    } else if (cpp_is_directive(tokens, 0, "if") &&
+               cpp_guard_token(tokens, 2, LOGICNOT) != NULL &&
+               cpp_guard_token(tokens, 3, ID) != NULL &&
+               strcmp(((token_t *)vec_get(tokens, 3))->id_name,
+                      "defined") == 0) {
+        if (cpp_guard_token(tokens, 4, LPAREN) != NULL) {
+            // #if !defined(X)
+            name = cpp_guard_token(tokens, 5, ID);
+            idx = cpp_guard_token(tokens, 6, RPAREN) != NULL ? 7 : 0;
+        } else {
+            // #if !defined X
+            name = cpp_guard_token(tokens, 4, ID);
+            idx = 5;
+        }
+    }
+    if (name == NULL || idx == 0 ||
+        (idx < len && !((token_t *)vec_get(tokens, idx))->startLine)) {
+        return NULL;
+    }
+
+    // Find the matching #endif, which must end the file
+    int depth = 1;
+    for (; idx < len; ++idx) {
+        if (cpp_is_directive(tokens, idx, "if") ||
+            cpp_is_directive(tokens, idx, "ifdef") ||
+            cpp_is_directive(tokens, idx, "ifndef")) {
+            ++depth;
+        } else if (depth == 1 && (cpp_is_directive(tokens, idx, "elif") ||
+                                  cpp_is_directive(tokens, idx, "else"))) {
+            return NULL;
+        } else if (cpp_is_directive(tokens, idx, "endif") && --depth == 0) {
+            break;
+        }
+    }
+    if (depth != 0) {
+        return NULL;
+    }
+
+    // Nothing may follow the #endif line
+    for (idx += 2; idx < len; ++idx) {
+        if (((token_t *)vec_get(tokens, idx))->startLine) {
+            return NULL;
+        }
+    }
+
+    return name->id_name;
+}
+
 status_t cpp_expand(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
     status_t status = CCC_OK;
     ++cs->expand_level;
 
-    token_t *token = NULL, *next_last = NULL, *last = NULL;
-    for (; vec_iter_has_next(ts);
-         last = next_last, cpp_iter_advance(ts, false)) {
-
-        token = vec_iter_get(ts);
+    while (cpp_iter_has_next(cs, ts)) {
+        token_t *token = vec_iter_advance(ts);
         if (cs->expand_level == 1) {
             cs->last_top_token = token;
         }
-
-        if (token->type != SPACE) {
-            next_last = token;
+        if (cs->file != NULL && ts->vec == &cs->file->tokens) {
+            cs->file_mark = token->mark;
         }
 
         // If we're ignoring and, we only want to check # directives
@@ -488,7 +983,7 @@ status_t cpp_expand(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
 
         case HASH:
             if (!cs->in_param) {
-                if (last != NULL && last->type != NEWLINE) {
+                if (!token->startLine) {
                     if (!cs->ignore) {
                         logger_log(token->mark, LOG_ERR,
                                    "stray '#' in program");
@@ -497,13 +992,9 @@ status_t cpp_expand(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
                     }
                     continue;
                 }
-                cpp_iter_advance(ts, true);
                 if (CCC_OK != (status = cpp_handle_directive(cs, ts, output))) {
                     goto done;
                 }
-
-                // Set last as NULL to pass above check for stray #
-                next_last = NULL;
                 continue;
             }
             // FALL THROUGH
@@ -516,14 +1007,14 @@ status_t cpp_expand(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
         assert(token->type == ID);
 
         // If the current token is a member of its hideset, just pass it
-        if (str_set_mem(token->hideset, token->id_name)) {
+        if (hideset_mem(token->hideset, token->id_name)) {
             cpp_stream_append(cs, output, token);
             continue;
         }
 
-        token_t *next = cpp_next_nonspace(ts, false);
+        token_t *next = cpp_iter_has_next(cs, ts) ? vec_iter_get(ts) : NULL;
 
-        cpp_macro_t *macro = ht_lookup(&cs->macros, &token->id_name);
+        cpp_macro_t *macro = cpp_macro_lookup(cs, token->id_name);
         if (macro == NULL ||
             (macro->num_params != -1 &&
              (next == NULL || next->type != LPAREN))) {
@@ -533,54 +1024,61 @@ status_t cpp_expand(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
             continue;
         }
         if (macro->type != CPP_MACRO_BASIC) {
-            cpp_handle_special_macro(cs, token->mark, macro->type, output);
+            cpp_handle_special_macro(cs, token, macro->type, output);
             continue;
         }
 
-        cpp_macro_inst_t macro_inst =
-            { macro, SLIST_LIT(offsetof(cpp_macro_param_t, link)) };
+        cpp_macro_inst_t macro_inst = { macro, ts->vec, NULL };
 
-        str_set_t *hideset = str_set_empty(); // Macro's hideset
+        hideset_man_t *hm = &cs->token_man->hidesets;
+        hideset_t *hideset; // Macro's hideset
         vec_t subbed;
         vec_init(&subbed, 0);
 
         // Object like macro
         if (macro->num_params == -1) {
-            hideset = str_set_copy(token->hideset);
-            hideset = str_set_add(hideset, token->id_name);
+            hideset = hideset_add(hm, token->hideset, token->id_name);
             if (CCC_OK !=
                 (status = cpp_substitute(cs, &macro_inst, hideset, &subbed))) {
                 goto fail;
             }
         } else {
-            cpp_next_nonspace(ts, true); // Skip to lparen
             if (CCC_OK !=
                 (status = cpp_fetch_macro_params(cs, ts, &macro_inst))) {
                 goto fail;
             }
-            token_t *rparen = vec_iter_get(ts);
+            token_t *rparen = vec_iter_advance(ts);
 
             assert(rparen->type == RPAREN);
-            hideset = str_set_intersect(token->hideset, rparen->hideset);
-            hideset = str_set_add(hideset, token->id_name);
+            hideset = hideset_intersect(hm, token->hideset, rparen->hideset);
+            hideset = hideset_add(hm, hideset, token->id_name);
             if (CCC_OK !=
                 (status = cpp_substitute(cs, &macro_inst, hideset, &subbed))) {
                 goto fail;
             }
         }
 
+        // The expansion takes the place of the macro name
+        if (vec_size(&subbed) > 0) {
+            token_t *head = vec_front(&subbed);
+            bool has_space = token->hasSpace || token->startLine;
+            if (head->hasSpace != has_space) {
+                head = token_copy(cs->token_man, head);
+                head->hasSpace = has_space;
+                vec_set(&subbed, 0, head);
+            }
+        }
+
         // Expand the result of the substitution
         vec_iter_t sub_iter = { &subbed, 0 };
         cpp_expand(cs, &sub_iter, output);
 
         cpp_macro_inst_destroy(&macro_inst);
-        str_set_destroy(hideset);
         vec_destroy(&subbed);
         continue;
 
     fail:
         cpp_macro_inst_destroy(&macro_inst);
-        str_set_destroy(hideset);
         vec_destroy(&subbed);
         goto done;
     }
@@ -590,113 +1088,185 @@ done:
     return status;
 }
 
+/**
+ * Makes arg a view of a macro argument
+ */
+static void cpp_macro_arg(cpp_macro_inst_t *macro_inst, int param, vec_t *arg) {
+    cpp_macro_arg_t *span = &macro_inst->args[param];
+    vec_view(arg, macro_inst->tokens, span->begin, span->end);
+}
+
 status_t cpp_substitute(cpp_state_t *cs, cpp_macro_inst_t *macro_inst,
-                        str_set_t *hideset, vec_t *output) {
+                        hideset_t *hideset, vec_t *output) {
+    assert(vec_size(output) == 0);
     status_t status = CCC_OK;
-    vec_iter_t iter = { &macro_inst->macro->stream, 0 };
-    vec_t temp;
-    vec_init(&temp, 0);
-
-    for (; vec_iter_has_next(&iter); cpp_iter_advance(&iter, false)) {
-        token_t *token = vec_iter_get(&iter);
-        vec_t *param_vec;
-
-        if (token->type == HASH && macro_inst->macro->num_params != -1) {
-            // Handle stringification
-            cpp_iter_advance(&iter, true);
-            token_t *param = vec_iter_get(&iter);
-            if (param->type != ID ||
-                NULL == (param_vec =
-                         cpp_macro_inst_lookup(macro_inst, param->id_name))) {
-                logger_log(param->mark, LOG_ERR,
-                           "'#' is not followed by a macro parameter");
-                goto fail;
+    cpp_macro_t *macro = macro_inst->macro;
+    vec_t arg;
+
+    for (size_t i = 0; i < macro->num_ops; ++i) {
+        cpp_macro_op_t *op = &macro->ops[i];
+        token_t *token = vec_get(&macro->stream, op->idx);
+
+        switch (op->type) {
+        case CPP_OP_TOKEN:
+            cpp_stream_append(cs, output, token);
+            break;
+
+        case CPP_OP_STRINGIFY: {
+            cpp_macro_arg(macro_inst, op->param, &arg);
+            token_t *stringified = cpp_stringify(cs, &arg);
+            stringified->hasSpace = token->hasSpace;
+            cpp_stream_append(cs, output, stringified);
+            break;
+        }
+
+        case CPP_OP_PASTE: { // Not macro param, just glue the next token
+            vec_iter_t iter = { &macro->stream, op->idx };
+            if (CCC_OK != (status = cpp_glue(cs, output, &iter, 1))) {
+                return status;
             }
+            break;
+        }
 
-            token_t *stringified = cpp_stringify(cs, param_vec);
-            cpp_stream_append(cs, &temp, stringified);
-        } else if (token->type == HASHHASH) { // Concatenation
-            cpp_iter_advance(&iter, true);
-            token_t *next = vec_iter_get(&iter);
-
-            if (next->type == ID &&
-                NULL != (param_vec =
-                         cpp_macro_inst_lookup(macro_inst, next->id_name))) {
-                // Macro parameter: glue tho whole parameter
-                vec_iter_t param_iter = { param_vec, 0 };
-                if (CCC_OK != (status = cpp_glue(cs, &temp, &param_iter, 0))) {
-                    goto fail;
-                }
-            } else { // Not macro param, just glue the next token
-                if (CCC_OK != (status = cpp_glue(cs, &temp, &iter, 1))) {
-                    goto fail;
-                }
+        case CPP_OP_PASTE_PARAM: { // Macro parameter: glue the whole parameter
+            cpp_macro_arg(macro_inst, op->param, &arg);
+            vec_iter_t param_iter = { &arg, 0 };
+            if (CCC_OK != (status = cpp_glue(cs, output, &param_iter, 0))) {
+                return status;
             }
-        } else if (token->type == ID && NULL !=
-                   (param_vec = cpp_macro_inst_lookup(macro_inst,
-                                                       token->id_name))) {
-            // Found a macro paramater
-            token_t *next = cpp_iter_lookahead(&iter, 1);
-
-            if (next != NULL && next->type == HASHHASH) {
-                // Next token is a paste
-                if (vec_size(param_vec) == 0) {
-                    // Empty parameter vector
-                    token_t *after_paste = cpp_iter_lookahead(&iter, 2);
-
-                    // If next token is a macro parameter, then skip the
-                    // next two tokens and output that param's tokens
-                    if (after_paste->type == ID &&
-                        NULL != (param_vec =
-                                 cpp_macro_inst_lookup(macro_inst,
-                                                       after_paste->id_name))) {
-                        cpp_iter_advance(&iter, true); // skip empty param
-                        cpp_iter_advance(&iter, true); // skip ##
-                        vec_append_vec(&temp, param_vec);
-                    }
-                } else {
-                    // Just append all the tokens onto the output if pasting
-                    vec_append_vec(&temp, param_vec);
-                }
-            } else {
-                // Macro param not followed by ##, expand it onto the output
-                vec_iter_t iter = { param_vec, 0 };
+            break;
+        }
+
+        case CPP_OP_PARAM_RAW: {
+            // Next op is a paste
+            cpp_macro_op_t *paste = &macro->ops[i + 1];
+            cpp_macro_arg(macro_inst, op->param, &arg);
+            if (vec_size(&arg) > 0) {
+                // Just append all the tokens onto the output if pasting
+                vec_append_vec(output, &arg);
+            } else if (paste->type == CPP_OP_PASTE_PARAM) {
+                // Empty parameter pasted with a parameter: skip the paste and
+                // output that param's tokens
+                cpp_macro_arg(macro_inst, paste->param, &arg);
+                vec_append_vec(output, &arg);
+                ++i;
+            }
+            break;
+        }
+
+        case CPP_OP_PARAM: {
+            // Macro param not followed by ##, expand it onto the output. The
+            // expansion is reused if the param appears more than once
+            cpp_macro_arg_t *span = &macro_inst->args[op->param];
+            if (!span->is_expanded) {
+                cpp_macro_arg(macro_inst, op->param, &arg);
+                vec_iter_t iter = { &arg, 0 };
+                vec_init(&span->expanded, 0);
+                span->is_expanded = true;
+
                 bool param_save = cs->in_param;
                 cs->in_param = true;
-                cpp_expand(cs, &iter, &temp);
+                cpp_expand(cs, &iter, &span->expanded);
                 cs->in_param = param_save;
             }
-        } else {
-            // Regular token, just put it on the output
-            cpp_stream_append(cs, &temp, token);
+
+            size_t head_idx = vec_size(output);
+            VEC_FOREACH(cur, &span->expanded) {
+                cpp_stream_append(cs, output, vec_get(&span->expanded, cur));
+            }
+
+            // The argument takes the spacing of the parameter
+            if (vec_size(output) > head_idx) {
+                token_t *head = vec_get(output, head_idx);
+                if (head->hasSpace != token->hasSpace) {
+                    head = token_copy(cs->token_man, head);
+                    head->hasSpace = token->hasSpace;
+                    vec_set(output, head_idx, head);
+                }
+            }
+            break;
+        }
         }
     }
 
-    // Add the hideset passed into this function to all output tokens
-    VEC_FOREACH(cur, &temp) {
-        token_t *token = vec_get(&temp, cur);
+    // Add the hideset passed into this function to all output tokens. Tokens
+    // are shared, and only copied if this changes them
+    VEC_FOREACH(cur, output) {
+        token_t *token = vec_get(output, cur);
+        hideset_t *token_hideset =
+            hideset_union(&cs->token_man->hidesets, token->hideset, hideset);
+        if (token_hideset == token->hideset && !token->startLine) {
+            continue;
+        }
 
-        // Make a copy and add it to output
         token_t *copy = token_copy(cs->token_man, token);
-        copy->hideset = str_set_union_inplace(copy->hideset, hideset);
-        cpp_stream_append(cs, output, copy);
+        copy->hideset = token_hideset;
+
+        // Arguments may span lines, but their expansion does not
+        copy->hasSpace = copy->hasSpace || copy->startLine;
+        copy->startLine = false;
+        vec_set(output, cur, copy);
     }
 
-fail:
-    vec_destroy(&temp);
     return status;
 }
 
+/**
+ * Returns the mark just past the end of a token. Tokens longer than
+ * TOKEN_MAX_LEN have no length, so the end of their source line is used
+ */
+static fmark_t cpp_token_end(token_t *token) {
+    if (token->start != NULL) {
+        return token->mark + token->len;
+    }
+
+    const char *start;
+    size_t len;
+    fmark_t base = fmark_buffer(token->mark, &start, &len);
+    const char *end = start + len;
+    const char *p = start + (token->mark - base);
+    for (; p < end; ++p) {
+        if (*p != '\n') {
+            continue;
+        }
+        // Spliced lines continue the directive
+        const char *prev = p > start && p[-1] == '\r' ? p - 1 : p;
+        if (prev == start || prev[-1] != '\\') {
+            break;
+        }
+    }
+
+    return base + (p - start);
+}
+
 status_t cpp_handle_directive(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
     status_t status = CCC_OK;
-    token_t *token = vec_iter_get(ts);
-    fmark_t *mark = token->mark;
 
     // Single # on a line allowed
-    if (token->type == NEWLINE || !vec_iter_has_next(ts)) {
+    if (!vec_iter_has_next(ts) ||
+        ((token_t *)vec_iter_get(ts))->startLine) {
         return CCC_OK;
     }
 
+    // Gather the rest of the line, ending it with an end of directive token
+    vec_t line;
+    vec_init(&line, 0);
+    token_t *last = NULL;
+    for (; vec_iter_has_next(ts); vec_iter_advance(ts)) {
+        token_t *token = vec_iter_get(ts);
+        if (token->startLine) {
+            break;
+        }
+        vec_push_back(&line, token);
+        last = token;
+    }
+    token_t eod = { .type = TOKEN_EOF, .mark = cpp_token_end(last) };
+    vec_push_back(&line, &eod);
+
+    vec_iter_t line_iter = { &line, 0 };
+    token_t *token = vec_iter_get(&line_iter);
+    fmark_t mark = token->mark;
+
     char *tok_str = token_str(token);
     char *dir_name;
     bool implicit_line = false;
@@ -728,22 +1298,30 @@ status_t cpp_handle_directive(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
         }
     } else {
         if (!implicit_line) {
-            cpp_iter_advance(ts, true); // Skip the directive name
+            cpp_iter_advance(&line_iter); // Skip the directive name
         }
         if (!cs->ignore || !dir->if_ignore) {
-            status = dir->func(cs, ts, output);
+            status = dir->func(cs, &line_iter, output);
             cs->last_dir = dir->type;
         }
     }
 
-    cpp_iter_skip_space(ts);
-    if (cpp_skip_line(ts, false) > 1) {
+    if (cpp_skip_line(&line_iter) > 0) {
         if (!cs->ignore && dir != NULL && status == CCC_OK) {
             logger_log(mark, LOG_WARN, "extra tokens at end of #%s directive",
                        dir->name);
         }
     }
 
+    // Conditionals continue with the lines following the directive
+    if (status == CCC_OK && dir != NULL &&
+        (dir->type == CPP_DIR_ifdef || dir->type == CPP_DIR_ifndef ||
+         dir->type == CPP_DIR_if)) {
+        status = cpp_if_helper(cs, ts, output, mark, cs->if_taken);
+        cs->last_dir = dir->type;
+    }
+
+    vec_destroy(&line);
     free(tok_str);
     return status;
 }
@@ -753,41 +1331,56 @@ status_t cpp_fetch_macro_params(cpp_state_t *cs, vec_iter_t *ts,
     (void)cs;
     token_t *lparen = vec_iter_get(ts);
     assert(lparen->type == LPAREN);
-    cpp_iter_advance(ts, true);
+    cpp_iter_advance(ts);
 
     cpp_macro_t *macro = macro_inst->macro;
     assert(macro->num_params >= 0);
 
+    // Arguments are spans of the invocation's tokens, which aren't copied
+    assert(macro_inst->tokens == ts->vec);
+    if (macro->num_params > 0) {
+        macro_inst->args =
+            emalloc(macro->num_params * sizeof(cpp_macro_arg_t));
+        for (int i = 0; i < macro->num_params; ++i) {
+            macro_inst->args[i].is_expanded = false;
+        }
+    }
+
     int num_params = 0;
 
     bool done = false;
     int cur = 0;
 
     while (!done) {
+        if (!cpp_iter_has_next(cs, ts)) {
+            logger_log(lparen->mark, LOG_ERR,
+                       "unterminated argument list invoking macro \"%s\"",
+                       macro->name);
+            return CCC_ESYNTAX;
+        }
+
         bool vararg = false;
-        char *arg = NULL;
-        cpp_macro_param_t *param = NULL;
+        cpp_macro_arg_t *arg = NULL;
 
         if (cur < macro->num_params) {
-            arg = vec_get(&macro->params, cur);
-            param = emalloc(sizeof(cpp_macro_param_t));
-            vec_init(&param->stream, 0);
+            arg = &macro_inst->args[cur];
 
-            if (arg == NULL) { // NULL arg denotes vararg
+            if (vec_get(&macro->params, cur) == NULL) { // NULL denotes vararg
                 assert(cur == macro->num_params - 1); // Must be last argument
                 vararg = true;
-                param->name = VARARG_NAME;
-            } else {
-                param->name = arg;
             }
+            ++cur;
         }
         token_t *token = vec_iter_get(ts);
         if (num_params == 0 && token->type != RPAREN) {
             ++num_params;
         }
+        if (arg != NULL) {
+            arg->begin = ts->off;
+        }
 
         int parens = 0;
-        for (; vec_iter_has_next(ts); cpp_iter_advance(ts, false)) {
+        for (; cpp_iter_has_next(cs, ts); cpp_iter_advance(ts)) {
             token_t *token = vec_iter_get(ts);
             if (token->type == LPAREN) {
                 ++parens;
@@ -796,7 +1389,6 @@ status_t cpp_fetch_macro_params(cpp_state_t *cs, vec_iter_t *ts,
             } else if (parens == 0) {
                 if (token->type == COMMA && !vararg) {
                     ++num_params;
-                    cpp_iter_advance(ts, true);
                     break;
                 }
                 if (token->type == RPAREN) {
@@ -804,28 +1396,12 @@ status_t cpp_fetch_macro_params(cpp_state_t *cs, vec_iter_t *ts,
                     break;
                 }
             }
-
-            if (cur < macro->num_params) {
-                cpp_stream_append(cs, &param->stream, token);
-            }
         }
-
-        if (cur < macro->num_params) {
-            // Remove trailing whitespace
-            bool done = false;
-            while (!done && vec_size(&param->stream) > 0) {
-                token_t *tail = vec_back(&param->stream);
-                switch (tail->type) {
-                case SPACE:
-                case NEWLINE:
-                    vec_pop_back(&param->stream);
-                    break;
-                default:
-                    done = true;
-                }
-            }
-            sl_append(&macro_inst->args, &param->link);
-            ++cur;
+        if (arg != NULL) {
+            arg->end = ts->off;
+        }
+        if (!done && cpp_iter_has_next(cs, ts)) {
+            cpp_iter_advance(ts); // Skip the comma
         }
     }
 
@@ -844,29 +1420,17 @@ token_t *cpp_stringify(cpp_state_t *cs, vec_t *ts) {
     string_builder_t sb;
     sb_init(&sb, 0);
 
-    token_t *first = vec_get(ts, 0);
     token_t *token = token_create(cs->token_man);
     token->type = STRING;
-    token->mark = first->mark;
+    token->mark = vec_size(ts) > 0 ? ((token_t *)vec_front(ts))->mark :
+        FMARK_BUILT_IN;
 
-    bool last_space = false;
     VEC_FOREACH(cur, ts) {
         token_t *token = vec_get(ts, cur);
 
-        // Combine multiple spaces into one
-        if (token->type == SPACE || token->type == NEWLINE) {
-            if (last_space) {
-                continue;
-            }
-
-            // If the token isn't a space, make a space
-            if (token->type != SPACE) {
-                token = token_copy(cs->token_man, token);
-                token->type = SPACE;
-            }
-            last_space = true;
-        } else {
-            last_space = false;
+        // Whitespace between tokens becomes a single space
+        if (cur > 0 && (token->hasSpace || token->startLine)) {
+            sb_append_char(&sb, ' ');
         }
 
         token_str_append_sb(&sb, token);
@@ -888,10 +1452,8 @@ status_t cpp_glue(cpp_state_t *cs, vec_t *left, vec_iter_t *right,
 
     token_t *rhead = vec_iter_get(right);
     token_t *ltail = NULL;
-    while (vec_size(left) > 0) {
-        if ((ltail = vec_pop_back(left))->type != SPACE) {
-            break;
-        }
+    if (vec_size(left) > 0) {
+        ltail = vec_pop_back(left);
     }
 
     if (ltail == NULL) {
@@ -905,9 +1467,13 @@ status_t cpp_glue(cpp_state_t *cs, vec_t *left, vec_iter_t *right,
         token_str_append_sb(&sb, ltail);
         token_str_append_sb(&sb, rhead);
 
+        // The pasted spelling isn't registered as a buffer of its own, so the
+        // mark table doesn't grow with each paste. The new tokens take the
+        // mark of the left operand instead.
         tstream_t stream;
         char *buf = sstore_lookup(sb_buf(&sb));
-        ts_init(&stream, buf, buf + sb_len(&sb), ltail->mark->filename, NULL);
+        char *end = buf + sb_len(&sb);
+        ts_init(&stream, buf, end, ltail->mark);
 
         size_t init_size = vec_size(left);
 
@@ -916,6 +1482,16 @@ status_t cpp_glue(cpp_state_t *cs, vec_t *left, vec_iter_t *right,
         assert(status == CCC_OK);
 
         size_t post_size = vec_size(left);
+        for (size_t i = init_size; i < post_size; ++i) {
+            token_t *token = vec_get(left, i);
+            token->mark = ltail->mark;
+        }
+        if (post_size > init_size) {
+            // The pasted token takes the place of the left one
+            token_t *pasted = vec_get(left, init_size);
+            pasted->hasSpace = ltail->hasSpace;
+            pasted->startLine = false;
+        }
         if (post_size > init_size + 1) {
             logger_log(ltail->mark, LOG_ERR,
                        "pasting \"%s\" and \"%s\" does not give a valid "
@@ -931,7 +1507,7 @@ status_t cpp_glue(cpp_state_t *cs, vec_t *left, vec_iter_t *right,
     --nelems;
 
     while (nelems-- > 0) {
-        cpp_iter_advance(right, false);
+        cpp_iter_advance(right);
         if (!vec_iter_has_next(right)) {
             break;
         }
@@ -941,10 +1517,12 @@ status_t cpp_glue(cpp_state_t *cs, vec_t *left, vec_iter_t *right,
     return CCC_OK;
 }
 
-void cpp_handle_special_macro(cpp_state_t *cs, fmark_t *mark,
+void cpp_handle_special_macro(cpp_state_t *cs, token_t *name,
                               cpp_macro_type_t type, vec_t *output) {
+    fmark_t mark = name->mark;
     token_t *token = token_create(cs->token_man);
     token->mark = mark;
+    token->hasSpace = name->hasSpace || name->startLine;
 
     char buf[TIME_DATE_BUF_SZ];
 
@@ -958,11 +1536,10 @@ void cpp_handle_special_macro(cpp_state_t *cs, fmark_t *mark,
         break;
     case CPP_MACRO_LINE:
         token->type = INTLIT;
-        token->int_params = emalloc(sizeof(token_int_params_t));
-        token->int_params->hasU = false;
-        token->int_params->hasL = false;
-        token->int_params->hasLL = false;
-        token->int_params->int_val = cs->last_top_token->mark->line -
+        token->hasU = false;
+        token->hasL = false;
+        token->hasLL = false;
+        token->int_val = fmark_line(cs->last_top_token->mark) -
             cs->line_orig + cs->line_mod;
         break;
     case CPP_MACRO_DATE:
@@ -23,13 +23,63 @@
 #ifndef _CPP_H_
 #define _CPP_H_
 
+#include <stdio.h>
+
 #include "lex/lex.h"
 #include "lex/token.h"
 #include "util/vector.h"
 
 typedef struct cpp_macro_t cpp_macro_t;
 
+/**
+ * Preprocesses a file
+ *
+ * @param token_man Token manager to allocate tokens from
+ * @param lexer Lexer to use
+ * @param filepath Path of the file to preprocess
+ * @param output (token_t *) Location to store the tokens
+ * @param deps (char *) Location to store the paths of included headers not in
+ *     system directories, NULL if they aren't needed
+ * @return CCC_OK on success, error code on error
+ */
 status_t cpp_process(token_man_t *token_man, lexer_t *lexer, char *filepath,
-                     vec_t *output);
+                     vec_t *output, vec_t *deps);
+
+/**
+ * Preprocesses a file, printing the result as text with line markers. Output
+ * is written as it is produced.
+ *
+ * @param token_man Token manager to allocate tokens from
+ * @param lexer Lexer to use
+ * @param filepath Path of the file to preprocess
+ * @param file File to write to
+ * @param deps (char *) Location to store the paths of included headers not in
+ *     system directories, NULL if they aren't needed
+ * @return CCC_OK on success, error code on error
+ */
+status_t cpp_preprocess(token_man_t *token_man, lexer_t *lexer,
+                        char *filepath, FILE *file, vec_t *deps);
+
+/**
+ * Preprocesses a header, writing the result to a precompiled header which can
+ * be included with -include-pch
+ *
+ * @param token_man Token manager to allocate tokens from
+ * @param lexer Lexer to use
+ * @param filepath Path of the header
+ * @param pch_path Path of the precompiled header to write
+ * @param deps (char *) Location to store the paths of included headers not in
+ *     system directories, NULL if they aren't needed
+ * @return CCC_OK on success, error code on error
+ */
+status_t cpp_write_pch(token_man_t *token_man, lexer_t *lexer,
+                       char *filepath, char *pch_path, vec_t *deps);
+
+/**
+ * Frees the state shared by all files: the predefined macros, those of the
+ * precompiled header, and the tokens of included files. Must be called after
+ * all files are processed.
+ */
+void cpp_predef_destroy(void);
 
 #endif /* _CPP_H_ */
@@ -22,13 +22,12 @@
 
 #include "cpp_directives.h"
 
+#include <assert.h>
 #include <limits.h>
 #include <unistd.h>
 
-#include "ast/ast.h"
-#include "parse/parse.h"
+#include "lex/cpp_eval.h"
 #include "top/optman.h"
-#include "typecheck/typecheck.h"
 #include "util/logger.h"
 
 #define DIR_ENTRY(directive, if_ignored) \
@@ -36,6 +35,7 @@
 
 cpp_directive_t directives[] = {
     DIR_ENTRY(include, true),
+    DIR_ENTRY(embed, true),
 
     DIR_ENTRY(define, true),
     DIR_ENTRY(undef, true),
@@ -62,21 +62,21 @@ status_t cpp_expand_line(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
     vec_t input;
     vec_init(&input, 0);
 
-    for (; vec_iter_has_next(ts); cpp_iter_advance(ts, true)) {
+    for (; vec_iter_has_next(ts); cpp_iter_advance(ts)) {
         token_t *token = vec_iter_get(ts);
-        if (token->type == NEWLINE) {
+        if (token->type == TOKEN_EOF) {
             break;
         }
 
         if (pp_if && token->type == ID) {
             // Handle defined operator
             if (strcmp(token->id_name, "defined") == 0) {
-                cpp_iter_advance(ts, true);
+                cpp_iter_advance(ts);
                 token = vec_iter_get(ts);
                 bool has_paren = false;
                 if (token->type == LPAREN) {
                     has_paren = true;
-                    cpp_iter_advance(ts, true);
+                    cpp_iter_advance(ts);
                     token = vec_iter_get(ts);
                 }
 
@@ -87,11 +87,11 @@ status_t cpp_expand_line(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
                     goto fail;
                 }
 
-                cpp_macro_t *macro = ht_lookup(&cs->macros, &token->id_name);
+                cpp_macro_t *macro = cpp_macro_lookup(cs, token->id_name);
                 token = macro == NULL ? &token_int_zero : &token_int_one;
 
                 if (has_paren) {
-                    cpp_iter_advance(ts, true); // Get paren
+                    cpp_iter_advance(ts); // Get paren
                     token_t *next_token = vec_iter_get(ts);
                     if (next_token->type != RPAREN) {
                         logger_log(token->mark, LOG_ERR,
@@ -102,7 +102,7 @@ status_t cpp_expand_line(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
                 }
             } else {
                 // Non 'defined' idenitifer if undefined macro, just output zero
-                cpp_macro_t *macro = ht_lookup(&cs->macros, &token->id_name);
+                cpp_macro_t *macro = cpp_macro_lookup(cs, token->id_name);
                 token = macro == NULL ? &token_int_zero : token;
 
             }
@@ -123,9 +123,18 @@ fail:
 }
 
 status_t cpp_dir_include(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
+    return cpp_file_helper(cs, ts, output, false);
+}
+
+status_t cpp_dir_embed(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
+    return cpp_file_helper(cs, ts, output, true);
+}
+
+status_t cpp_file_helper(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
+                         bool embed) {
     status_t status = CCC_OK;
     token_t *token = vec_iter_get(ts);
-    fmark_t *mark = token->mark;
+    fmark_t mark = token->mark;
     char *filename = NULL;
 
     vec_t line;
@@ -138,64 +147,89 @@ status_t cpp_dir_include(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
     vec_iter_t line_iter = { &line, 0 };
     token = vec_iter_get(&line_iter);
 
+    string_builder_t sb;
+    sb_init(&sb, 0);
+    bool bracket = false;
+
     switch (token->type) {
     case STRING: // "filename"
-        cpp_iter_advance(&line_iter, true);
+        cpp_iter_advance(&line_iter);
         filename = token->str_val;
-        status = cpp_include_helper(cs, mark, filename, false, output);
         break;
     case LT: { // <filename>
-        string_builder_t sb;
-        sb_init(&sb, 0);
-
         bool done = false;
-        cpp_iter_advance(&line_iter, false);
+        cpp_iter_advance(&line_iter);
         for (; vec_iter_has_next(&line_iter);
-             cpp_iter_advance(&line_iter, false)) {
+             cpp_iter_advance(&line_iter)) {
             token_t *token = vec_iter_get(&line_iter);
 
-            if (token->type == NEWLINE) {
-                break;
-            }
             if (token->type == GT) {
                 done = true;
-                cpp_iter_advance(&line_iter, false);
+                cpp_iter_advance(&line_iter);
                 break;
             }
 
             token_str_append_sb(&sb, token);
         }
-        if (done) {
-            status = cpp_include_helper(cs, mark, sb_buf(&sb), true, output);
-        } else {
+        if (!done) {
             logger_log(token->mark, LOG_ERR,
                        "missing terminating > character");
             status = CCC_ESYNTAX;
+            goto fail;
         }
-        sb_destroy(&sb);
+        filename = sb_buf(&sb);
+        bracket = true;
         break;
     }
     default:
         logger_log(token->mark, LOG_ERR,
-                   "#include expects \"FILENAME\" or <FILENAME>");
+                   "#%s expects \"FILENAME\" or <FILENAME>",
+                   embed ? "embed" : "include");
         status = CCC_ESYNTAX;
+        goto fail;
+    }
+
+    if (embed) {
+        // The limit, prefix, suffix and if_empty parameters aren't supported
+        if (vec_iter_has_next(&line_iter)) {
+            token = vec_iter_get(&line_iter);
+            logger_log(token->mark, LOG_ERR, "unsupported #embed parameter");
+            status = CCC_ESYNTAX;
+            goto fail;
+        }
+        status = cpp_embed_helper(cs, mark, filename, bracket, output);
+    } else {
+        status = cpp_include_helper(cs, mark, filename, bracket, output);
     }
 
 fail:
+    sb_destroy(&sb);
     vec_destroy(&line);
     return status;
 }
 
-status_t cpp_include_helper(cpp_state_t *cs, fmark_t *mark, char *filename,
-                            bool bracket, vec_t *output) {
+status_t cpp_include_find(cpp_state_t *cs, fmark_t mark, char *filename,
+                          bool bracket, char *buf, char **result) {
+    status_t status = CCC_OK;
     char *file_dir, file_dir_buf[PATH_MAX + 1];
-    char include_path[PATH_MAX + 1];
+    char *include_path = buf;
 
     strncpy(file_dir_buf, cs->filename, PATH_MAX);
     file_dir_buf[PATH_MAX] = '\0';
 
     file_dir = ccc_dirname(file_dir_buf);
 
+    // Resolutions are shared by all files, since the search path is the same
+    string_builder_t key;
+    sb_init(&key, 0);
+    fdir_include_key(&key, file_dir, filename, bracket);
+
+    char *path;
+    if (fdir_include_lookup(sb_buf(&key), &path)) {
+        goto found;
+    }
+    path = NULL;
+
     VEC_FOREACH(cur, &cs->search_path) {
         char *cur_path = vec_get(&cs->search_path, cur);
 
@@ -222,7 +256,8 @@ status_t cpp_include_helper(cpp_state_t *cs, fmark_t *mark, char *filename,
 
         if (cur_path_len + strlen(filename) + 1 > PATH_MAX) {
             logger_log(mark, LOG_ERR, "Include path name too long");
-            return CCC_ESYNTAX;
+            status = CCC_ESYNTAX;
+            goto fail;
         }
 
         if (relative) {
@@ -236,15 +271,83 @@ status_t cpp_include_helper(cpp_state_t *cs, fmark_t *mark, char *filename,
         strcpy(include_path + cur_path_len + 1, filename);
 
         // File isn't accessible
-        if(-1 == access(include_path, R_OK)) {
+        if (fdir_lookup(include_path) == NULL && !fdir_exists(include_path)) {
             continue;
         }
 
-        return cpp_process_file(cs, include_path, output);
+        path = include_path;
+        break;
     }
+    fdir_include_insert(sb_buf(&key), path);
 
-    logger_log(mark, LOG_ERR, "%s: No such file or directory", filename);
-    return CCC_ESYNTAX;
+found:
+    if (path == NULL) {
+        logger_log(mark, LOG_ERR, "%s: No such file or directory", filename);
+        status = CCC_ESYNTAX;
+        goto fail;
+    }
+
+    if (cs->deps != NULL) {
+        cpp_add_dep(cs, path);
+    }
+    *result = path;
+
+fail:
+    sb_destroy(&key);
+    return status;
+}
+
+status_t cpp_include_helper(cpp_state_t *cs, fmark_t mark, char *filename,
+                            bool bracket, vec_t *output) {
+    status_t status = CCC_OK;
+    char buf[PATH_MAX + 1];
+    char *path;
+    if (CCC_OK !=
+        (status = cpp_include_find(cs, mark, filename, bracket, buf, &path))) {
+        return status;
+    }
+
+    // Skip files already known to have no effect without reading them. A path
+    // not seen before is opened, as it may name a file seen by another path
+    fdir_entry_t *entry;
+    if (CCC_OK == fdir_insert(path, &entry) && cpp_include_skip(cs, entry)) {
+        return status;
+    }
+
+    return cpp_process_file(cs, path, output);
+}
+
+status_t cpp_embed_helper(cpp_state_t *cs, fmark_t mark, char *filename,
+                          bool bracket, vec_t *output) {
+    status_t status = CCC_OK;
+    char buf[PATH_MAX + 1];
+    char *path;
+    if (CCC_OK !=
+        (status = cpp_include_find(cs, mark, filename, bracket, buf, &path))) {
+        return status;
+    }
+
+    // The file stays mapped by the file directory, so its bytes are used in
+    // place rather than copied into tokens
+    fdir_entry_t *entry;
+    if (CCC_OK != (status = fdir_insert(path, &entry))) {
+        logger_log(mark, LOG_ERR, "%s: Cannot read file", filename);
+        return status;
+    }
+
+    // An empty file expands to nothing
+    if (entry->buf == entry->end) {
+        return status;
+    }
+
+    token_t *token = token_create(cs->token_man);
+    token->type = EMBED;
+    token->mark = mark;
+    token->startLine = true;
+    token->embed = entry;
+    cpp_stream_append(cs, output, token);
+
+    return status;
 }
 
 status_t cpp_dir_define(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
@@ -266,32 +369,34 @@ status_t cpp_define_helper(cpp_state_t *cs, vec_iter_t *ts,
     vec_init(&macro->params, 0);
     macro->num_params = -1;
     macro->type = type;
+    macro->ops = NULL;
 
     if (has_eq) {
-        cpp_iter_advance(ts, true);
+        cpp_iter_advance(ts);
         if ((token = vec_iter_get(ts))->type == EQ) {
-            cpp_iter_advance(ts, false);
+            cpp_iter_advance(ts);
         }
     }
 
-    // Don't want to skip spaces, because lparen must be right after macro name
-    cpp_iter_advance(ts, false);
+    cpp_iter_advance(ts);
 
-    if (vec_iter_has_next(ts) && (token = vec_iter_get(ts))->type == LPAREN) {
-        cpp_iter_advance(ts, true);
+    // lparen must be right after macro name
+    if (vec_iter_has_next(ts) && (token = vec_iter_get(ts))->type == LPAREN &&
+        !token->hasSpace) {
+        cpp_iter_advance(ts);
         macro->num_params = 0;
 
         bool done = false;
         bool first = true;
         bool vararg = false;
 
-        for (; vec_iter_has_next(ts); cpp_iter_advance(ts, true)) {
+        for (; vec_iter_has_next(ts); cpp_iter_advance(ts)) {
             token = vec_iter_get(ts);
-            if (token->type == NEWLINE) {
+            if (token->type == TOKEN_EOF) {
                 break;
             }
             if (token->type == RPAREN) {
-                cpp_iter_advance(ts, true);
+                cpp_iter_advance(ts);
                 done = true;
                 break;
             }
@@ -305,7 +410,7 @@ status_t cpp_define_helper(cpp_state_t *cs, vec_iter_t *ts,
                     status = CCC_ESYNTAX;
                     goto fail;
                 }
-                cpp_iter_advance(ts, true);
+                cpp_iter_advance(ts);
                 token = vec_iter_get(ts);
             }
             if (token->type == ELIPSE) {
@@ -332,18 +437,20 @@ status_t cpp_define_helper(cpp_state_t *cs, vec_iter_t *ts,
         }
     }
 
-    cpp_iter_skip_space(ts); // Skip space between header and body
-
-    for (; vec_iter_has_next(ts); cpp_iter_advance(ts, false)) {
+    for (; vec_iter_has_next(ts); cpp_iter_advance(ts)) {
         token = vec_iter_get(ts);
-        if (token->type == NEWLINE) {
+        if (token->type == TOKEN_EOF) {
             break;
         }
 
         vec_push_back(&macro->stream, token);
     }
 
-    cpp_macro_t *old_macro = ht_remove(&cs->macros, &macro->name);
+    if (CCC_OK != (status = cpp_macro_compile(macro))) {
+        goto fail;
+    }
+
+    cpp_macro_t *old_macro = cpp_macro_lookup(cs, macro->name);
     if (old_macro != NULL) {
         if (old_macro->type != CPP_MACRO_BASIC ||
             !cpp_macro_equal(macro, old_macro)) {
@@ -351,8 +458,10 @@ status_t cpp_define_helper(cpp_state_t *cs, vec_iter_t *ts,
             logger_log(old_macro->mark, LOG_NOTE,
                        "this is the location of the previous definition");
         }
-        cpp_macro_destroy(old_macro);
     }
+
+    // Predefined macros are shadowed rather than replaced
+    cpp_macro_destroy(ht_remove(&cs->macros, &macro->name));
     status = ht_insert(&cs->macros, &macro->link);
     assert(status == CCC_OK);
 
@@ -367,51 +476,58 @@ status_t cpp_dir_undef(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
     (void)output;
     token_t *token = vec_iter_get(ts);
     VERIFY_TOK_ID(token);
-    cpp_iter_advance(ts, true);
+    cpp_iter_advance(ts);
 
-    cpp_macro_t *macro = ht_remove(&cs->macros, &token->id_name);
-    cpp_macro_destroy(macro);
+    cpp_macro_undef(cs, token->id_name);
 
     return CCC_OK;
 }
 
 status_t cpp_dir_ifdef(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
+    (void)output;
     bool taken;
     if (cs->ignore) {
-        cpp_skip_line(ts, true);
+        cpp_skip_line(ts);
         taken = false;
     } else {
         token_t *token = vec_iter_get(ts);
         VERIFY_TOK_ID(token);
-        cpp_iter_advance(ts, true);
+        cpp_iter_advance(ts);
 
-        cpp_macro_t *macro = ht_lookup(&cs->macros, &token->id_name);
+        cpp_macro_t *macro = cpp_macro_lookup(cs, token->id_name);
         taken = macro != NULL;
     }
-    return cpp_if_helper(cs, ts, output, taken);
+
+    // cpp_handle_directive continues with cpp_if_helper
+    cs->if_taken = taken;
+    return CCC_OK;
 }
 
 status_t cpp_dir_ifndef(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
+    (void)output;
     bool taken;
     if (cs->ignore) {
-        cpp_skip_line(ts, true);
+        cpp_skip_line(ts);
         taken = false;
     } else {
         token_t *token = vec_iter_get(ts);
         VERIFY_TOK_ID(token);
-        cpp_iter_advance(ts, true);
+        cpp_iter_advance(ts);
 
-        cpp_macro_t *macro = ht_lookup(&cs->macros, &token->id_name);
+        cpp_macro_t *macro = cpp_macro_lookup(cs, token->id_name);
         taken = macro == NULL;
     }
-    return cpp_if_helper(cs, ts, output, taken);
+
+    cs->if_taken = taken;
+    return CCC_OK;
 }
 
 status_t cpp_dir_if(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
+    (void)output;
     status_t status = CCC_OK;
     bool taken;
     if (cs->ignore) {
-        cpp_skip_line(ts, true);
+        cpp_skip_line(ts);
         taken = false;
     } else {
         long long val;
@@ -421,7 +537,8 @@ status_t cpp_dir_if(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
         taken = val != 0;
     }
 
-    return cpp_if_helper(cs, ts, output, taken);
+    cs->if_taken = taken;
+    return CCC_OK;
 }
 
 status_t cpp_evaluate_line(cpp_state_t *cs, vec_iter_t *ts, long long *val) {
@@ -429,7 +546,6 @@ status_t cpp_evaluate_line(cpp_state_t *cs, vec_iter_t *ts, long long *val) {
     cs->ignore = false;
 
     status_t status = CCC_OK;
-    trans_unit_t *ast = ast_trans_unit_create(true);
     *val = 0;
 
     vec_t line;
@@ -439,19 +555,14 @@ status_t cpp_evaluate_line(cpp_state_t *cs, vec_iter_t *ts, long long *val) {
         goto fail;
     }
 
-    expr_t *expr = NULL;
-    if (CCC_OK != (status = parser_parse_expr(&line, ast, &expr))) {
-        goto fail;
-    }
-
-    if (!typecheck_const_expr(expr, val, true)) {
-        status = CCC_ESYNTAX;
+    // Iterator is left at the end of the line
+    token_t *eod = vec_iter_get(ts);
+    if (CCC_OK != (status = cpp_eval(&line, eod->mark, val))) {
         goto fail;
     }
 
 fail:
-    ast_destroy(ast);
-    cpp_skip_line(ts, false);
+    cpp_skip_line(ts);
     vec_destroy(&line);
 
     cs->ignore = ignore_save;
@@ -459,9 +570,8 @@ fail:
 }
 
 status_t cpp_if_helper(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
-                       bool if_taken) {
+                       fmark_t mark, bool if_taken) {
     status_t status = CCC_OK;
-    token_t *start_token = vec_iter_get(ts);
 
     bool ignore_save = cs->ignore;
     cs->if_taken = if_taken; // Mark if_taken for last directive
@@ -479,7 +589,7 @@ status_t cpp_if_helper(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
         if (CCC_BACKTRACK != (status = cpp_expand(cs, ts, output)) &&
             cs->last_dir != CPP_DIR_endif) {
             if (status == CCC_OK) {
-                logger_log(start_token->mark, LOG_ERR, "Unterminted #if");
+                logger_log(mark, LOG_ERR, "Unterminted #if");
             }
             goto fail;
         }
@@ -559,12 +669,15 @@ status_t cpp_dir_error_helper(vec_iter_t *ts, bool is_err) {
     string_builder_t sb;
     sb_init(&sb, 0);
     token_t *token = vec_iter_get(ts);
-    const char *line_start = token->mark->line_start;
+    fmark_loc_t loc;
+    fmark_decode(token->mark, &loc);
+    const char *line_start = loc.line_start;
     while (*line_start && *line_start != '\n') {
         sb_append_char(&sb, *(line_start++));
     }
     logger_log(token->mark, is_err ? LOG_ERR : LOG_WARN, "%s", sb_buf(&sb));
     sb_destroy(&sb);
+    cpp_skip_line(ts);
 
     return is_err ? CCC_ESYNTAX : CCC_OK;
 }
@@ -576,9 +689,14 @@ status_t cpp_dir_warning(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
 }
 
 status_t cpp_dir_pragma(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
-    (void)cs;
     (void)output;
-    cpp_skip_line(ts, false);
+    token_t *token = vec_iter_get(ts);
+    if (token->type == ID && strcmp(token->id_name, "once") == 0) {
+        fdir_entry_t *entry = fdir_lookup(cs->filename);
+        assert(entry != NULL);
+        cs->once = str_set_add(cs->once, entry->file->filename);
+    }
+    cpp_skip_line(ts);
     return CCC_OK;
 }
 
@@ -596,7 +714,7 @@ status_t cpp_dir_line(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
 
     vec_iter_t line_iter = { &line, 0 };
     int num = 0;
-    for (; vec_iter_has_next(&line_iter); cpp_iter_advance(&line_iter, true)) {
+    for (; vec_iter_has_next(&line_iter); cpp_iter_advance(&line_iter)) {
         token_t *token = vec_iter_get(&line_iter);
         switch (num++) {
         case 0:
@@ -608,8 +726,8 @@ status_t cpp_dir_line(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
                 goto fail;
             }
             // -1 because this line value applies to next line
-            cs->line_mod = token->int_params->int_val - 1;
-            cs->line_orig = head->mark->line;
+            cs->line_mod = token->int_val - 1;
+            cs->line_orig = fmark_line(head->mark);
             break;
         case 1:
             if (token->type != STRING) {
@@ -630,7 +748,7 @@ status_t cpp_dir_line(cpp_state_t *cs, vec_iter_t *ts, vec_t *output) {
 
 
 fail:
-    cpp_skip_line(ts, false);
+    cpp_skip_line(ts);
     vec_destroy(&line);
     return status;
 }
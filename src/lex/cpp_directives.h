@@ -43,6 +43,7 @@ extern cpp_directive_t directives[];
                                    vec_t *output)
 
 DIR_DECL(include);
+DIR_DECL(embed);
 
 DIR_DECL(define);
 DIR_DECL(undef);
@@ -63,13 +64,36 @@ DIR_DECL(line);
 status_t cpp_expand_line(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
                          bool pp_if);
 
-status_t cpp_include_helper(cpp_state_t *cs, fmark_t *mark, char *filename,
+/**
+ * Handles the "FILENAME" or <FILENAME> operand of #include and #embed
+ */
+status_t cpp_file_helper(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
+                         bool embed);
+
+/**
+ * Finds an included file on the search path
+ *
+ * @param cs The preprocessor state
+ * @param mark Location of the directive, for errors
+ * @param filename Name of the file as spelled
+ * @param bracket true if the name used brackets
+ * @param buf Buffer of at least PATH_MAX + 1 bytes for building the path
+ * @param result Location to store the path of the file
+ * @return CCC_OK if found, error code otherwise
+ */
+status_t cpp_include_find(cpp_state_t *cs, fmark_t mark, char *filename,
+                          bool bracket, char *buf, char **result);
+
+status_t cpp_include_helper(cpp_state_t *cs, fmark_t mark, char *filename,
                             bool bracket, vec_t *output);
 
+status_t cpp_embed_helper(cpp_state_t *cs, fmark_t mark, char *filename,
+                          bool bracket, vec_t *output);
+
 status_t cpp_dir_error_helper(vec_iter_t *ts, bool is_err);
 
 status_t cpp_if_helper(cpp_state_t *cs, vec_iter_t *ts, vec_t *output,
-                       bool if_taken);
+                       fmark_t mark, bool if_taken);
 
 status_t cpp_evaluate_line(cpp_state_t *cs, vec_iter_t *ts, long long *val);
 
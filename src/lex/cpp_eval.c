@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Preprocessor #if expression evaluator
+ *
+ * Evaluates directly on the expanded tokens with precedence climbing, without
+ * building an AST.
+ */
+
+#include "cpp_eval.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lex/token.h"
+#include "util/logger.h"
+
+/**
+ * Value of a #if expression
+ */
+typedef struct cpp_val_t {
+    uintmax_t val;    /**< Value, interpreted as intmax_t if signed */
+    bool is_unsigned; /**< Whether the value has unsigned type */
+} cpp_val_t;
+
+/**
+ * State of an evaluation
+ */
+typedef struct cpp_eval_t {
+    vec_iter_t iter; /**< Position in the expression */
+    token_t *eod;    /**< Token returned at end of expression */
+} cpp_eval_t;
+
+/** Precedence of ?: */
+#define CPP_PREC_COND 2
+
+static status_t cpp_eval_expr(cpp_eval_t *ev, int min_prec, bool eval,
+                              cpp_val_t *result);
+
+/**
+ * Returns the current token, or the end of expression token
+ */
+static token_t *cpp_eval_peek(cpp_eval_t *ev) {
+    return vec_iter_has_next(&ev->iter) ? vec_iter_get(&ev->iter) : ev->eod;
+}
+
+/**
+ * Returns the current token and advances past it
+ */
+static token_t *cpp_eval_next(cpp_eval_t *ev) {
+    return vec_iter_has_next(&ev->iter) ? vec_iter_advance(&ev->iter) :
+        ev->eod;
+}
+
+/**
+ * Returns the precedence of a binary operator, or 0 if type isn't one
+ */
+static int cpp_eval_prec(token_type_t type) {
+    switch (type) {
+    case COMMA:    return 1;
+    case COND:     return CPP_PREC_COND;
+    case LOGICOR:  return 3;
+    case LOGICAND: return 4;
+    case BITOR:    return 5;
+    case BITXOR:   return 6;
+    case BITAND:   return 7;
+    case EQ:
+    case NE:       return 8;
+    case LT:
+    case GT:
+    case LE:
+    case GE:       return 9;
+    case LSHIFT:
+    case RSHIFT:   return 10;
+    case PLUS:
+    case MINUS:    return 11;
+    case STAR:
+    case DIV:
+    case MOD:      return 12;
+    default:       return 0;
+    }
+}
+
+/**
+ * Logs an error at token
+ */
+static status_t cpp_eval_error(token_t *token, const char *fmt) {
+    if (token->type == TOKEN_EOF) {
+        logger_log(token->mark, LOG_ERR, fmt, "end of line");
+    } else {
+        char *str = token_str(token);
+        logger_log(token->mark, LOG_ERR, fmt, str);
+        free(str);
+    }
+
+    return CCC_ESYNTAX;
+}
+
+/**
+ * Evaluates a unary expression
+ */
+static status_t cpp_eval_unary(cpp_eval_t *ev, bool eval, cpp_val_t *result) {
+    status_t status = CCC_OK;
+    token_t *token = cpp_eval_next(ev);
+
+    switch (token->type) {
+    case INTLIT:
+        result->val = (uintmax_t)token->int_val;
+        // Literals too large for intmax_t are unsigned
+        result->is_unsigned = token->hasU || token->int_val < 0;
+        return status;
+
+    case LPAREN:
+        if (CCC_OK != (status = cpp_eval_expr(ev, 1, eval, result))) {
+            return status;
+        }
+        token = cpp_eval_next(ev);
+        if (token->type != RPAREN) {
+            return cpp_eval_error(token, "missing ')' before %s in "
+                                  "preprocessor expression");
+        }
+        return status;
+
+    case PLUS:
+    case MINUS:
+    case BITNOT:
+    case LOGICNOT:
+        if (CCC_OK != (status = cpp_eval_unary(ev, eval, result))) {
+            return status;
+        }
+        switch (token->type) {
+        case MINUS:
+            result->val = -result->val;
+            break;
+        case BITNOT:
+            result->val = ~result->val;
+            break;
+        case LOGICNOT:
+            result->val = result->val == 0;
+            result->is_unsigned = false;
+            break;
+        default:
+            break;
+        }
+        return status;
+
+    case FLOATLIT:
+        return cpp_eval_error(token, "floating constant %s in preprocessor "
+                              "expression");
+
+    default: {
+        // Identifiers left after expansion, including keywords, are 0
+        const char *str = token->type == ID ? token->id_name :
+            token_type_str(token->type);
+        if (isalpha(*str) || *str == '_') {
+            result->val = 0;
+            result->is_unsigned = false;
+            return status;
+        }
+
+        return cpp_eval_error(token, "%s is not valid in preprocessor "
+                              "expressions");
+    }
+    }
+}
+
+/**
+ * Applies an arithmetic binary operator
+ */
+static status_t cpp_eval_binary(token_t *op, bool eval, cpp_val_t *lhs,
+                                cpp_val_t *rhs) {
+    // Usual arithmetic conversions
+    bool lhs_unsigned = lhs->is_unsigned;
+    bool is_unsigned = lhs_unsigned || rhs->is_unsigned;
+    uintmax_t a = lhs->val, b = rhs->val;
+    intmax_t sa = (intmax_t)a, sb = (intmax_t)b;
+
+    lhs->is_unsigned = is_unsigned;
+    switch (op->type) {
+    case STAR:   lhs->val = a * b; break;
+    case PLUS:   lhs->val = a + b; break;
+    case MINUS:  lhs->val = a - b; break;
+    case BITAND: lhs->val = a & b; break;
+    case BITOR:  lhs->val = a | b; break;
+    case BITXOR: lhs->val = a ^ b; break;
+
+    case DIV:
+    case MOD:
+        if (b == 0) {
+            if (eval) {
+                logger_log(op->mark, LOG_ERR, "division by zero in #if");
+                return CCC_ESYNTAX;
+            }
+            lhs->val = 0;
+        } else if (is_unsigned) {
+            lhs->val = op->type == DIV ? a / b : a % b;
+        } else if (sb == -1) { // Avoid overflow of INTMAX_MIN / -1
+            lhs->val = op->type == DIV ? -a : 0;
+        } else {
+            lhs->val = (uintmax_t)(op->type == DIV ? sa / sb : sa % sb);
+        }
+        break;
+
+        // Shifts have the type of their left operand
+    case LSHIFT:
+    case RSHIFT: {
+        lhs->is_unsigned = lhs_unsigned;
+        bool left = op->type == LSHIFT;
+        if (!rhs->is_unsigned && sb < 0) {
+            left = !left;
+            b = -b;
+        }
+        if (b >= sizeof(uintmax_t) * CHAR_BIT) {
+            lhs->val = !left && !lhs->is_unsigned && sa < 0 ? UINTMAX_MAX : 0;
+        } else if (left) {
+            lhs->val = a << b;
+        } else if (lhs->is_unsigned) {
+            lhs->val = a >> b;
+        } else {
+            lhs->val = (uintmax_t)(sa >> b);
+        }
+        break;
+    }
+
+    case EQ:
+    case NE:
+    case LT:
+    case GT:
+    case LE:
+    case GE: {
+        int cmp = is_unsigned ? (a > b) - (a < b) : (sa > sb) - (sa < sb);
+        switch (op->type) {
+        case EQ: lhs->val = cmp == 0; break;
+        case NE: lhs->val = cmp != 0; break;
+        case LT: lhs->val = cmp < 0;  break;
+        case GT: lhs->val = cmp > 0;  break;
+        case LE: lhs->val = cmp <= 0; break;
+        default: lhs->val = cmp >= 0; break;
+        }
+        lhs->is_unsigned = false;
+        break;
+    }
+
+    default:
+        assert(false);
+    }
+
+    return CCC_OK;
+}
+
+/**
+ * Evaluates an expression by precedence climbing
+ *
+ * @param ev Evaluation state
+ * @param min_prec Minimum precedence of binary operators to consume
+ * @param eval false if the expression is not evaluated, such as the right
+ *     side of 0 &&. Errors such as division by zero are not reported
+ * @param result Location to store the value
+ */
+static status_t cpp_eval_expr(cpp_eval_t *ev, int min_prec, bool eval,
+                              cpp_val_t *result) {
+    status_t status = CCC_OK;
+    if (CCC_OK != (status = cpp_eval_unary(ev, eval, result))) {
+        return status;
+    }
+
+    while (true) {
+        token_t *op = cpp_eval_peek(ev);
+        int prec = cpp_eval_prec(op->type);
+        if (prec == 0 || prec < min_prec) {
+            break;
+        }
+        cpp_eval_next(ev);
+
+        cpp_val_t rhs;
+        bool cond = result->val != 0;
+        switch (op->type) {
+        case COND: {
+            // Right associative
+            cpp_val_t mid;
+            if (CCC_OK !=
+                (status = cpp_eval_expr(ev, 1, eval && cond, &mid))) {
+                return status;
+            }
+            token_t *colon = cpp_eval_next(ev);
+            if (colon->type != COLON) {
+                return cpp_eval_error(colon, "'?' without following ':' "
+                                      "before %s");
+            }
+            if (CCC_OK != (status = cpp_eval_expr(ev, CPP_PREC_COND,
+                                                  eval && !cond, &rhs))) {
+                return status;
+            }
+            result->val = cond ? mid.val : rhs.val;
+            result->is_unsigned = mid.is_unsigned || rhs.is_unsigned;
+            break;
+        }
+        case LOGICAND:
+        case LOGICOR: {
+            bool is_and = op->type == LOGICAND;
+            if (CCC_OK != (status = cpp_eval_expr(ev, prec + 1,
+                                                  eval && cond == is_and,
+                                                  &rhs))) {
+                return status;
+            }
+            result->val = is_and ? cond && rhs.val : cond || rhs.val;
+            result->is_unsigned = false;
+            break;
+        }
+        case COMMA:
+            if (CCC_OK !=
+                (status = cpp_eval_expr(ev, prec + 1, eval, result))) {
+                return status;
+            }
+            break;
+        default:
+            if (CCC_OK !=
+                (status = cpp_eval_expr(ev, prec + 1, eval, &rhs))) {
+                return status;
+            }
+            if (CCC_OK != (status = cpp_eval_binary(op, eval, result, &rhs))) {
+                return status;
+            }
+        }
+    }
+
+    return status;
+}
+
+status_t cpp_eval(vec_t *line, fmark_t mark, long long *result) {
+    status_t status = CCC_OK;
+
+    token_t eod = { .type = TOKEN_EOF, .mark = mark };
+    cpp_eval_t ev = { { line, 0 }, &eod };
+
+    if (vec_size(line) == 0) {
+        logger_log(mark, LOG_ERR, "#if with no expression");
+        return CCC_ESYNTAX;
+    }
+
+    cpp_val_t val;
+    if (CCC_OK != (status = cpp_eval_expr(&ev, 1, true, &val))) {
+        return status;
+    }
+
+    token_t *token = cpp_eval_peek(&ev);
+    if (token->type != TOKEN_EOF) {
+        return cpp_eval_error(token, "missing binary operator before %s");
+    }
+
+    *result = (long long)val.val;
+    return status;
+}
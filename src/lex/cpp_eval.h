@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Preprocessor #if expression evaluator interface
+ */
+
+#ifndef _CPP_EVAL_H_
+#define _CPP_EVAL_H_
+
+#include "util/file_mark.h"
+#include "util/util.h"
+#include "util/vector.h"
+
+/**
+ * Evaluates a #if expression. Arithmetic is done in intmax_t or uintmax_t,
+ * identifiers evaluate to 0.
+ *
+ * @param line (token_t *) Macro expanded tokens of the expression. `defined`
+ *     must have been replaced already
+ * @param mark Location of the end of the line
+ * @param result Location to store the value
+ * @return CCC_OK on success, error code on error
+ */
+status_t cpp_eval(vec_t *line, fmark_t mark, long long *result);
+
+#endif /* _CPP_EVAL_H_ */
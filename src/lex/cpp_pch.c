@@ -0,0 +1,796 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Precompiled headers
+ *
+ * A precompiled header holds a header's preprocessed tokens and the macros it
+ * left defined, laid out as they are in memory. Pointers are stored as
+ * indices or offsets, and are fixed up in place once the file is mapped, so
+ * nothing is lexed or copied when it's loaded. Strings are interned on load,
+ * and the source text the tokens came from is registered with the file mark
+ * table so their locations are kept.
+ *
+ * A header is only valid for the compiler and options it was written with.
+ */
+
+#include "cpp_pch.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "top/optman.h"
+#include "util/logger.h"
+#include "util/string_store.h"
+
+#define CPP_PCH_MAGIC "CCCPCH1"
+
+/**
+ * Rounds a size up to keep sections 8 byte aligned
+ */
+#define CPP_PCH_ALIGN(size) (((size) + 7) & ~(uint64_t)7)
+
+/**
+ * Marks after this are relative to the start of the file's source buffers
+ */
+#define CPP_PCH_MARK_BASE (FMARK_PRIM_TYPE + 1)
+
+/**
+ * Start of a precompiled header. Offsets are from the start of the file,
+ * except for data offsets which are from the start of the data section.
+ */
+typedef struct cpp_pch_header_t {
+    char magic[8];       /**< CPP_PCH_MAGIC */
+    uint64_t hash;       /**< Hash of the compiler and options */
+    uint64_t size;       /**< Size of the file */
+    uint64_t num_strs;   /**< Number of strings */
+    uint64_t strs;       /**< (uint64_t) Data offsets of the strings */
+    uint64_t num_bufs;   /**< Number of source buffers */
+    uint64_t bufs;       /**< (cpp_pch_buf_t) Source buffers */
+    uint64_t num_tokens; /**< Number of tokens */
+    uint64_t num_output; /**< Number of tokens of output, which come first */
+    uint64_t tokens;     /**< (token_t) Tokens */
+    uint64_t num_params; /**< Number of macro parameters */
+    uint64_t params;     /**< (char *) String index + 1, 0 for varargs */
+    uint64_t num_ops;    /**< Number of macro ops */
+    uint64_t ops;        /**< (cpp_macro_op_t) Ops of the macros */
+    uint64_t num_macros; /**< Number of macros */
+    uint64_t macros;     /**< (cpp_macro_t) Macros */
+    uint64_t num_once;   /**< Number of #pragma once files */
+    uint64_t once;       /**< (uint64_t) String indices of the files */
+    uint64_t data;       /**< Strings and source text */
+} cpp_pch_header_t;
+
+/**
+ * Source buffer in a precompiled header
+ */
+typedef struct cpp_pch_buf_t {
+    uint64_t name; /**< String index of the file name */
+    uint64_t text; /**< Data offset of the text */
+    uint64_t len;  /**< Length of the text */
+} cpp_pch_buf_t;
+
+/**
+ * String being written
+ */
+typedef struct cpp_pch_str_t {
+    sl_link_t link;
+    char *str;
+    uint64_t idx; /**< Index in the string table */
+} cpp_pch_str_t;
+
+/**
+ * Source buffer being written
+ */
+typedef struct cpp_pch_src_t {
+    fmark_t base;      /**< Mark of the start of the buffer */
+    const char *start; /**< Start of the buffer */
+    uint64_t len;      /**< Length of the buffer */
+    uint64_t rel;      /**< Mark of the start relative to the first buffer */
+    cpp_pch_buf_t buf; /**< Entry in the file */
+} cpp_pch_src_t;
+
+/**
+ * Sections of a precompiled header being written
+ */
+typedef struct cpp_pch_writer_t {
+    htable_t strs;             /**< char * -> cpp_pch_str_t */
+    uint64_t num_strs;         /**< Number of strings */
+    string_builder_t str_offs; /**< (uint64_t) Data offsets of the strings */
+    string_builder_t srcs;     /**< (cpp_pch_src_t) Source buffers */
+    uint64_t num_srcs;         /**< Number of source buffers */
+    uint64_t last_src;         /**< Index of the last buffer looked up */
+    uint64_t next_rel;         /**< Relative mark of the next buffer */
+    string_builder_t tokens;   /**< (token_t) Tokens */
+    uint64_t num_tokens;       /**< Number of tokens */
+    string_builder_t params;   /**< (char *) Macro parameters */
+    uint64_t num_params;       /**< Number of macro parameters */
+    string_builder_t ops;      /**< (cpp_macro_op_t) Macro ops */
+    uint64_t num_ops;          /**< Number of macro ops */
+    string_builder_t macros;   /**< (cpp_macro_t) Macros */
+    uint64_t num_macros;       /**< Number of macros */
+    string_builder_t once;     /**< (uint64_t) #pragma once files */
+    uint64_t num_once;         /**< Number of #pragma once files */
+    string_builder_t data;     /**< Strings and source text */
+} cpp_pch_writer_t;
+
+/**
+ * The included precompiled header
+ */
+typedef struct cpp_pch_t {
+    bool loaded;      /**< Whether loading was attempted */
+    status_t status;  /**< Status of loading */
+    void *map;        /**< The mapped file */
+    size_t size;      /**< Size of the mapping */
+    token_t **ptrs;   /**< Pointers to the file's tokens */
+    size_t num_output; /**< Number of tokens of output */
+    char **once;      /**< #pragma once files */
+    size_t num_once;  /**< Number of #pragma once files */
+    htable_t macros;  /**< char * -> cpp_macro_t, in the mapping */
+} cpp_pch_t;
+
+static cpp_pch_t s_pch;
+
+static const ht_params_t s_str_params = {
+    0,                             // Size estimate
+    offsetof(cpp_pch_str_t, str),  // Offset of key
+    offsetof(cpp_pch_str_t, link), // Offset of ht link
+    ind_str_hash,                  // Hash function
+    ind_str_eq,                    // void string compare
+};
+
+static const ht_params_t s_macro_params = {
+    0,                           // Size estimate
+    offsetof(cpp_macro_t, name), // Offset of key
+    offsetof(cpp_macro_t, link), // Offset of ht link
+    ind_str_hash,                // Hash function
+    ind_str_eq,                  // void string compare
+};
+
+/**
+ * Adds bytes to an FNV-1a hash
+ */
+static uint64_t cpp_pch_hash_bytes(uint64_t hash, const void *bytes,
+                                   size_t len) {
+    const unsigned char *cur = bytes;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ cur[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Returns the hash of the compiler and the options which affect
+ * preprocessing
+ */
+static uint64_t cpp_pch_hash(void) {
+    static bool computed = false;
+    static uint64_t hash;
+    if (computed) {
+        return hash;
+    }
+    computed = true;
+
+    hash = 14695981039346656037ULL;
+    hash = cpp_pch_hash_bytes(hash, CPP_PCH_MAGIC, sizeof(CPP_PCH_MAGIC));
+
+    size_t sizes[] = {
+        sizeof(void *), sizeof(token_t), sizeof(cpp_macro_t),
+        sizeof(cpp_macro_op_t), sizeof(cpp_pch_header_t)
+    };
+    hash = cpp_pch_hash_bytes(hash, sizes, sizeof(sizes));
+
+    // Any rebuild of the compiler changes its executable
+    char exe_path[PATH_MAX + 1] = { 0 };
+    get_exe_path(exe_path, PATH_MAX);
+    struct stat st;
+    if (stat(exe_path, &st) == 0) {
+        hash = cpp_pch_hash_bytes(hash, &st.st_size, sizeof(st.st_size));
+        hash = cpp_pch_hash_bytes(hash, &st.st_mtime, sizeof(st.st_mtime));
+    }
+
+    hash = cpp_pch_hash_bytes(hash, &optman.std, sizeof(optman.std));
+    VEC_FOREACH(cur, &optman.macros) {
+        char *macro = vec_get(&optman.macros, cur);
+        hash = cpp_pch_hash_bytes(hash, "D", 1);
+        hash = cpp_pch_hash_bytes(hash, macro, strlen(macro) + 1);
+    }
+    VEC_FOREACH(cur, &optman.include_paths) {
+        char *path = vec_get(&optman.include_paths, cur);
+        hash = cpp_pch_hash_bytes(hash, "I", 1);
+        hash = cpp_pch_hash_bytes(hash, path, strlen(path) + 1);
+    }
+
+    return hash;
+}
+
+/**
+ * Returns the index of a string, adding it if necessary
+ */
+static uint64_t cpp_pch_str(cpp_pch_writer_t *w, char *str) {
+    cpp_pch_str_t *entry = ht_lookup(&w->strs, &str);
+    if (entry != NULL) {
+        return entry->idx;
+    }
+
+    entry = emalloc(sizeof(*entry));
+    entry->str = str;
+    entry->idx = w->num_strs++;
+    status_t status = ht_insert(&w->strs, &entry->link);
+    assert(status == CCC_OK);
+
+    uint64_t off = sb_len(&w->data);
+    sb_append_len(&w->str_offs, (char *)&off, sizeof(off));
+    sb_append_len(&w->data, str, strlen(str) + 1);
+
+    return entry->idx;
+}
+
+/**
+ * Returns the source buffer containing a mark, adding it if necessary
+ */
+static cpp_pch_src_t *cpp_pch_src(cpp_pch_writer_t *w, fmark_t mark) {
+    cpp_pch_src_t *srcs = (cpp_pch_src_t *)sb_buf(&w->srcs);
+
+    // Consecutive tokens are usually from the same buffer
+    if (w->num_srcs > 0) {
+        cpp_pch_src_t *last = &srcs[w->last_src];
+        if (mark >= last->base && mark <= last->base + last->len) {
+            return last;
+        }
+    }
+    for (uint64_t i = 0; i < w->num_srcs; ++i) {
+        if (mark >= srcs[i].base && mark <= srcs[i].base + srcs[i].len) {
+            w->last_src = i;
+            return &srcs[i];
+        }
+    }
+
+    cpp_pch_src_t src;
+    size_t len;
+    src.base = fmark_buffer(mark, &src.start, &len);
+    src.len = len;
+    src.rel = w->next_rel;
+    src.buf.name = cpp_pch_str(w, fmark_filename(mark));
+    src.buf.text = sb_len(&w->data);
+    src.buf.len = len;
+    sb_append_len(&w->data, src.start, len);
+
+    // Each buffer has a mark for each character and one for its end
+    w->next_rel += len + 1;
+    if (w->next_rel > UINT32_MAX - CPP_PCH_MARK_BASE) {
+        exit_err("source location space exhausted");
+    }
+
+    sb_append_len(&w->srcs, (char *)&src, sizeof(src));
+    w->last_src = w->num_srcs++;
+
+    return &((cpp_pch_src_t *)sb_buf(&w->srcs))[w->last_src];
+}
+
+/**
+ * Returns a mark relative to the file's source buffers
+ */
+static fmark_t cpp_pch_mark(cpp_pch_writer_t *w, fmark_t mark) {
+    if (mark < CPP_PCH_MARK_BASE) {
+        return mark;
+    }
+    cpp_pch_src_t *src = cpp_pch_src(w, mark);
+    return CPP_PCH_MARK_BASE + src->rel + (mark - src->base);
+}
+
+/**
+ * Returns true if a token of the given type has a string value
+ */
+static bool cpp_pch_has_str(token_type_t type) {
+    switch (type) {
+    case ID:
+    case STRING:
+    case FLOATLIT:
+    case TOK_WARN:
+    case TOK_ERR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void cpp_pch_add_token(cpp_pch_writer_t *w, token_t *token) {
+    token_t copy;
+    memcpy(&copy, token, sizeof(copy));
+    copy.hideset = HIDESET_EMPTY;
+    copy.mark = cpp_pch_mark(w, token->mark);
+
+    // The spelling is stored as a data offset + 1
+    if (token->start != NULL) {
+        uint64_t off;
+        cpp_pch_src_t *src = token->mark < CPP_PCH_MARK_BASE ? NULL :
+            cpp_pch_src(w, token->mark);
+        if (src != NULL && token->start >= src->start &&
+            token->start + token->len <= src->start + src->len) {
+            off = src->buf.text + (token->start - src->start);
+        } else {
+            off = sb_len(&w->data);
+            sb_append_len(&w->data, token->start, token->len);
+        }
+        copy.start = (char *)(uintptr_t)(off + 1);
+    }
+    if (cpp_pch_has_str(token->type)) {
+        copy.str_val = (char *)(uintptr_t)cpp_pch_str(w, token->str_val);
+    }
+
+    sb_append_len(&w->tokens, (char *)&copy, sizeof(copy));
+    ++w->num_tokens;
+}
+
+static void cpp_pch_add_macro(cpp_pch_writer_t *w, cpp_macro_t *macro) {
+    cpp_macro_t copy;
+    memcpy(&copy, macro, sizeof(copy));
+    memset(&copy.link, 0, sizeof(copy.link));
+    copy.name = (char *)(uintptr_t)cpp_pch_str(w, macro->name);
+    copy.mark = cpp_pch_mark(w, macro->mark);
+
+    copy.stream.elems = (void **)(uintptr_t)w->num_tokens;
+    copy.stream.capacity = 0;
+    VEC_FOREACH(cur, &macro->stream) {
+        cpp_pch_add_token(w, vec_get(&macro->stream, cur));
+    }
+
+    copy.params.elems = (void **)(uintptr_t)w->num_params;
+    copy.params.capacity = 0;
+    VEC_FOREACH(cur, &macro->params) {
+        char *param = vec_get(&macro->params, cur);
+        char *idx = (char *)(uintptr_t)(param == NULL ? 0 :
+                                        cpp_pch_str(w, param) + 1);
+        sb_append_len(&w->params, (char *)&idx, sizeof(idx));
+        ++w->num_params;
+    }
+
+    copy.ops = (cpp_macro_op_t *)(uintptr_t)w->num_ops;
+    if (macro->num_ops > 0) {
+        sb_append_len(&w->ops, (char *)macro->ops,
+                      macro->num_ops * sizeof(*macro->ops));
+        w->num_ops += macro->num_ops;
+    }
+
+    sb_append_len(&w->macros, (char *)&copy, sizeof(copy));
+    ++w->num_macros;
+}
+
+/**
+ * Writes a section of the file, padded to keep the next one aligned
+ */
+static void cpp_pch_write_section(FILE *file, string_builder_t *sb) {
+    static const char padding[8] = { 0 };
+    size_t len = sb_len(sb);
+    fwrite(sb_buf(sb), 1, len, file);
+    fwrite(padding, 1, CPP_PCH_ALIGN(len) - len, file);
+}
+
+status_t cpp_pch_write(cpp_state_t *cs, vec_t *output, char *path) {
+    status_t status = CCC_OK;
+
+    // Embedded files are used in place, so they can't be saved as tokens
+    VEC_FOREACH(cur, output) {
+        token_t *token = vec_get(output, cur);
+        if (token->type == EMBED) {
+            logger_log(token->mark, LOG_ERR,
+                       "#embed cannot be used in a precompiled header");
+            return CCC_ESYNTAX;
+        }
+    }
+
+    cpp_pch_writer_t w;
+    ht_init(&w.strs, &s_str_params);
+    w.num_strs = 0;
+    w.num_srcs = 0;
+    w.last_src = 0;
+    w.next_rel = 0;
+    w.num_tokens = 0;
+    w.num_params = 0;
+    w.num_ops = 0;
+    w.num_macros = 0;
+    w.num_once = 0;
+    string_builder_t *sections[] = {
+        &w.str_offs, &w.srcs, &w.tokens, &w.params, &w.ops, &w.macros,
+        &w.once, &w.data
+    };
+    for (size_t i = 0; i < STATIC_ARRAY_LEN(sections); ++i) {
+        sb_init(sections[i], 0);
+    }
+
+    VEC_FOREACH(cur, output) {
+        cpp_pch_add_token(&w, vec_get(output, cur));
+    }
+    uint64_t num_output = w.num_tokens;
+
+    HT_FOREACH(link, &cs->macros) {
+        cpp_pch_add_macro(&w, GET_HT_ELEM(&cs->macros, link));
+    }
+
+    for (str_set_t *cur = cs->once; cur != NULL; cur = cur->next) {
+        uint64_t idx = cpp_pch_str(&w, cur->str);
+        sb_append_len(&w.once, (char *)&idx, sizeof(idx));
+        ++w.num_once;
+    }
+
+    // Only the file's entries of the source buffers are written
+    string_builder_t bufs;
+    sb_init(&bufs, 0);
+    cpp_pch_src_t *srcs = (cpp_pch_src_t *)sb_buf(&w.srcs);
+    for (uint64_t i = 0; i < w.num_srcs; ++i) {
+        sb_append_len(&bufs, (char *)&srcs[i].buf, sizeof(srcs[i].buf));
+    }
+
+    cpp_pch_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CPP_PCH_MAGIC, sizeof(CPP_PCH_MAGIC));
+    header.hash = cpp_pch_hash();
+    header.num_strs = w.num_strs;
+    header.num_bufs = w.num_srcs;
+    header.num_tokens = w.num_tokens;
+    header.num_output = num_output;
+    header.num_params = w.num_params;
+    header.num_ops = w.num_ops;
+    header.num_macros = w.num_macros;
+    header.num_once = w.num_once;
+
+    uint64_t off = CPP_PCH_ALIGN(sizeof(header));
+    header.strs = off;
+    off += CPP_PCH_ALIGN(sb_len(&w.str_offs));
+    header.bufs = off;
+    off += CPP_PCH_ALIGN(sb_len(&bufs));
+    header.tokens = off;
+    off += CPP_PCH_ALIGN(sb_len(&w.tokens));
+    header.params = off;
+    off += CPP_PCH_ALIGN(sb_len(&w.params));
+    header.ops = off;
+    off += CPP_PCH_ALIGN(sb_len(&w.ops));
+    header.macros = off;
+    off += CPP_PCH_ALIGN(sb_len(&w.macros));
+    header.once = off;
+    off += CPP_PCH_ALIGN(sb_len(&w.once));
+    header.data = off;
+    off += CPP_PCH_ALIGN(sb_len(&w.data));
+    header.size = off;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", path, strerror(errno));
+        status = CCC_FILEERR;
+        goto fail;
+    }
+
+    static const char padding[8] = { 0 };
+    fwrite(&header, 1, sizeof(header), file);
+    fwrite(padding, 1, CPP_PCH_ALIGN(sizeof(header)) - sizeof(header), file);
+    cpp_pch_write_section(file, &w.str_offs);
+    cpp_pch_write_section(file, &bufs);
+    cpp_pch_write_section(file, &w.tokens);
+    cpp_pch_write_section(file, &w.params);
+    cpp_pch_write_section(file, &w.ops);
+    cpp_pch_write_section(file, &w.macros);
+    cpp_pch_write_section(file, &w.once);
+    cpp_pch_write_section(file, &w.data);
+
+    if (ferror(file)) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", path, strerror(errno));
+        status = CCC_FILEERR;
+    }
+    if (EOF == fclose(file) && status == CCC_OK) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", path, strerror(errno));
+        status = CCC_FILEERR;
+    }
+
+fail:
+    sb_destroy(&bufs);
+    for (size_t i = 0; i < STATIC_ARRAY_LEN(sections); ++i) {
+        sb_destroy(sections[i]);
+    }
+    HT_DESTROY_FUNC(&w.strs, free);
+    return status;
+}
+
+/**
+ * Returns true if a section of count elements of size bytes at off is inside
+ * a file of the given size
+ */
+static bool cpp_pch_section_ok(uint64_t file_size, uint64_t off,
+                               uint64_t count, uint64_t size) {
+    return off % 8 == 0 && off <= file_size &&
+        count <= (file_size - off) / size;
+}
+
+/**
+ * Returns a mark of the file fixed up to the mark its source buffers were
+ * registered at
+ */
+static fmark_t cpp_pch_fix_mark(fmark_t mark, fmark_t base) {
+    return mark < CPP_PCH_MARK_BASE ? mark : base + (mark - CPP_PCH_MARK_BASE);
+}
+
+/**
+ * Maps a precompiled header and fixes up its pointers
+ */
+static status_t cpp_pch_load(char *path) {
+    status_t status = CCC_OK;
+    char **strs = NULL;
+    ht_init(&s_pch.macros, &s_macro_params);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", path, strerror(errno));
+        return CCC_FILEERR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", path, strerror(errno));
+        close(fd);
+        return CCC_FILEERR;
+    }
+    if ((size_t)st.st_size < sizeof(cpp_pch_header_t)) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: not a precompiled header", path);
+        close(fd);
+        return CCC_FILEERR;
+    }
+
+    // Private so the pointers can be fixed up in place
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", path, strerror(errno));
+        return CCC_FILEERR;
+    }
+    s_pch.map = map;
+    s_pch.size = st.st_size;
+
+    char *base = map;
+    cpp_pch_header_t *header = map;
+    if (memcmp(header->magic, CPP_PCH_MAGIC, sizeof(CPP_PCH_MAGIC)) != 0 ||
+        header->size != s_pch.size) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: not a precompiled header", path);
+        return CCC_FILEERR;
+    }
+    if (header->hash != cpp_pch_hash()) {
+        logger_log(FMARK_NONE, LOG_ERR,
+                   "%s: precompiled header was created by a different "
+                   "compiler or with different options", path);
+        return CCC_FILEERR;
+    }
+    uint64_t size = header->size;
+    if (!cpp_pch_section_ok(size, header->strs, header->num_strs,
+                            sizeof(uint64_t)) ||
+        !cpp_pch_section_ok(size, header->bufs, header->num_bufs,
+                            sizeof(cpp_pch_buf_t)) ||
+        !cpp_pch_section_ok(size, header->tokens, header->num_tokens,
+                            sizeof(token_t)) ||
+        !cpp_pch_section_ok(size, header->params, header->num_params,
+                            sizeof(char *)) ||
+        !cpp_pch_section_ok(size, header->ops, header->num_ops,
+                            sizeof(cpp_macro_op_t)) ||
+        !cpp_pch_section_ok(size, header->macros, header->num_macros,
+                            sizeof(cpp_macro_t)) ||
+        !cpp_pch_section_ok(size, header->once, header->num_once,
+                            sizeof(uint64_t)) ||
+        !cpp_pch_section_ok(size, header->data, 0, 1) ||
+        header->num_output > header->num_tokens) {
+        goto corrupt;
+    }
+    char *data = base + header->data;
+    uint64_t data_size = size - header->data;
+
+    // Strings are interned so they're shared with the rest of the compiler
+    uint64_t *str_offs = (uint64_t *)(base + header->strs);
+    strs = emalloc(header->num_strs * sizeof(*strs));
+    for (uint64_t i = 0; i < header->num_strs; ++i) {
+        uint64_t off = str_offs[i];
+        if (off >= data_size ||
+            memchr(data + off, '\0', data_size - off) == NULL) {
+            goto corrupt;
+        }
+        strs[i] = sstore_lookup(data + off);
+    }
+
+    // The buffers are registered consecutively, so marks relative to the first
+    // only need the first's mark added
+    cpp_pch_buf_t *bufs = (cpp_pch_buf_t *)(base + header->bufs);
+    uint64_t num_marks = 0;
+    for (uint64_t i = 0; i < header->num_bufs; ++i) {
+        if (bufs[i].name >= header->num_strs || bufs[i].text > data_size ||
+            bufs[i].len > data_size - bufs[i].text) {
+            goto corrupt;
+        }
+        // Each buffer has a mark for each character and one for its end
+        num_marks += bufs[i].len + 1;
+    }
+    if (num_marks > UINT32_MAX - CPP_PCH_MARK_BASE) {
+        goto corrupt;
+    }
+    fmark_t mark_base = FMARK_NONE;
+    for (uint64_t i = 0; i < header->num_bufs; ++i) {
+        char *text = data + bufs[i].text;
+        fmark_t mark = fmark_register(strs[bufs[i].name], text,
+                                      text + bufs[i].len);
+        if (i == 0) {
+            mark_base = mark;
+        }
+    }
+
+    token_t *tokens = (token_t *)(base + header->tokens);
+    s_pch.ptrs = emalloc(header->num_tokens * sizeof(*s_pch.ptrs));
+    for (uint64_t i = 0; i < header->num_tokens; ++i) {
+        token_t *token = &tokens[i];
+        if (token->type > FUNC || token->type == EMBED ||
+            (token->mark >= CPP_PCH_MARK_BASE &&
+             token->mark - CPP_PCH_MARK_BASE >= num_marks)) {
+            goto corrupt;
+        }
+        token->mark = cpp_pch_fix_mark(token->mark, mark_base);
+        token->hideset = HIDESET_EMPTY;
+        if (token->start != NULL) {
+            uintptr_t off = (uintptr_t)token->start - 1;
+            if (off > data_size || token->len > data_size - off) {
+                goto corrupt;
+            }
+            token->start = data + off;
+        }
+        if (cpp_pch_has_str(token->type)) {
+            uintptr_t idx = (uintptr_t)token->str_val;
+            if (idx >= header->num_strs) {
+                goto corrupt;
+            }
+            token->str_val = strs[idx];
+        }
+        s_pch.ptrs[i] = token;
+    }
+    s_pch.num_output = header->num_output;
+
+    char **params = (char **)(base + header->params);
+    for (uint64_t i = 0; i < header->num_params; ++i) {
+        uintptr_t idx = (uintptr_t)params[i];
+        if (idx > header->num_strs) {
+            goto corrupt;
+        }
+        params[i] = idx == 0 ? NULL : strs[idx - 1];
+    }
+
+    cpp_macro_op_t *ops = (cpp_macro_op_t *)(base + header->ops);
+    cpp_macro_t *macros = (cpp_macro_t *)(base + header->macros);
+    for (uint64_t i = 0; i < header->num_macros; ++i) {
+        cpp_macro_t *macro = &macros[i];
+        uintptr_t name = (uintptr_t)macro->name;
+        uintptr_t stream = (uintptr_t)macro->stream.elems;
+        uintptr_t param = (uintptr_t)macro->params.elems;
+        uintptr_t op = (uintptr_t)macro->ops;
+        if (name >= header->num_strs || macro->type > CPP_MACRO_UNDEF ||
+            (macro->mark >= CPP_PCH_MARK_BASE &&
+             macro->mark - CPP_PCH_MARK_BASE >= num_marks) ||
+            stream > header->num_tokens ||
+            macro->stream.size > header->num_tokens - stream ||
+            param > header->num_params ||
+            macro->params.size > header->num_params - param ||
+            macro->num_params < -1 ||
+            (macro->num_params >= 0 &&
+             (size_t)macro->num_params > macro->params.size) ||
+            op > header->num_ops || macro->num_ops > header->num_ops - op) {
+            goto corrupt;
+        }
+
+        macro->name = strs[name];
+        macro->mark = cpp_pch_fix_mark(macro->mark, mark_base);
+        macro->stream.elems = (void **)&s_pch.ptrs[stream];
+        macro->params.elems = (void **)&params[param];
+        macro->ops = macro->num_ops == 0 ? NULL : &ops[op];
+
+        // Ops index the macro's own body and parameters
+        for (size_t j = 0; j < macro->num_ops; ++j) {
+            cpp_macro_op_t *cur = &macro->ops[j];
+            bool has_param = cur->type == CPP_OP_PARAM ||
+                cur->type == CPP_OP_PARAM_RAW ||
+                cur->type == CPP_OP_STRINGIFY ||
+                cur->type == CPP_OP_PASTE_PARAM;
+            if ((unsigned)cur->type > CPP_OP_PASTE_PARAM ||
+                cur->idx >= macro->stream.size ||
+                (has_param &&
+                 (cur->param < 0 || cur->param >= macro->num_params))) {
+                goto corrupt;
+            }
+        }
+
+        status = ht_insert(&s_pch.macros, &macro->link);
+        if (status != CCC_OK) {
+            goto corrupt;
+        }
+    }
+
+    uint64_t *once = (uint64_t *)(base + header->once);
+    s_pch.once = emalloc(header->num_once * sizeof(*s_pch.once));
+    for (uint64_t i = 0; i < header->num_once; ++i) {
+        if (once[i] >= header->num_strs) {
+            goto corrupt;
+        }
+        s_pch.once[i] = strs[once[i]];
+    }
+    s_pch.num_once = header->num_once;
+
+    free(strs);
+    return status;
+
+corrupt:
+    logger_log(FMARK_NONE, LOG_ERR, "%s: precompiled header is corrupt", path);
+    free(strs);
+    return CCC_FILEERR;
+}
+
+status_t cpp_pch_include(cpp_state_t *cs, char *path, vec_t *output) {
+    if (!s_pch.loaded) {
+        s_pch.loaded = true;
+        s_pch.status = cpp_pch_load(path);
+    }
+    if (s_pch.status != CCC_OK) {
+        return s_pch.status;
+    }
+
+    for (size_t i = 0; i < s_pch.num_output; ++i) {
+        cs->file_mark = s_pch.ptrs[i]->mark;
+        cpp_stream_append(cs, output, s_pch.ptrs[i]);
+    }
+    // #pragma once is recorded on the first path of a file, which may differ
+    // in this compilation
+    for (size_t i = 0; i < s_pch.num_once; ++i) {
+        char *once = s_pch.once[i];
+        fdir_entry_t *entry;
+        if (CCC_OK == fdir_insert(once, &entry)) {
+            once = entry->file->filename;
+        }
+        cs->once = str_set_add(cs->once, once);
+    }
+    if (cs->deps != NULL) {
+        cpp_add_dep(cs, path);
+    }
+
+    return CCC_OK;
+}
+
+cpp_macro_t *cpp_pch_lookup(char *name) {
+    if (!s_pch.loaded || s_pch.status != CCC_OK) {
+        return NULL;
+    }
+    return ht_lookup(&s_pch.macros, &name);
+}
+
+void cpp_pch_destroy(void) {
+    if (!s_pch.loaded) {
+        return;
+    }
+
+    ht_destroy(&s_pch.macros);
+    free(s_pch.ptrs);
+    free(s_pch.once);
+    if (s_pch.map != NULL) {
+        munmap(s_pch.map, s_pch.size);
+    }
+    memset(&s_pch, 0, sizeof(s_pch));
+}
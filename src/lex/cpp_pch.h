@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Precompiled header interface
+ */
+
+#ifndef _CPP_PCH_H_
+#define _CPP_PCH_H_
+
+#include "lex/cpp_priv.h"
+
+/**
+ * Writes a precompiled header: the preprocessed tokens of a header, and the
+ * macros it leaves defined
+ *
+ * @param cs Preprocessor state after processing the header
+ * @param output (token_t *) Preprocessed tokens of the header
+ * @param path Path of the file to write
+ * @return CCC_OK on success, error code on error
+ */
+status_t cpp_pch_write(cpp_state_t *cs, vec_t *output, char *path);
+
+/**
+ * Includes a precompiled header. Its tokens are appended to output and its
+ * macros become visible to cpp_macro_lookup. The file is only loaded the
+ * first time it's included.
+ *
+ * @param cs Preprocessor state
+ * @param path Path of the precompiled header
+ * @param output (token_t *) Location to append the tokens
+ * @return CCC_OK on success, error code on error
+ */
+status_t cpp_pch_include(cpp_state_t *cs, char *path, vec_t *output);
+
+/**
+ * Looks up a macro defined by the included precompiled header
+ *
+ * @param name Name of the macro
+ * @return The macro, NULL if there is none or no header was included
+ */
+cpp_macro_t *cpp_pch_lookup(char *name);
+
+/**
+ * Unloads the included precompiled header
+ */
+void cpp_pch_destroy(void);
+
+#endif /* _CPP_PCH_H_ */
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Preprocessed output printer
+ *
+ * Text is built in a large buffer which is written whenever it fills, so the
+ * output never has to be held in memory as a whole.
+ */
+
+#include "cpp_print.h"
+
+#include <ctype.h>
+#include <string.h>
+
+/**
+ * Writes the buffered text
+ */
+static void cpp_print_flush(cpp_printer_t *printer) {
+    fwrite(sb_buf(&printer->buf), 1, sb_len(&printer->buf), printer->file);
+    sb_clear(&printer->buf);
+}
+
+/**
+ * Ends the current line if anything was printed on it
+ */
+static void cpp_print_end_line(cpp_printer_t *printer) {
+    if (printer->last != '\0') {
+        sb_append_char(&printer->buf, '\n');
+        printer->last = '\0';
+    }
+}
+
+/**
+ * Prints a line marker, the following line is line in filename
+ */
+static void cpp_print_marker(cpp_printer_t *printer, char *filename,
+                             int line) {
+    cpp_print_end_line(printer);
+    sb_append_printf(&printer->buf, "# %d \"", line);
+    for (char *cur = filename; *cur != '\0'; ++cur) {
+        if (*cur == '"' || *cur == '\\') {
+            sb_append_char(&printer->buf, '\\');
+        }
+        sb_append_char(&printer->buf, *cur);
+    }
+    sb_append_char(&printer->buf, '"');
+    if (printer->flag != 0) {
+        sb_append_printf(&printer->buf, " %d", printer->flag);
+        printer->flag = 0;
+    }
+    sb_append_char(&printer->buf, '\n');
+
+    printer->filename = filename;
+    printer->line = line;
+}
+
+/**
+ * Returns true if printing c1 then c2 with no space between them could lex
+ * differently than the tokens they're from, e.g. + + or x 1. A quote after an
+ * identifier may join it as an encoding prefix, e.g. L "s"
+ */
+static bool cpp_print_pastes(char c1, char c2) {
+    static const char *punct = "+-*/%<>=!&|^#:.";
+
+    if (c1 == '\0' || c2 == '\0') {
+        return false;
+    }
+    if (isalnum(c1) || c1 == '_') {
+        return isalnum(c2) || c2 == '_' || c2 == '.' || c2 == '\'' ||
+            c2 == '"';
+    }
+    if (c1 == '.') {
+        return isalnum(c2) || c2 == '_' || c2 == '.';
+    }
+    return strchr(punct, c1) != NULL && strchr(punct, c2) != NULL;
+}
+
+/**
+ * Removes line splices from the text in sb starting at pos
+ */
+static void cpp_print_unsplice(string_builder_t *sb, size_t pos) {
+    char *dest = sb_buf(sb) + pos;
+    char *end = sb_buf(sb) + sb_len(sb);
+    for (char *cur = dest; cur < end; ++cur) {
+        if (*cur == '\\') {
+            char *next = cur + 1;
+            if (next < end && *next == '\r') {
+                ++next;
+            }
+            if (next < end && *next == '\n') {
+                cur = next;
+                continue;
+            }
+        }
+        *(dest++) = *cur;
+    }
+    *dest = '\0';
+    sb->len = dest - sb_buf(sb);
+}
+
+void cpp_printer_init(cpp_printer_t *printer, FILE *file) {
+    printer->file = file;
+    sb_init(&printer->buf, CPP_PRINT_BUF_SIZE);
+    printer->filename = NULL;
+    printer->line = 0;
+    printer->mark = FMARK_NONE;
+    printer->depth = 0;
+    printer->flag = 0;
+    printer->last = '\0';
+}
+
+status_t cpp_printer_destroy(cpp_printer_t *printer) {
+    cpp_print_end_line(printer);
+    cpp_print_flush(printer);
+    sb_destroy(&printer->buf);
+
+    return ferror(printer->file) ? CCC_FILEERR : CCC_OK;
+}
+
+void cpp_print_enter(cpp_printer_t *printer, char *filename) {
+    if (++printer->depth > 1) {
+        printer->flag = 1;
+    }
+    cpp_print_marker(printer, filename, 1);
+    printer->mark = FMARK_NONE;
+}
+
+void cpp_print_leave(cpp_printer_t *printer, fmark_t mark) {
+    if (--printer->depth > 0 && mark > FMARK_PRIM_TYPE) {
+        printer->flag = 2;
+        cpp_print_marker(printer, fmark_filename(mark), fmark_line(mark) + 1);
+    }
+    printer->mark = FMARK_NONE;
+}
+
+void cpp_print_token(cpp_printer_t *printer, token_t *token, fmark_t mark) {
+    // Only move to the token's line when it comes from a new source token
+    if (mark != printer->mark && mark > FMARK_PRIM_TYPE) {
+        printer->mark = mark;
+        char *filename = fmark_filename(mark);
+        int line = fmark_line(mark);
+
+        if (printer->filename == NULL ||
+            (filename != printer->filename &&
+             strcmp(filename, printer->filename) != 0) ||
+            line < printer->line ||
+            line - printer->line > CPP_PRINT_MAX_BLANK) {
+            cpp_print_marker(printer, filename, line);
+        } else if (line > printer->line) {
+            if (printer->last != '\0') {
+                cpp_print_end_line(printer);
+                ++printer->line;
+            }
+            for (; printer->line < line; ++printer->line) {
+                sb_append_char(&printer->buf, '\n');
+            }
+        }
+    }
+
+    string_builder_t *sb = &printer->buf;
+    size_t pos = sb_len(sb);
+    if (token->type == ID) {
+        sb_append_len(sb, token->id_name, strlen(token->id_name));
+    } else {
+        token_str_append_sb(sb, token);
+    }
+
+    // Spellings from the source may contain line splices
+    if (memchr(sb_buf(sb) + pos, '\n', sb_len(sb) - pos) != NULL) {
+        cpp_print_unsplice(sb, pos);
+    }
+    if (sb_len(sb) == pos) {
+        return;
+    }
+
+    char *text = sb_buf(sb) + pos;
+    if (printer->last != '\0' &&
+        (token->hasSpace || cpp_print_pastes(printer->last, text[0]))) {
+        sb_append_char(sb, ' ');
+        text = sb_buf(sb) + pos;
+        memmove(text + 1, text, sb_len(sb) - pos - 1);
+        text[0] = ' ';
+    }
+    printer->last = sb_buf(sb)[sb_len(sb) - 1];
+
+    if (sb_len(sb) >= CPP_PRINT_BUF_SIZE) {
+        cpp_print_flush(printer);
+    }
+}
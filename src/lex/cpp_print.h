@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Preprocessed output printer interface
+ */
+
+#ifndef _CPP_PRINT_H_
+#define _CPP_PRINT_H_
+
+#include <stdio.h>
+
+#include "lex/token.h"
+#include "util/file_mark.h"
+#include "util/status.h"
+#include "util/string_builder.h"
+
+/**
+ * Output is written once this many bytes are buffered
+ */
+#define CPP_PRINT_BUF_SIZE (64 * 1024)
+
+/**
+ * Most blank lines printed to reach a token's line. Further lines are skipped
+ * with a line marker.
+ */
+#define CPP_PRINT_MAX_BLANK 8
+
+/**
+ * Prints preprocessed tokens as text as they are produced, with
+ * # line "file" markers so locations can be recovered
+ */
+typedef struct cpp_printer_t {
+    FILE *file;       /**< File to write to */
+    string_builder_t buf; /**< Text not yet written */
+    char *filename;   /**< File of the current line */
+    int line;         /**< Line number of the current line */
+    fmark_t mark;     /**< Source location of the last token */
+    int depth;        /**< Include depth */
+    int flag;         /**< Flag of the next line marker, 0 if none */
+    char last;        /**< Last character printed, 0 if none on this line */
+} cpp_printer_t;
+
+/**
+ * Initializes a printer
+ *
+ * @param printer The printer to initialize
+ * @param file File to write to
+ */
+void cpp_printer_init(cpp_printer_t *printer, FILE *file);
+
+/**
+ * Writes buffered output and destroys a printer
+ *
+ * @param printer The printer to destroy
+ * @return CCC_OK on success, CCC_FILEERR if writing failed
+ */
+status_t cpp_printer_destroy(cpp_printer_t *printer);
+
+/**
+ * Marks the start of a file
+ *
+ * @param printer The printer
+ * @param filename Name of the file
+ */
+void cpp_print_enter(cpp_printer_t *printer, char *filename);
+
+/**
+ * Marks the end of a file, returning to the file that included it
+ *
+ * @param printer The printer
+ * @param mark Location of the #include directive of the file
+ */
+void cpp_print_leave(cpp_printer_t *printer, fmark_t mark);
+
+/**
+ * Prints a token
+ *
+ * @param printer The printer
+ * @param token The token to print
+ * @param mark Source location of the token. For tokens from a macro
+ *     expansion, this is the location of the macro's name
+ */
+void cpp_print_token(cpp_printer_t *printer, token_t *token, fmark_t mark);
+
+#endif /* _CPP_PRINT_H_ */
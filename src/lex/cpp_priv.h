@@ -24,12 +24,16 @@
 #define _CPP_PRIV_
 
 #include "cpp.h"
+#include "cpp_print.h"
 
+#include "util/file_directory.h"
 #include "util/htable.h"
+#include "util/string_set.h"
 
 typedef enum cpp_dir_type_t {
     CPP_DIR_NONE,
     CPP_DIR_include,
+    CPP_DIR_embed,
     CPP_DIR_define,
     CPP_DIR_undef,
     CPP_DIR_ifdef,
@@ -45,11 +49,44 @@ typedef enum cpp_dir_type_t {
 } cpp_dir_type_t;
 
 
+/**
+ * A file being preprocessed. It is lexed a line at a time as tokens are
+ * needed, so inactive groups can be skipped without lexing them.
+ */
+typedef struct cpp_file_t {
+    tstream_t stream; /**< Unlexed remainder of the file */
+    vec_t tokens;     /**< (token_t *) Tokens lexed so far */
+    status_t status;  /**< Status of lexing the file */
+
+    /** Shared tokens lines are taken from. NULL if lexing privately */
+    struct cpp_shared_file_t *shared;
+} cpp_file_t;
+
+/**
+ * A group which was skipped while lexing a shared file
+ */
+typedef struct cpp_file_gap_t {
+    size_t idx;       /**< Index of the token following the group */
+    tstream_t stream; /**< Stream at the start of the group */
+} cpp_file_gap_t;
+
+/**
+ * An included file, lexed once for every file processed. Its tokens are
+ * immutable, and lexed a line at a time by whichever file first needs them.
+ * A file in which a skipped group is active lexes the rest privately.
+ */
+typedef struct cpp_shared_file_t {
+    sl_link_t link;   /**< Table link */
+    fdir_id_t id;     /**< Identity of the file, from its fdir entry */
+    cpp_file_t file;  /**< Tokens lexed so far */
+    vec_t gaps;       /**< (cpp_file_gap_t *) Skipped groups, in order */
+} cpp_shared_file_t;
+
 typedef struct cpp_state_t {
     char *filename;
     token_man_t *token_man;
     lexer_t *lexer;
-    htable_t macros; /**< char * -> cpp_macro_t */
+    htable_t macros; /**< char * -> cpp_macro_t, shadows predefined macros */
     vec_t search_path; /**< (char *) */
 
     char *cur_filename; /**< filename for __FILE__ */
@@ -66,6 +103,12 @@ typedef struct cpp_state_t {
 
     token_t *last_top_token;
     int expand_level;
+    vec_t *output; /**< Final output, lexer errors are reported in it */
+    cpp_file_t *file; /**< File being processed */
+    fmark_t file_mark; /**< Location of the last token read from a file */
+    cpp_printer_t *printer; /**< Prints the final output, NULL to keep it */
+    vec_t *deps; /**< (char *) Included user headers, NULL if not needed */
+    str_set_t *once; /**< Files included so far containing #pragma once */
 } cpp_state_t;
 
 typedef enum cpp_macro_type_t {
@@ -74,27 +117,53 @@ typedef enum cpp_macro_type_t {
     CPP_MACRO_LINE,  /**< __LINE__ */
     CPP_MACRO_DATE,  /**< __DATE__ */
     CPP_MACRO_TIME,  /**< __TIME__ */
+    CPP_MACRO_UNDEF, /**< Hides an #undef'd predefined macro */
 } cpp_macro_type_t;
 
+/**
+ * Operations of a compiled macro body
+ */
+typedef enum cpp_op_type_t {
+    CPP_OP_TOKEN,       /**< Body token */
+    CPP_OP_PARAM,       /**< Macro expanded argument */
+    CPP_OP_PARAM_RAW,   /**< Unexpanded argument, left operand of ## */
+    CPP_OP_STRINGIFY,   /**< # applied to an argument */
+    CPP_OP_PASTE,       /**< ## with a body token */
+    CPP_OP_PASTE_PARAM, /**< ## with an argument */
+} cpp_op_type_t;
+
+typedef struct cpp_macro_op_t {
+    cpp_op_type_t type; /**< Type of operation */
+    int param;          /**< Index of the argument. __VA_ARGS__ is last */
+    size_t idx;         /**< Index of the body token the operation is from */
+} cpp_macro_op_t;
+
 typedef struct cpp_macro_t {
     sl_link_t link;
     char *name;
-    fmark_t *mark;
+    fmark_t mark;
     vec_t stream; /**< (token_t) */
     vec_t params; /**< (char *) name NULL if varargs */
     int num_params; /**< -1 if object like macro */
     cpp_macro_type_t type;
+    cpp_macro_op_t *ops; /**< Body compiled by cpp_macro_compile */
+    size_t num_ops;      /**< Number of ops */
 } cpp_macro_t;
 
-typedef struct cpp_macro_param_t {
-    sl_link_t link;
-    char *name;
-    vec_t stream;
-} cpp_macro_param_t;
+/**
+ * Span of a macro argument in the tokens of the invocation
+ */
+typedef struct cpp_macro_arg_t {
+    size_t begin;     /**< Index of the first token */
+    size_t end;       /**< Index past the last token */
+    bool is_expanded; /**< Whether expanded has been computed */
+    vec_t expanded;   /**< (token_t *) Macro expanded argument */
+} cpp_macro_arg_t;
 
 typedef struct cpp_macro_inst_t {
     cpp_macro_t *macro;
-    slist_t args;       /**< cpp_macro_param_t */
+    vec_t *tokens;         /**< (token_t *) Tokens of the invocation */
+    cpp_macro_arg_t *args; /**< Arguments, indexed by parameter */
 } cpp_macro_inst_t;
 
 #define VERIFY_TOK_ID(token)                                \
@@ -106,39 +175,96 @@ typedef struct cpp_macro_inst_t {
         }                                                   \
     } while (0)
 
-inline void cpp_iter_skip_space(vec_iter_t *iter) {
-    for (; vec_iter_has_next(iter); vec_iter_advance(iter)) {
-        token_t *token = vec_iter_get(iter);
-        if (token->type != SPACE) {
-            break;
-        }
-    }
-}
-
 status_t cpp_state_init(cpp_state_t *cs, token_man_t *token_man,
                         lexer_t *lexer);
 
 void cpp_macro_destroy(cpp_macro_t *macro);
 
+/**
+ * Looks up the current definition of a macro, which is either defined in this
+ * file or predefined
+ *
+ * @param cs Preprocessor state
+ * @param name Name of the macro
+ * @return The macro, or NULL if it isn't defined
+ */
+cpp_macro_t *cpp_macro_lookup(cpp_state_t *cs, char *name);
+
+/**
+ * Undefines a macro
+ *
+ * @param cs Preprocessor state
+ * @param name Name of the macro
+ */
+void cpp_macro_undef(cpp_state_t *cs, char *name);
+
 void cpp_macro_inst_destroy(cpp_macro_inst_t *macro_inst);
 
 void cpp_state_destroy(cpp_state_t *cs);
 
-token_t *cpp_iter_advance(vec_iter_t *iter, bool skip_space);
+token_t *cpp_iter_advance(vec_iter_t *iter);
 
-token_t *cpp_iter_lookahead(vec_iter_t *iter, size_t lookahead);
+/**
+ * Returns whether an iterator has another token. If iter is over the current
+ * file's tokens, more of the file is lexed as needed. Inactive groups are
+ * skipped while ignoring.
+ */
+bool cpp_iter_has_next(cpp_state_t *cs, vec_iter_t *iter);
 
-token_t *cpp_next_nonspace(vec_iter_t *iter, bool inplace);
+token_t *cpp_iter_lookahead(vec_iter_t *iter, size_t lookahead);
 
+/**
+ * Appends a token to a stream of tokens. Errors and warnings from the lexer
+ * are reported, and adjacent strings concatenated, when they reach the final
+ * output. With a printer, tokens reaching the final output are printed
+ * instead.
+ */
 void cpp_stream_append(cpp_state_t *cs, vec_t *output, token_t *token);
 
+/**
+ * Concatenates the run of adjacent strings at the end of output into one
+ * string, interning only the result
+ */
+void cpp_join_strings(cpp_state_t *cs, vec_t *output);
+
 status_t cpp_process_file(cpp_state_t *cs, char *filename, vec_t *output);
 
-size_t cpp_skip_line(vec_iter_t *ts, bool skip_newline);
+/**
+ * Records a header as a dependency of the file being processed, unless it's in
+ * a system directory or was already recorded
+ *
+ * @param cs Preprocessor state. cs->deps must be non NULL
+ * @param path Path of the header
+ */
+void cpp_add_dep(cpp_state_t *cs, char *path);
+
+/**
+ * Returns true if including a file again would have no effect, because it
+ * was already included with #pragma once or its include guard is defined
+ */
+bool cpp_include_skip(cpp_state_t *cs, fdir_entry_t *entry);
+
+/**
+ * Detects an include guard: the whole file is wrapped in #ifndef X or
+ * #if !defined X with no #elif or #else at the outer level
+ *
+ * @param tokens Tokens of the file
+ * @return The guard macro's name, NULL if the file has no guard
+ */
+char *cpp_find_guard(vec_t *tokens);
+
+size_t cpp_skip_line(vec_iter_t *ts);
 
 bool cpp_macro_equal(cpp_macro_t *m1, cpp_macro_t *m2);
 
-vec_t *cpp_macro_inst_lookup(cpp_macro_inst_t *inst, char *arg_name);
+/**
+ * Compiles the body of a macro into ops, resolving parameter names to
+ * indices so substitution doesn't need to look them up
+ *
+ * @param macro The macro to compile. Its stream and params must be set
+ * @return CCC_OK on success, error code on error
+ */
+status_t cpp_macro_compile(cpp_macro_t *macro);
 
 status_t cpp_macro_define(cpp_state_t *cs, char *string,
                           cpp_macro_type_t type, bool has_eq);
@@ -146,7 +272,7 @@ status_t cpp_macro_define(cpp_state_t *cs, char *string,
 status_t cpp_expand(cpp_state_t *cs, vec_iter_t *ts, vec_t *output);
 
 status_t cpp_substitute(cpp_state_t *cs, cpp_macro_inst_t *macro_inst,
-                        str_set_t *hideset, vec_t *output);
+                        hideset_t *hideset, vec_t *output);
 
 status_t cpp_handle_directive(cpp_state_t *cs, vec_iter_t *ts, vec_t *output);
 
@@ -158,7 +284,7 @@ token_t *cpp_stringify(cpp_state_t *cs, vec_t *ts);
 status_t cpp_glue(cpp_state_t *cs, vec_t *left, vec_iter_t *right,
                   size_t nelems);
 
-void cpp_handle_special_macro(cpp_state_t *cs, fmark_t *mark,
+void cpp_handle_special_macro(cpp_state_t *cs, token_t *name,
                               cpp_macro_type_t type, vec_t *output);
 
 
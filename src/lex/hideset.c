@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Macro expansion hideset implementation
+ */
+
+#include "hideset.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/util.h"
+
+/** Memoized operations. 0 is reserved for unused cache entries */
+enum {
+    HIDESET_OP_ADD = 1,
+    HIDESET_OP_UNION,
+    HIDESET_OP_INTERSECT,
+};
+
+static uint32_t hideset_key_hash(const void *vkey) {
+    return ((const hideset_key_t *)vkey)->hash;
+}
+
+static bool hideset_key_eq(const void *vkey1, const void *vkey2) {
+    const hideset_key_t *key1 = vkey1;
+    const hideset_key_t *key2 = vkey2;
+
+    return key1->hash == key2->hash && key1->size == key2->size &&
+        memcmp(key1->names, key2->names, key1->size * sizeof(char *)) == 0;
+}
+
+void hideset_man_init(hideset_man_t *hm) {
+    static const ht_params_t s_params = {
+        0,                            // No Size estimate
+        offsetof(hideset_t, key),     // Offset of key
+        offsetof(hideset_t, link),    // Offset of ht link
+        hideset_key_hash,             // Hash function
+        hideset_key_eq,               // void string compare
+    };
+
+    ht_init(&hm->sets, &s_params);
+    hm->buf = NULL;
+    hm->buf_size = 0;
+    memset(hm->cache, 0, sizeof(hm->cache));
+}
+
+void hideset_man_destroy(hideset_man_t *hm) {
+    HT_DESTROY_FUNC(&hm->sets, free);
+    free(hm->buf);
+}
+
+bool hideset_mem(const hideset_t *set, const char *name) {
+    if (set == HIDESET_EMPTY) {
+        return false;
+    }
+
+    size_t lo = 0, hi = set->key.size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (set->key.names[mid] == name) {
+            return true;
+        }
+        if ((uintptr_t)set->key.names[mid] < (uintptr_t)name) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Makes sure the scratch buffer can hold size names
+ */
+static char **hideset_buf(hideset_man_t *hm, size_t size) {
+    if (hm->buf_size < size) {
+        hm->buf_size = size * 2;
+        hm->buf = erealloc(hm->buf, hm->buf_size * sizeof(char *));
+    }
+
+    return hm->buf;
+}
+
+/**
+ * Returns the interned hideset containing the given sorted names
+ */
+static hideset_t *hideset_intern(hideset_man_t *hm, char **names,
+                                 size_t size) {
+    if (size == 0) {
+        return HIDESET_EMPTY;
+    }
+
+    hideset_key_t key = { 5381, size, names };
+    for (size_t i = 0; i < size; ++i) {
+        key.hash = key.hash * 33 + (uint32_t)((uintptr_t)names[i] >> 3);
+    }
+
+    hideset_t *set = ht_lookup(&hm->sets, &key);
+    if (set != NULL) {
+        return set;
+    }
+
+    // Store the names after the set
+    set = emalloc(sizeof(*set) + size * sizeof(char *));
+    set->key = key;
+    set->key.names = (char **)(set + 1);
+    memcpy(set->key.names, names, size * sizeof(char *));
+
+    status_t status = ht_insert(&hm->sets, &set->link);
+    assert(status == CCC_OK);
+
+    return set;
+}
+
+/**
+ * Returns the cache entry for an operation
+ */
+static hideset_op_t *hideset_cache(hideset_man_t *hm, int op, hideset_t *lhs,
+                                   const void *rhs) {
+    uintptr_t hash = ((uintptr_t)lhs >> 4) * 31 + ((uintptr_t)rhs >> 4) + op;
+    return &hm->cache[(hash ^ (hash >> 8)) % HIDESET_CACHE_SIZE];
+}
+
+/**
+ * Merges two hidesets
+ *
+ * @param intersect true to intersect, false to union
+ */
+static hideset_t *hideset_merge(hideset_man_t *hm, hideset_t *set1,
+                                hideset_t *set2, bool intersect) {
+    char **names = hideset_buf(hm, set1->key.size + set2->key.size);
+    size_t size = 0;
+
+    size_t i = 0, j = 0;
+    while (i < set1->key.size && j < set2->key.size) {
+        uintptr_t name1 = (uintptr_t)set1->key.names[i];
+        uintptr_t name2 = (uintptr_t)set2->key.names[j];
+        if (name1 == name2) {
+            names[size++] = set1->key.names[i];
+            ++i;
+            ++j;
+        } else if (name1 < name2) {
+            if (!intersect) {
+                names[size++] = set1->key.names[i];
+            }
+            ++i;
+        } else {
+            if (!intersect) {
+                names[size++] = set2->key.names[j];
+            }
+            ++j;
+        }
+    }
+    if (!intersect) {
+        for (; i < set1->key.size; ++i) {
+            names[size++] = set1->key.names[i];
+        }
+        for (; j < set2->key.size; ++j) {
+            names[size++] = set2->key.names[j];
+        }
+    }
+
+    return hideset_intern(hm, names, size);
+}
+
+hideset_t *hideset_add(hideset_man_t *hm, hideset_t *set, char *name) {
+    if (hideset_mem(set, name)) {
+        return set;
+    }
+
+    hideset_op_t *entry = hideset_cache(hm, HIDESET_OP_ADD, set, name);
+    if (entry->op == HIDESET_OP_ADD && entry->lhs == set &&
+        entry->rhs == name) {
+        return entry->result;
+    }
+
+    size_t size = set == HIDESET_EMPTY ? 0 : set->key.size;
+    char **names = hideset_buf(hm, size + 1);
+
+    // Insert name in order
+    size_t i = 0, dest = 0;
+    for (; i < size && (uintptr_t)set->key.names[i] < (uintptr_t)name; ++i) {
+        names[dest++] = set->key.names[i];
+    }
+    names[dest++] = name;
+    for (; i < size; ++i) {
+        names[dest++] = set->key.names[i];
+    }
+
+    hideset_op_t op = { HIDESET_OP_ADD, set, name,
+                        hideset_intern(hm, names, dest) };
+    *entry = op;
+    return op.result;
+}
+
+hideset_t *hideset_union(hideset_man_t *hm, hideset_t *set1, hideset_t *set2) {
+    if (set1 == set2 || set2 == HIDESET_EMPTY) {
+        return set1;
+    }
+    if (set1 == HIDESET_EMPTY) {
+        return set2;
+    }
+
+    hideset_op_t *entry = hideset_cache(hm, HIDESET_OP_UNION, set1, set2);
+    if (entry->op == HIDESET_OP_UNION && entry->lhs == set1 &&
+        entry->rhs == set2) {
+        return entry->result;
+    }
+
+    hideset_op_t op = { HIDESET_OP_UNION, set1, set2,
+                        hideset_merge(hm, set1, set2, false) };
+    *entry = op;
+    return op.result;
+}
+
+hideset_t *hideset_intersect(hideset_man_t *hm, hideset_t *set1,
+                             hideset_t *set2) {
+    if (set1 == set2) {
+        return set1;
+    }
+    if (set1 == HIDESET_EMPTY || set2 == HIDESET_EMPTY) {
+        return HIDESET_EMPTY;
+    }
+
+    hideset_op_t *entry = hideset_cache(hm, HIDESET_OP_INTERSECT, set1, set2);
+    if (entry->op == HIDESET_OP_INTERSECT && entry->lhs == set1 &&
+        entry->rhs == set2) {
+        return entry->result;
+    }
+
+    hideset_op_t op = { HIDESET_OP_INTERSECT, set1, set2,
+                        hideset_merge(hm, set1, set2, true) };
+    *entry = op;
+    return op.result;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Macro expansion hideset interface
+ *
+ * Hidesets are interned and immutable, so equal hidesets are the same pointer
+ * and can be shared between tokens. The names in a hideset must be interned,
+ * they are compared by address.
+ */
+
+#ifndef _HIDESET_H_
+#define _HIDESET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/htable.h"
+
+/** The empty hideset */
+#define HIDESET_EMPTY NULL
+
+/** Number of memoized hideset operations */
+#define HIDESET_CACHE_SIZE 256
+
+/**
+ * Contents of a hideset
+ */
+typedef struct hideset_key_t {
+    uint32_t hash; /**< Hash of names */
+    size_t size;   /**< Number of names */
+    char **names;  /**< Names, sorted by address */
+} hideset_key_t;
+
+/**
+ * An interned hideset
+ */
+typedef struct hideset_t {
+    sl_link_t link;    /**< Table link */
+    hideset_key_t key; /**< Contents of the hideset */
+} hideset_t;
+
+/**
+ * A memoized hideset operation
+ */
+typedef struct hideset_op_t {
+    int op;            /**< Operation performed */
+    hideset_t *lhs;    /**< Left operand */
+    const void *rhs;   /**< Right operand, a hideset or a name */
+    hideset_t *result; /**< Result of the operation */
+} hideset_op_t;
+
+/**
+ * Hideset manager. Owns all of the hidesets created with it.
+ */
+typedef struct hideset_man_t {
+    htable_t sets;   /**< hideset_key_t -> hideset_t */
+    char **buf;      /**< Scratch space for building hidesets */
+    size_t buf_size; /**< Capacity of buf */
+    hideset_op_t cache[HIDESET_CACHE_SIZE]; /**< Memoized operations */
+} hideset_man_t;
+
+/**
+ * Initializes a hideset manager
+ *
+ * @param hm The manager to initialize
+ */
+void hideset_man_init(hideset_man_t *hm);
+
+/**
+ * Destroys a hideset manager, freeing all of its hidesets
+ *
+ * @param hm The manager to destroy
+ */
+void hideset_man_destroy(hideset_man_t *hm);
+
+/**
+ * Returns true if name is a member of set
+ *
+ * @param set The set to search
+ * @param name Interned name to look for
+ */
+bool hideset_mem(const hideset_t *set, const char *name);
+
+/**
+ * Returns the hideset of set with name added
+ *
+ * @param hm The hideset manager
+ * @param set The set to add to
+ * @param name Interned name to add
+ */
+hideset_t *hideset_add(hideset_man_t *hm, hideset_t *set, char *name);
+
+/**
+ * Returns the union of two hidesets
+ *
+ * @param hm The hideset manager
+ * @param set1 First set
+ * @param set2 Second set
+ */
+hideset_t *hideset_union(hideset_man_t *hm, hideset_t *set1, hideset_t *set2);
+
+/**
+ * Returns the intersection of two hidesets
+ *
+ * @param hm The hideset manager
+ * @param set1 First set
+ * @param set2 Second set
+ */
+hideset_t *hideset_intersect(hideset_man_t *hm, hideset_t *set1,
+                             hideset_t *set2);
+
+#endif /* _HIDESET_H_ */
@@ -30,22 +30,22 @@
 #include <errno.h>
 #include <limits.h>
 #include <math.h>
+#include <string.h>
 #include <wchar.h>
 
 #include "util/char_class.h"
+#include "util/char_scan.h"
 #include "util/logger.h"
 #include "util/string_store.h"
 
 #define INIT_LEXBUF_SIZE 128
 
-void lexer_init(lexer_t *lexer, token_man_t *token_man, fmark_man_t *mark_man,
-                symtab_t *symtab) {
+void lexer_init(lexer_t *lexer, token_man_t *token_man, symtab_t *symtab) {
     assert(lexer != NULL);
     assert(symtab != NULL);
 
     lexer->symtab = symtab;
     lexer->token_man = token_man;
-    lexer->mark_man = mark_man;
     sb_init(&lexer->lexbuf, INIT_LEXBUF_SIZE);
 }
 
@@ -55,6 +55,18 @@ void lexer_destroy(lexer_t *lexer) {
 }
 
 status_t lexer_lex_stream(lexer_t *lexer, tstream_t *stream, vec_t *result) {
+    status_t status = CCC_OK;
+
+    while (ts_peek(stream) != EOF) {
+        if (CCC_OK != (status = lexer_lex_line(lexer, stream, result))) {
+            break;
+        }
+    }
+
+    return status;
+}
+
+status_t lexer_lex_line(lexer_t *lexer, tstream_t *stream, vec_t *result) {
     assert(lexer != NULL);
     assert(stream != NULL);
     assert(result != NULL);
@@ -63,29 +75,269 @@ status_t lexer_lex_stream(lexer_t *lexer, tstream_t *stream, vec_t *result) {
     lex_state_t ls = { lexer, result };
 
     token_t *last = NULL;
+    bool has_space = false;
     while (ts_peek(stream) != EOF) {
-        token_t *token = token_create(lexer->token_man);
-        token->start = ts_pos(stream);
+        token_t cur;
+        memset(&cur, 0, sizeof(cur));
+        cur.start = ts_pos(stream);
+        size_t warn_idx = vec_size(result);
 
-        if (CCC_OK != (status = lex_next_token(&ls, stream, token))) {
+        if (CCC_OK != (status = lex_next_token(&ls, stream, &cur))) {
             return status;
         }
-        token->len = ts_pos(stream) - token->start;
+
+        // Whitespace is recorded on the next token
+        if (cur.type == SPACE) {
+            has_space = true;
+            continue;
+        }
+        if (cur.type == NEWLINE) {
+            if (last != NULL) {
+                break;
+            }
+            has_space = false;
+            continue;
+        }
+        cur.hasSpace = has_space;
+        cur.startLine = last == NULL;
+        has_space = false;
+
+        size_t len = ts_pos(stream) - cur.start;
+        if (len > TOKEN_MAX_LEN) {
+            cur.start = NULL;
+        } else {
+            cur.len = len;
+        }
 
         // If we encounter two # in a row, combine them. This is necessary
         // to lex the %:%: digraph with only getc and ungetc operations
-        if (token->type == HASH && last != NULL && last->type == HASH) {
+        if (cur.type == HASH && last != NULL && last->type == HASH &&
+            !cur.hasSpace) {
             last->type = HASHHASH;
             continue;
         }
 
+        token_t *token = token_create(lexer->token_man);
+        *token = cur;
         vec_push_back(result, token);
+
+        // Warnings found while lexing a token follow it on its line
+        for (size_t i = vec_size(result) - 1; i > warn_idx; --i) {
+            vec_set(result, i, vec_get(result, i - 1));
+        }
+        vec_set(result, warn_idx, token);
         last = token;
     }
 
     return status;
 }
 
+int lex_line_comment(tstream_t *stream) {
+    int next;
+    do {
+        // Skip to the next newline or backslash
+        if (stream->last == EOF) {
+            char *lim = ts_splice(stream);
+            char *nl = memchr(stream->cur, '\n', lim - stream->cur);
+            ts_skip(stream, nl == NULL ? lim : nl);
+        }
+    } while ((next = lex_getc_splice(stream)) != '\n' && next != EOF);
+
+    return next;
+}
+
+bool lex_block_comment(tstream_t *stream) {
+    int last = 0;
+    while (true) {
+        // Skip to the next star or backslash
+        if (stream->last == EOF && last != '*') {
+            char *lim = ts_splice(stream);
+            char *star = memchr(stream->cur, '*', lim - stream->cur);
+            if (star == NULL) {
+                star = lim;
+            }
+            if (star != stream->cur) {
+                ts_skip(stream, star);
+                last = 0;
+            }
+        }
+        int next = lex_getc_splice(stream);
+        if (next == EOF) {
+            return false;
+        }
+        if (last == '*' && next == '/') {
+            return true;
+        }
+        last = next;
+    }
+}
+
+void lexer_skip_group(tstream_t *stream) {
+    assert(stream != NULL);
+    int depth = 0;
+
+    while (ts_peek(stream) != EOF) {
+        tstream_t line = *stream;
+        switch (lex_skip_group_line(stream)) {
+        case LEX_GROUP_IF:
+            ++depth;
+            break;
+        case LEX_GROUP_ELSE:
+            if (depth == 0) {
+                *stream = line;
+                return;
+            }
+            break;
+        case LEX_GROUP_ENDIF:
+            if (depth == 0) {
+                *stream = line;
+                return;
+            }
+            --depth;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+lex_group_line_t lex_skip_group_line(tstream_t *stream) {
+    bool hash = false;
+    int cur = lex_getc_splice(stream);
+
+    // Skip blanks before and after the #
+    while (true) {
+        if (scan_is_hspace(cur)) {
+            if (stream->last == EOF) {
+                ts_skip(stream, (char *)scan_hspace(stream->cur,
+                                                    ts_splice(stream)));
+            }
+            cur = lex_getc_splice(stream);
+            continue;
+        }
+
+        int next;
+        switch (cur) {
+        case '/':
+            next = lex_getc_splice(stream);
+            if (next == '*') {
+                if (!lex_block_comment(stream)) {
+                    return LEX_GROUP_NONE;
+                }
+                cur = lex_getc_splice(stream);
+                continue;
+            }
+            if (next == '/') {
+                lex_line_comment(stream);
+                return LEX_GROUP_NONE;
+            }
+            lex_skip_group_text(stream, next);
+            return LEX_GROUP_NONE;
+        case '%':
+            if (hash) {
+                break;
+            }
+            next = lex_getc_splice(stream);
+            if (next != ':') {
+                lex_skip_group_text(stream, next);
+                return LEX_GROUP_NONE;
+            }
+            // FALL THROUGH
+        case '#':
+            if (hash) {
+                break;
+            }
+            hash = true;
+            cur = lex_getc_splice(stream);
+            continue;
+        default:
+            break;
+        }
+        break;
+    }
+
+    if (!hash) {
+        lex_skip_group_text(stream, cur);
+        return LEX_GROUP_NONE;
+    }
+
+    // Read enough of the directive name to classify it
+    char name[LEX_GROUP_NAME_LEN + 1];
+    size_t len = 0;
+    for (; scan_is_id(cur); cur = lex_getc_splice(stream)) {
+        if (len < LEX_GROUP_NAME_LEN) {
+            name[len] = cur;
+        }
+        ++len;
+    }
+    lex_skip_group_text(stream, cur);
+
+    if (len > LEX_GROUP_NAME_LEN) {
+        return LEX_GROUP_NONE;
+    }
+    name[len] = '\0';
+
+    if (strcmp(name, "if") == 0 || strcmp(name, "ifdef") == 0 ||
+        strcmp(name, "ifndef") == 0) {
+        return LEX_GROUP_IF;
+    }
+    if (strcmp(name, "elif") == 0 || strcmp(name, "else") == 0) {
+        return LEX_GROUP_ELSE;
+    }
+    if (strcmp(name, "endif") == 0) {
+        return LEX_GROUP_ENDIF;
+    }
+
+    return LEX_GROUP_NONE;
+}
+
+void lex_skip_group_text(tstream_t *stream, int cur) {
+    while (true) {
+        int next;
+        switch (cur) {
+        case EOF:
+        case '\n':
+            return;
+
+            // Literals end at their closing quote or the end of the line
+        case '"':
+        case '\'':
+            while ((next = lex_getc_splice(stream)) != cur) {
+                if (next == '\n' || next == EOF) {
+                    return;
+                }
+                if (next == '\\') {
+                    lex_getc_splice(stream);
+                }
+            }
+            break;
+
+        case '/':
+            next = lex_getc_splice(stream);
+            if (next == '*') {
+                if (!lex_block_comment(stream)) {
+                    return;
+                }
+                break;
+            }
+            if (next == '/') {
+                lex_line_comment(stream);
+                return;
+            }
+            cur = next;
+            continue;
+        default:
+            break;
+        }
+
+        if (stream->last == EOF) {
+            ts_skip(stream, (char *)scan_group_text(stream->cur,
+                                                    ts_splice(stream)));
+        }
+        cur = lex_getc_splice(stream);
+    }
+}
+
 int lex_if_next_eq(tstream_t *stream, int test, token_type_t noeq,
                    token_type_t iseq) {
     int next = lex_getc_splice(stream);
@@ -118,12 +370,16 @@ status_t lex_next_token(lex_state_t *ls, tstream_t *stream, token_t *result) {
 
     status_t status = CCC_OK;
 
-    result->mark = fmark_man_insert(ls->lexer->mark_man, &stream->mark);
+    result->mark = ts_mark(stream);
     int cur = lex_getc_splice(stream);
 
     // Combine spaces
     if (isspace(cur) && cur != '\n') {
         while (isspace(cur) && cur != '\n') {
+            if (stream->last == EOF) {
+                ts_skip(stream, (char *)scan_hspace(stream->cur,
+                                                    ts_splice(stream)));
+            }
             cur = lex_getc_splice(stream);
         }
 
@@ -160,29 +416,19 @@ status_t lex_next_token(lex_state_t *ls, tstream_t *stream, token_t *result) {
         switch (next) {
             // Single line comment
         case '/':
-            while ((next = lex_getc_splice(stream)) != '\n' &&
-                next != EOF)
-                continue;
-            result->type = SPACE;
+            next = lex_line_comment(stream);
+            result->type = next == '\n' ? NEWLINE : SPACE;
             break;
 
             // Multi line comment
-        case '*': {
-            int last = 0;
-            while ((next = lex_getc_splice(stream)) != EOF) {
-                if (last == '*' && next == '/') {
-                    break;
-                }
-                last = next;
-            }
-            if (next == EOF) {
-                logger_log(&stream->mark, LOG_ERR, "unterminated comment");
+        case '*':
+            if (!lex_block_comment(stream)) {
+                logger_log(ts_mark(stream), LOG_ERR, "unterminated comment");
                 status = CCC_ESYNTAX;
             }
 
             result->type = SPACE;
             break;
-        }
 
         case '=': result->type = DIVEQ; break;
         default:
@@ -390,22 +636,47 @@ status_t lex_id(lex_state_t *ls, tstream_t *stream, int cur, token_t *result) {
     lexer_t *lexer = ls->lexer;
     sb_clear(&lexer->lexbuf);
 
-    bool done = false;
+    // If the identifier is contiguous in the buffer, it is interned straight
+    // from the buffer. Otherwise it has a line splice, so it is copied.
+    len_str_t key = { NULL, 0, 0 };
+    char *start = ts_pos(stream) - 1;
+    if (stream->last == EOF && start >= stream->start && *start == cur) {
+        char *end = (char *)scan_id(stream->cur, ts_splice(stream));
+        ts_skip(stream, end);
+
+        cur = lex_getc_splice(stream);
+        if (scan_is_id(cur)) {
+            sb_append_len(&lexer->lexbuf, start, end - start);
+        } else {
+            key.str = start;
+            key.len = end - start;
+        }
+    }
+
+    bool done = key.str != NULL;
     while (!done) {
         switch (cur) {
         case ID_CHARS:
             sb_append_char(&lexer->lexbuf, cur);
+            if (stream->last == EOF) {
+                char *id_end = (char *)scan_id(stream->cur, ts_splice(stream));
+                sb_append_len(&lexer->lexbuf, stream->cur,
+                              id_end - stream->cur);
+                ts_skip(stream, id_end);
+            }
             cur = lex_getc_splice(stream);
             break;
         default:
-            ts_ungetc(cur, stream);
+            key.str = sb_buf(&lexer->lexbuf);
+            key.len = sb_len(&lexer->lexbuf);
             done = true;
         }
     }
+    ts_ungetc(cur, stream);
 
-    symtab_entry_t *entry =
-        st_lookup(lexer->symtab, sb_buf(&lexer->lexbuf), ID);
-    result->id_name = entry->key;
+    key.hash = strn_hash(key.str, key.len);
+    symtab_entry_t *entry = st_lookup(lexer->symtab, &key, ID);
+    result->id_name = (char *)entry->key.str;
     result->type = entry->type;
 
     return status;
@@ -528,12 +799,11 @@ status_t lex_char_lit(lex_state_t *ls, tstream_t *stream, token_t *result,
     status_t status = CCC_OK;
 
     result->type = INTLIT;
-    result->int_params = emalloc(sizeof(token_int_params_t));
-    result->int_params->hasU = false;
-    result->int_params->hasL = false;
-    result->int_params->hasLL = false;
+    result->hasU = false;
+    result->hasL = false;
+    result->hasLL = false;
 
-    result->int_params->int_val = lex_single_char(ls, stream, result, type);
+    result->int_val = lex_single_char(ls, stream, result, type);
 
     bool first = true;
     int cur = lex_getc_splice(stream);
@@ -546,7 +816,7 @@ status_t lex_char_lit(lex_state_t *ls, tstream_t *stream, token_t *result,
             vec_push_back(ls->ostream, warn);
         }
         ts_ungetc(cur, stream);
-        result->int_params->int_val = lex_single_char(ls, stream, result, type);
+        result->int_val = lex_single_char(ls, stream, result, type);
         cur = lex_getc_splice(stream);
         first = false;
     }
@@ -567,6 +837,21 @@ status_t lex_string(lex_state_t *ls, tstream_t *stream, token_t *result,
     bool done = false;
     bool next_escape = false;
     while (!done) {
+        // Copy up to the next quote or backslash
+        if (stream->last == EOF) {
+            char *lim = ts_splice(stream);
+            char *quote = memchr(stream->cur, '"', lim - stream->cur);
+            if (quote == NULL) {
+                quote = lim;
+            }
+            if (quote != stream->cur) {
+                sb_append_len(&lexer->lexbuf, stream->cur,
+                              quote - stream->cur);
+                ts_skip(stream, quote);
+                next_escape = false;
+            }
+        }
+
         int cur = lex_getc_splice(stream);
         if (cur == EOF) {
             break;
@@ -743,18 +1028,17 @@ status_t lex_number(lex_state_t *ls, tstream_t *stream, int cur,
 
     errno = 0;
     if (is_float) {
+        // Only validate the value, it is parsed again when it is needed
         result->type = FLOATLIT;
-        result->float_params = emalloc(sizeof(token_float_params_t));
-        result->float_params->hasF = has_f;
-        result->float_params->hasL = has_l;
-        result->float_params->float_val = strtold(buf, &end);
+        result->hasF = has_f;
+        result->hasL = has_l;
+        strtold(buf, &end);
     } else {
         result->type = INTLIT;
-        result->int_params = emalloc(sizeof(token_int_params_t));
-        result->int_params->hasU = has_u;
-        result->int_params->hasL = has_l;
-        result->int_params->hasLL = has_ll;
-        result->int_params->int_val = strtoull(buf, &end, 0);
+        result->hasU = has_u;
+        result->hasL = has_l;
+        result->hasLL = has_ll;
+        result->int_val = strtoull(buf, &end, 0);
     }
 
     err = false;
@@ -781,13 +1065,10 @@ status_t lex_number(lex_state_t *ls, tstream_t *stream, int cur,
     }
 
     if (err) {
-        switch (result->type) {
-        case FLOATLIT: free(result->float_params); break;
-        case INTLIT: free(result->int_params); break;
-        default: break;
-        }
         result->type = TOK_WARN;
         result->str_val = err_msg;
+    } else if (result->type == FLOATLIT) {
+        result->float_str = sstore_lookup(buf);
     }
 
     return status;
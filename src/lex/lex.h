@@ -34,7 +34,6 @@
 typedef struct lexer_t {
     symtab_t *symtab;         /**< Symbol table */
     token_man_t *token_man;   /**< Symbol table */
-    fmark_man_t *mark_man;
     string_builder_t lexbuf;
 } lexer_t;
 
@@ -43,8 +42,7 @@ typedef struct lexer_t {
  *
  * @param lexer The lexer to initialize
  */
-void lexer_init(lexer_t *lexer, token_man_t *token_man, fmark_man_t *mark_man,
-                symtab_t *symtab);
+void lexer_init(lexer_t *lexer, token_man_t *token_man, symtab_t *symtab);
 
 /**
  * Destroys a lexer object
@@ -63,4 +61,24 @@ void lexer_destroy(lexer_t *lexer);
  */
 status_t lexer_lex_stream(lexer_t *lexer, tstream_t *stream, vec_t *result);
 
+/**
+ * Lexes the next line of a text stream which has tokens, consuming its newline
+ *
+ * @param lexer The lexer to fetch from
+ * @param stream text stream, positioned at the start of a line
+ * @param result Location to store tokens
+ * @return CCC_OK on success, error code on error
+ */
+status_t lexer_lex_line(lexer_t *lexer, tstream_t *stream, vec_t *result);
+
+/**
+ * Skips an inactive conditional group without lexing it. Only nesting of
+ * conditional directives, comments and literals are tracked.
+ *
+ * @param stream text stream, positioned at the start of a line. On return it
+ *     is positioned at the start of the #elif, #else or #endif line ending the
+ *     group, or at EOF
+ */
+void lexer_skip_group(tstream_t *stream);
+
 #endif /* _LEX_H_ */
@@ -33,6 +33,19 @@ typedef enum lex_str_type_t {
     LEX_STR_U32,
 } lex_str_type_t;
 
+/**
+ * Kinds of line in an inactive conditional group
+ */
+typedef enum lex_group_line_t {
+    LEX_GROUP_NONE,  /**< Text or a directive which doesn't affect nesting */
+    LEX_GROUP_IF,    /**< #if, #ifdef or #ifndef */
+    LEX_GROUP_ELSE,  /**< #elif or #else */
+    LEX_GROUP_ENDIF, /**< #endif */
+} lex_group_line_t;
+
+/** Length of the longest directive name lex_skip_group_line looks for */
+#define LEX_GROUP_NAME_LEN 6
+
 typedef struct lex_state_t {
     lexer_t *lexer;
     vec_t *ostream;
@@ -43,6 +56,39 @@ int lex_if_next_eq(tstream_t *stream, int test, token_type_t noeq,
 
 int lex_getc_splice(tstream_t *stream);
 
+/**
+ * Skips the rest of a // comment, including its newline
+ *
+ * @param stream Stream positioned after the //
+ * @return '\n' or EOF, whichever ended the comment
+ */
+int lex_line_comment(tstream_t *stream);
+
+/**
+ * Skips the rest of a block comment
+ *
+ * @param stream Stream positioned after the opening
+ * @return true if the comment was terminated, false if EOF was reached
+ */
+bool lex_block_comment(tstream_t *stream);
+
+/**
+ * Skips a line of an inactive group, including its newline
+ *
+ * @param stream Stream positioned at the start of a line
+ * @return The kind of line skipped
+ */
+lex_group_line_t lex_skip_group_line(tstream_t *stream);
+
+/**
+ * Skips the rest of a line of an inactive group, stepping over comments and
+ * literals so that they cannot hide a newline or fake one
+ *
+ * @param stream Stream to skip
+ * @param cur Last character fetched from the stream
+ */
+void lex_skip_group_text(tstream_t *stream, int cur);
+
 status_t lex_next_token(lex_state_t *ls, tstream_t *stream, token_t *result);
 
 status_t lex_id(lex_state_t *ls, tstream_t *stream, int cur, token_t *result);
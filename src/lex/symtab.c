@@ -37,107 +37,166 @@
  */
 void st_entry_destroy(symtab_entry_t *entry);
 
+/**
+ * Key literal for a reserved keyword. The hash is unused because reserved
+ * keywords are not stored in the hash table
+ */
+#define ST_KEY_LIT(str) { str, sizeof(str) - 1, 0 }
+
 /**
  * Symbol table entries for reserved keywords
  */
 static symtab_entry_t s_reserved[] = {
     // Keywords
-    { SL_LINK_LIT, "auto"          , AUTO          },
-    { SL_LINK_LIT, "break"         , BREAK         },
-    { SL_LINK_LIT, "case"          , CASE          },
-    { SL_LINK_LIT, "const"         , CONST         },
-    { SL_LINK_LIT, "continue"      , CONTINUE      },
-    { SL_LINK_LIT, "default"       , DEFAULT       },
-    { SL_LINK_LIT, "do"            , DO            },
-    { SL_LINK_LIT, "else"          , ELSE          },
-    { SL_LINK_LIT, "enum"          , ENUM          },
-    { SL_LINK_LIT, "extern"        , EXTERN        },
-    { SL_LINK_LIT, "for"           , FOR           },
-    { SL_LINK_LIT, "goto"          , GOTO          },
-    { SL_LINK_LIT, "if"            , IF            },
-    { SL_LINK_LIT, "inline"        , INLINE        },
-    { SL_LINK_LIT, "register"      , REGISTER      },
-    { SL_LINK_LIT, "restrict"      , RESTRICT      },
-    { SL_LINK_LIT, "return"        , RETURN        },
-    { SL_LINK_LIT, "sizeof"        , SIZEOF        },
-    { SL_LINK_LIT, "static"        , STATIC        },
-    { SL_LINK_LIT, "struct"        , STRUCT        },
-    { SL_LINK_LIT, "switch"        , SWITCH        },
-    { SL_LINK_LIT, "typedef"       , TYPEDEF       },
-    { SL_LINK_LIT, "union"         , UNION         },
-    { SL_LINK_LIT, "volatile"      , VOLATILE      },
-    { SL_LINK_LIT, "while"         , WHILE         },
+    { SL_LINK_LIT, ST_KEY_LIT("auto")          , AUTO          },
+    { SL_LINK_LIT, ST_KEY_LIT("break")         , BREAK         },
+    { SL_LINK_LIT, ST_KEY_LIT("case")          , CASE          },
+    { SL_LINK_LIT, ST_KEY_LIT("const")         , CONST         },
+    { SL_LINK_LIT, ST_KEY_LIT("continue")      , CONTINUE      },
+    { SL_LINK_LIT, ST_KEY_LIT("default")       , DEFAULT       },
+    { SL_LINK_LIT, ST_KEY_LIT("do")            , DO            },
+    { SL_LINK_LIT, ST_KEY_LIT("else")          , ELSE          },
+    { SL_LINK_LIT, ST_KEY_LIT("enum")          , ENUM          },
+    { SL_LINK_LIT, ST_KEY_LIT("extern")        , EXTERN        },
+    { SL_LINK_LIT, ST_KEY_LIT("for")           , FOR           },
+    { SL_LINK_LIT, ST_KEY_LIT("goto")          , GOTO          },
+    { SL_LINK_LIT, ST_KEY_LIT("if")            , IF            },
+    { SL_LINK_LIT, ST_KEY_LIT("inline")        , INLINE        },
+    { SL_LINK_LIT, ST_KEY_LIT("register")      , REGISTER      },
+    { SL_LINK_LIT, ST_KEY_LIT("restrict")      , RESTRICT      },
+    { SL_LINK_LIT, ST_KEY_LIT("return")        , RETURN        },
+    { SL_LINK_LIT, ST_KEY_LIT("sizeof")        , SIZEOF        },
+    { SL_LINK_LIT, ST_KEY_LIT("static")        , STATIC        },
+    { SL_LINK_LIT, ST_KEY_LIT("struct")        , STRUCT        },
+    { SL_LINK_LIT, ST_KEY_LIT("switch")        , SWITCH        },
+    { SL_LINK_LIT, ST_KEY_LIT("typedef")       , TYPEDEF       },
+    { SL_LINK_LIT, ST_KEY_LIT("union")         , UNION         },
+    { SL_LINK_LIT, ST_KEY_LIT("volatile")      , VOLATILE      },
+    { SL_LINK_LIT, ST_KEY_LIT("while")         , WHILE         },
 
     // Underscore keywords
-    { SL_LINK_LIT, "_Alignas"      , ALIGNAS       },
-    { SL_LINK_LIT, "_Alignof"      , ALIGNOF       },
-    { SL_LINK_LIT, "_Bool"         , BOOL          },
-    { SL_LINK_LIT, "_Complex"      , COMPLEX       },
-    { SL_LINK_LIT, "_Generic"      , GENERIC       },
-    { SL_LINK_LIT, "_Imaginary"    , IMAGINARY     },
-    { SL_LINK_LIT, "_Static_assert", STATIC_ASSERT },
-    { SL_LINK_LIT, "_Thread_local" , THREAD_LOCAL  },
+    { SL_LINK_LIT, ST_KEY_LIT("_Alignas")      , ALIGNAS       },
+    { SL_LINK_LIT, ST_KEY_LIT("_Alignof")      , ALIGNOF       },
+    { SL_LINK_LIT, ST_KEY_LIT("_Bool")         , BOOL          },
+    { SL_LINK_LIT, ST_KEY_LIT("_Complex")      , COMPLEX       },
+    { SL_LINK_LIT, ST_KEY_LIT("_Generic")      , GENERIC       },
+    { SL_LINK_LIT, ST_KEY_LIT("_Imaginary")    , IMAGINARY     },
+    { SL_LINK_LIT, ST_KEY_LIT("_Static_assert"), STATIC_ASSERT },
+    { SL_LINK_LIT, ST_KEY_LIT("_Thread_local") , THREAD_LOCAL  },
 
     // __builtin
-    { SL_LINK_LIT, "__builtin_offsetof", OFFSETOF  },
-    { SL_LINK_LIT, "__builtin_va_list" , VA_LIST   },
-    { SL_LINK_LIT, "__builtin_va_start", VA_START  },
-    { SL_LINK_LIT, "__builtin_va_arg"  , VA_ARG    },
-    { SL_LINK_LIT, "__builtin_va_end"  , VA_END    },
-    { SL_LINK_LIT, "__builtin_va_copy" , VA_COPY   },
+    { SL_LINK_LIT, ST_KEY_LIT("__builtin_offsetof"), OFFSETOF  },
+    { SL_LINK_LIT, ST_KEY_LIT("__builtin_va_list") , VA_LIST   },
+    { SL_LINK_LIT, ST_KEY_LIT("__builtin_va_start"), VA_START  },
+    { SL_LINK_LIT, ST_KEY_LIT("__builtin_va_arg")  , VA_ARG    },
+    { SL_LINK_LIT, ST_KEY_LIT("__builtin_va_end")  , VA_END    },
+    { SL_LINK_LIT, ST_KEY_LIT("__builtin_va_copy") , VA_COPY   },
 
     // Types
-    { SL_LINK_LIT, "void"          , VOID          },
+    { SL_LINK_LIT, ST_KEY_LIT("void")          , VOID          },
 
-    { SL_LINK_LIT, "char"          , CHAR          },
-    { SL_LINK_LIT, "short"         , SHORT         },
-    { SL_LINK_LIT, "int"           , INT           },
-    { SL_LINK_LIT, "long"          , LONG          },
+    { SL_LINK_LIT, ST_KEY_LIT("char")          , CHAR          },
+    { SL_LINK_LIT, ST_KEY_LIT("short")         , SHORT         },
+    { SL_LINK_LIT, ST_KEY_LIT("int")           , INT           },
+    { SL_LINK_LIT, ST_KEY_LIT("long")          , LONG          },
 
-    { SL_LINK_LIT, "unsigned"      , UNSIGNED      },
-    { SL_LINK_LIT, "signed"        , SIGNED        },
+    { SL_LINK_LIT, ST_KEY_LIT("unsigned")      , UNSIGNED      },
+    { SL_LINK_LIT, ST_KEY_LIT("signed")        , SIGNED        },
 
-    { SL_LINK_LIT, "double"        , DOUBLE        },
-    { SL_LINK_LIT, "float"         , FLOAT         },
+    { SL_LINK_LIT, ST_KEY_LIT("double")        , DOUBLE        },
+    { SL_LINK_LIT, ST_KEY_LIT("float")         , FLOAT         },
 
-    { SL_LINK_LIT, "__func__"      , FUNC          },
+    { SL_LINK_LIT, ST_KEY_LIT("__func__")      , FUNC          },
 };
 
+/** Number of slots in the reserved keyword hash. Must be a power of 2 */
+#define ST_RESERVED_SLOTS 128
+
+/** Length of the longest reserved keyword */
+#define ST_RESERVED_MAX_LEN 18
+
+/**
+ * Perfect hash of the reserved keywords, on their length and first and last
+ * characters. Must be collision free over s_reserved.
+ */
+#define ST_RESERVED_HASH(str, len)                                  \
+    (((len) + 10 * (unsigned char)(str)[0] +                        \
+      3 * (unsigned char)(str)[(len) - 1]) & (ST_RESERVED_SLOTS - 1))
+
+/**
+ * Reserved keyword hash slots. Index into s_reserved plus one, 0 if empty
+ */
+static uint8_t s_reserved_slots[ST_RESERVED_SLOTS];
+
 /**
- * Paramaters for newly constructed symbol tables
+ * Fills in s_reserved_slots if it has not been already
+ */
+static void st_reserved_init(void);
+
+/**
+ * Looks up a reserved keyword
+ *
+ * @param key The string to look up
+ * @return The reserved keyword's entry, or NULL if key is not reserved
  */
+static symtab_entry_t *st_reserved_lookup(const len_str_t *key);
+
+static void st_reserved_init(void) {
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+
+    for (size_t i = 0; i < STATIC_ARRAY_LEN(s_reserved); ++i) {
+        len_str_t *key = &s_reserved[i].key;
+        assert(key->len <= ST_RESERVED_MAX_LEN);
+
+        size_t slot = ST_RESERVED_HASH(key->str, key->len);
+        assert(s_reserved_slots[slot] == 0);
+        s_reserved_slots[slot] = i + 1;
+    }
+}
+
+static symtab_entry_t *st_reserved_lookup(const len_str_t *key) {
+    if (key->len < 2 || key->len > ST_RESERVED_MAX_LEN) {
+        return NULL;
+    }
+
+    size_t slot = s_reserved_slots[ST_RESERVED_HASH(key->str, key->len)];
+    if (slot == 0) {
+        return NULL;
+    }
+
+    symtab_entry_t *entry = &s_reserved[slot - 1];
+    if (entry->key.len != key->len ||
+        memcmp(entry->key.str, key->str, key->len) != 0) {
+        return NULL;
+    }
+
+    return entry;
+}
+
 void st_init(symtab_t *table, bool reserved) {
     assert(table != NULL);
 
-    size_t size = reserved ? STATIC_ARRAY_LEN(s_reserved) * 2: 0;
-
-    ht_params_t params = {
-        size,                           // Size estimate
+    static const ht_params_t params = {
+        0,                              // Size estimate
         offsetof(symtab_entry_t, key),  // Offset of key
         offsetof(symtab_entry_t, link), // Offset of ht link
-        ind_str_hash,                   // Hash function
-        ind_str_eq,                     // void string compare
+        len_str_hash,                   // Hash function
+        len_str_eq,                     // void string compare
     };
 
     ht_init(&table->hashtab, &params);
 
-    // Initalize symbol table with reserved keywords
+    table->reserved = reserved;
     if (reserved) {
-        for (size_t i = 0; i < STATIC_ARRAY_LEN(s_reserved); ++i) {
-            status_t status = ht_insert(&table->hashtab, &s_reserved[i].link);
-            assert(status == CCC_OK);
-        }
+        st_reserved_init();
     }
-
 }
 
 void st_entry_destroy(symtab_entry_t *entry) {
-    // Ignore static entries
-    if (entry >= s_reserved && entry <
-        s_reserved + STATIC_ARRAY_LEN(s_reserved)) {
-        return;
-    }
-
     free(entry);
 }
 
@@ -145,18 +204,25 @@ void st_destroy(symtab_t *table) {
     HT_DESTROY_FUNC(&table->hashtab, st_entry_destroy);
 }
 
-symtab_entry_t *st_lookup(symtab_t *table, char *str, token_type_t type) {
+symtab_entry_t *st_lookup(symtab_t *table, const len_str_t *key,
+                          token_type_t type) {
     status_t status = CCC_OK;
 
-    symtab_entry_t *cur_entry = ht_lookup(&table->hashtab, &str);
+    symtab_entry_t *cur_entry;
+    if (table->reserved && NULL != (cur_entry = st_reserved_lookup(key))) {
+        return cur_entry;
+    }
+
+    cur_entry = ht_lookup(&table->hashtab, key);
     if (cur_entry != NULL) {
         return cur_entry;
     }
 
-    // Doesn't exist. Need to allocate memory for the string and entry
-    // We allocate them together so they are freed together
+    // Doesn't exist. The string is owned by the string store
     cur_entry = emalloc(sizeof(*cur_entry));
-    cur_entry->key = sstore_lookup(str);
+    cur_entry->key.str = sstore_lookup_len(key);
+    cur_entry->key.len = key->len;
+    cur_entry->key.hash = key->hash;
 
     cur_entry->type = type;
 
@@ -32,15 +32,16 @@
  */
 typedef struct symtab_t {
     htable_t hashtab; /**< Hash table backing store */
+    bool reserved;    /**< Whether reserved keywords are recognized */
 } symtab_t;
 
 /**
  * Type and value of a string token
  */
 typedef struct symtab_entry_t {
-    sl_link_t link; /**< Hashtable link */
-    char *key;      /**< Hashtable key value */
-    token_type_t type;   /**< Denotes the type of the symbol table entry */
+    sl_link_t link;    /**< Hashtable link */
+    len_str_t key;     /**< Hashtable key value. key.str is null terminated */
+    token_type_t type; /**< Denotes the type of the symbol table entry */
 } symtab_entry_t;
 
 /**
@@ -63,12 +64,16 @@ void st_destroy(symtab_t *table);
  * Looks up a string in the symbol table, if it exists returns the existing
  * entry. Otherwise, it adds its own entry is added.
  *
+ * Reserved keywords are recognized with a perfect hash before the table is
+ * searched.
+ *
  * @param table The table to lookup
- * @param str The string to lookup and or add
+ * @param key The string to lookup and or add. Does not need to be null
+ *     terminated, but its hash must be set
  * @param type The type of entry to add if it doesn't already exist
- * @param Pointer to an entry pointer if success, otherwise unchanged
- * @return CCC_OK on success, error code on failure
+ * @return The entry for the string
  */
-symtab_entry_t *st_lookup(symtab_t *table, char *str, token_type_t type);
+symtab_entry_t *st_lookup(symtab_t *table, const len_str_t *key,
+                          token_type_t type);
 
 #endif /* _SYMTAB_H_ */
@@ -27,78 +27,66 @@
 
 #include "lex/symtab.h"
 
+#include "util/file_directory.h"
 #include "util/string_builder.h"
 #include "util/logger.h"
 
-#define INT_PARAM_LIT(val) { false, false, false, val }
+#define INT_TOK_LIT(val) \
+    { INTLIT, false, false, false, false, false, false, 0, FMARK_BUILT_IN, \
+            NULL, HIDESET_EMPTY, { .int_val = val } }
 
-#define INT_TOK_LIT(param) \
-    { INTLIT, 0, NULL, &fmark_built_in, STR_SET_LIT, { .int_params = &param } }
+token_t token_int_zero = INT_TOK_LIT(0);
+token_t token_int_one = INT_TOK_LIT(1);
 
-static token_int_params_t zero_params = INT_PARAM_LIT(0);
-token_t token_int_zero = INT_TOK_LIT(zero_params);
+token_t token_eof = {
+    TOKEN_EOF, false, false, false, false, false, false, 0, FMARK_BUILT_IN,
+    NULL, HIDESET_EMPTY, { }
+};
 
-static token_int_params_t one_params = INT_PARAM_LIT(1);
-token_t token_int_one = INT_TOK_LIT(one_params);
+/** Number of tokens in a slab */
+#define TOKEN_SLAB_SIZE 1024
 
-token_t token_eof = { TOKEN_EOF, 0, NULL, &fmark_built_in, STR_SET_LIT, {} };
-
-
-typedef struct token_node_t {
+typedef struct token_slab_t {
     sl_link_t link;
-    token_t token;
-} token_node_t;
+    token_t tokens[TOKEN_SLAB_SIZE];
+} token_slab_t;
 
 void token_man_init(token_man_t *tm) {
-    sl_init(&tm->tokens, offsetof(token_node_t, link));
-}
-
-void token_node_destroy(token_node_t *token_node) {
-    str_set_destroy(token_node->token.hideset);
-    switch (token_node->token.type) {
-    case INTLIT: free(token_node->token.int_params); break;
-    case FLOATLIT: free(token_node->token.float_params); break;
-    default:
-        break;
-    }
-    free(token_node);
+    sl_init(&tm->slabs, offsetof(token_slab_t, link));
+    tm->offset = TOKEN_SLAB_SIZE;
+    hideset_man_init(&tm->hidesets);
 }
 
 void token_man_destroy(token_man_t *tm) {
-    SL_DESTROY_FUNC(&tm->tokens, token_node_destroy);
+    SL_DESTROY_FUNC(&tm->slabs, free);
+    tm->offset = TOKEN_SLAB_SIZE;
+    hideset_man_destroy(&tm->hidesets);
 }
 
 token_t *token_create(token_man_t *tm) {
-    token_node_t *result = emalloc(sizeof(token_node_t));
-    sl_append(&tm->tokens, &result->link);
+    if (tm->offset == TOKEN_SLAB_SIZE) {
+        token_slab_t *slab = ecalloc(1, sizeof(token_slab_t));
+        sl_append(&tm->slabs, &slab->link);
+        tm->offset = 0;
+    }
+
+    token_slab_t *tail = sl_tail(&tm->slabs);
+    token_t *result = &tail->tokens[tm->offset++];
 
-    // Set to safe values for printing and destruction
-    result->token.type = TOKEN_EOF;
-    result->token.start = NULL;
-    result->token.len = 0;
-    result->token.hideset = str_set_empty();
+    // Set to safe values for printing and destruction. The rest of the token
+    // is zeroed
+    result->type = TOKEN_EOF;
+    result->start = NULL;
+    result->len = 0;
+    result->hideset = HIDESET_EMPTY;
 
-    return &result->token;
+    return result;
 }
 
 token_t *token_copy(token_man_t *tm, token_t *token) {
     token_t *result = token_create(tm);
+    // Hidesets are immutable, so they are shared with the copy
     memcpy(result, token, sizeof(token_t));
-    switch (token->type) {
-    case INTLIT:
-        result->int_params = emalloc(sizeof(token_int_params_t));
-        memcpy(result->int_params, token->int_params,
-               sizeof(token_int_params_t));
-        break;
-    case FLOATLIT:
-        result->float_params = emalloc(sizeof(token_float_params_t));
-        memcpy(result->float_params, token->float_params,
-               sizeof(token_float_params_t));
-        break;
-    default:
-        break;
-    }
-    result->hideset = str_set_copy(token->hideset);
 
     return result;
 }
@@ -116,20 +104,22 @@ bool token_equal(const token_t *t1, const token_t *t2) {
     case ID: return strcmp(t1->id_name, t2->id_name) == 0;
     case STRING: return strcmp(t1->str_val, t2->str_val) == 0;
     case INTLIT:
-        return t1->int_params->int_val == t2->int_params->int_val &&
-            t1->int_params->hasU == t2->int_params->hasU &&
-            t1->int_params->hasL == t2->int_params->hasL &&
-            t1->int_params->hasLL == t2->int_params->hasLL;
+        return t1->int_val == t2->int_val && t1->hasU == t2->hasU &&
+            t1->hasL == t2->hasL && t1->hasLL == t2->hasLL;
     case FLOATLIT:
-        return t1->float_params->float_val == t2->float_params->float_val &&
-            t1->float_params->hasF == t2->float_params->hasF &&
-            t1->float_params->hasL == t2->float_params->hasL;
+        return token_float_val(t1) == token_float_val(t2) &&
+            t1->hasF == t2->hasF && t1->hasL == t2->hasL;
     default:
         break;
     }
     return true;
 }
 
+long double token_float_val(const token_t *token) {
+    assert(token->type == FLOATLIT);
+    return strtold(token->float_str, NULL);
+}
+
 
 void token_print_helper(token_t *token, string_builder_t *sb, FILE *file) {
     assert(token != NULL);
@@ -153,13 +143,13 @@ void token_print_helper(token_t *token, string_builder_t *sb, FILE *file) {
             directed_print(sb, file, "%.*s", (int)token->len, token->start);
             break;
         }
-        directed_print(sb, file, "%lld", token->int_params->int_val);
-        if (token->int_params->hasU) {
+        directed_print(sb, file, "%lld", token->int_val);
+        if (token->hasU) {
             directed_print(sb, file, "U");
         }
-        if (token->int_params->hasL) {
+        if (token->hasL) {
             directed_print(sb, file, "L");
-        } else if (token->int_params->hasLL) {
+        } else if (token->hasLL) {
             directed_print(sb, file, "LL");
         }
         break;
@@ -168,14 +158,23 @@ void token_print_helper(token_t *token, string_builder_t *sb, FILE *file) {
             directed_print(sb, file, "%.*s", (int)token->len, token->start);
             break;
         }
-        directed_print(sb, file, "%Lf", token->float_params->float_val);
-        if (token->float_params->hasL) {
+        directed_print(sb, file, "%Lf", token_float_val(token));
+        if (token->hasL) {
             directed_print(sb, file, "L");
         }
-        if (token->float_params->hasF) {
+        if (token->hasF) {
             directed_print(sb, file, "F");
         }
         break;
+    case EMBED: {
+        // Embedded bytes are spelled as a list of integer constants
+        unsigned char *start = (unsigned char *)token->embed->buf;
+        unsigned char *end = (unsigned char *)token->embed->end;
+        for (unsigned char *cur = start; cur < end; ++cur) {
+            directed_print(sb, file, cur == start ? "%u" : ",%u", *cur);
+        }
+        break;
+    }
     default:
         directed_print(sb, file, "%s", token_type_str(token->type));
     }
@@ -320,6 +319,7 @@ const char *token_type_str(token_type_t token) {
     case STRING:        return "<string literal>";
     case INTLIT:        return "<integer literal>";
     case FLOATLIT:      return "<float literal>";
+    case EMBED:         return "<#embed data>";
 
     case VA_LIST:       return "__builtin_va_list";
     case VA_START:      return "__builtin_va_start";
@@ -23,12 +23,17 @@
 #ifndef _TOKEN_H_
 #define _TOKEN_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "lex/hideset.h"
 #include "util/file_mark.h"
-#include "util/string_set.h"
+#include "util/slist.h"
 #include "util/string_builder.h"
 
+struct fdir_entry_t;
+
 typedef enum token_type_t {
     TOK_WARN,
     TOK_ERR,
@@ -36,8 +41,8 @@ typedef enum token_type_t {
     HASH,          // #
     HASHHASH,      // ##
 
-    SPACE,         // ' '
-    NEWLINE,       // '\n'
+    SPACE,         // ' ' Only used inside the lexer
+    NEWLINE,       // '\n' Only used inside the lexer
     BACKSLASH,     // '\\'
 
     // Delimiters
@@ -162,43 +167,53 @@ typedef enum token_type_t {
     STRING,        // string
     INTLIT,        // Integral literal
     FLOATLIT,      // Float literal
+    EMBED,         // Contents of a file from #embed
 
     FUNC,          // __func__
 } token_type_t;
 
-typedef struct token_int_params_t {
-    bool hasU;             /**< Has U suffix */
-    bool hasL;             /**< Has L suffix */
-    bool hasLL;            /**< Has LL suffix */
-    long long int_val;     /**< For integral types */
-} token_int_params_t;
-
-typedef struct token_float_params_t {
-    bool hasF;             /**< Has F suffix */
-    bool hasL;             /**< Has L suffix */
-    long double float_val; /**< For floating point types */
-} token_float_params_t;
+/**
+ * Maximum length of a token's spelling. Longer tokens have no spelling
+ */
+#define TOKEN_MAX_LEN UINT16_MAX
 
 /**
  * Token structure
+ *
+ * Literal values are stored in the token, so a token is never more than 32
+ * bytes. Whitespace and comments are not tokens, they are recorded in the
+ * hasSpace and startLine flags of the token that follows them.
  */
 typedef struct token_t {
-    token_type_t type;             /**< Type of token */
-    unsigned len;
-    char *start;
-    fmark_t *mark;                 /**< Location of token */
-    str_set_t *hideset;
+    token_type_t type : 8; /**< Type of token */
+    bool hasU : 1;         /**< INTLIT: Has U suffix */
+    bool hasL : 1;         /**< INTLIT, FLOATLIT: Has L suffix */
+    bool hasLL : 1;        /**< INTLIT: Has LL suffix */
+    bool hasF : 1;         /**< FLOATLIT: Has F suffix */
+    bool hasSpace : 1;     /**< Preceded by whitespace on its line */
+    bool startLine : 1;    /**< First token on its line */
+    uint16_t len;          /**< Length of spelling */
+    fmark_t mark;          /**< Location of token */
+    char *start;           /**< Spelling in source. NULL if none */
+    hideset_t *hideset;    /**< Macros this token was expanded from */
 
     union {
         char *id_name;
         char *str_val;
-        token_int_params_t *int_params;
-        token_float_params_t *float_params;
+        char *float_str;   /**< FLOATLIT: Spelling without line splices */
+        long long int_val; /**< INTLIT: Value */
+        struct fdir_entry_t *embed; /**< EMBED: File whose bytes are used */
     };
 } token_t;
 
+/**
+ * Token manager. Tokens are allocated from slabs, and are only freed when the
+ * manager is destroyed.
+ */
 typedef struct token_man_t {
-    slist_t tokens;
+    slist_t slabs;          /**< Slabs of tokens */
+    size_t offset;          /**< Index of next free token in the last slab */
+    hideset_man_t hidesets; /**< Hidesets of the tokens */
 } token_man_t;
 
 extern token_t token_int_zero;
@@ -213,6 +228,14 @@ token_t *token_copy(token_man_t *tm, token_t *token);
 
 bool token_equal(const token_t *t1, const token_t *t2);
 
+/**
+ * Returns the value of a floating point literal
+ *
+ * @param token The FLOATLIT token
+ * @return The value of token
+ */
+long double token_float_val(const token_t *token);
+
 /**
  * Prints a token
  *
@@ -36,10 +36,12 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "lex/symtab.h"
 #include "top/optman.h"
 #include "typecheck/typecheck.h"
+#include "util/file_directory.h"
 #include "util/htable.h"
 #include "util/logger.h"
 
@@ -52,6 +54,7 @@ status_t parser_parse(vec_t *tokens, trans_unit_t **result) {
     vec_push_back(tokens, &token_eof);
 
     lex_wrap_t lex;
+    lex.scope_limit = SIZE_MAX;
     vec_iter_init(&lex.tokens, tokens);
 
     return par_translation_unit(&lex, result);
@@ -69,6 +72,8 @@ status_t parser_parse_expr(vec_t *tokens, trans_unit_t *tunit,
     lex_wrap_t lex;
     lex.typetab = &tunit->typetab;
     lex.tunit = tunit;
+    lex.bindings = NULL;
+    lex.scope_limit = SIZE_MAX;
     vec_iter_init(&lex.tokens, tokens);
 
     return par_expression(&lex, result);
@@ -114,6 +119,8 @@ status_t par_translation_unit(lex_wrap_t *lex, trans_unit_t **result) {
     trans_unit_t *tunit = ast_trans_unit_create(false);
     lex->typetab = &tunit->typetab; // Set top type table to translation units
     lex->tunit = tunit;
+    lex->bindings = tunit->bindings;
+    tt_bind_prims(lex->bindings);
 
     while (LEX_CUR(lex)->type != TOKEN_EOF) {
         gdecl_t *gdecl;
@@ -257,6 +264,10 @@ status_t par_function_definition(lex_wrap_t *lex, gdecl_t *gdecl) {
         }
     }
 
+    if (par_defer_body(lex, gdecl)) {
+        goto fail;
+    }
+
     // Set the current function we're in
     log_function = node->id;
     lex->function = node->id;
@@ -271,6 +282,92 @@ fail:
     return status;
 }
 
+bool par_defer_body(lex_wrap_t *lex, gdecl_t *gdecl) {
+    if (LEX_CUR(lex)->type != LBRACE) {
+        return false;
+    }
+
+    // Only bodies of functions with internal linkage may go unused. Other
+    // bodies are deferred to be parsed in parallel
+    type_t *type = gdecl->decl->type;
+    bool on_use = (optman.misc & MISC_LAZY_PARSE) && type->type == TYPE_MOD &&
+        (type->mod.type_mod & TMOD_STATIC);
+    if (!on_use && optman.parse_jobs <= 1) {
+        return false;
+    }
+
+    // Find the matching brace. Unbalanced bodies are parsed right away so
+    // errors are reported in order
+    vec_iter_t body = lex->tokens;
+    size_t depth = 0;
+    vec_iter_t iter = lex->tokens;
+    do {
+        switch (((token_t *)vec_iter_get(&iter))->type) {
+        case LBRACE: ++depth; break;
+        case RBRACE: --depth; break;
+        case TOKEN_EOF: return false;
+        default: break;
+        }
+        vec_iter_advance(&iter);
+    } while (depth > 0);
+
+    decl_node_t *node = sl_head(&gdecl->decl->decls);
+    gdecl->fdefn.lazy.name = node->id;
+    gdecl->fdefn.lazy.body = body;
+    gdecl->fdefn.lazy.typetab = lex->typetab;
+    gdecl->fdefn.lazy.scope_limit = tt_file_seq(lex->typetab);
+    gdecl->fdefn.lazy.on_use = on_use;
+    gdecl->fdefn.lazy.referenced = false;
+
+    // Redefinitions are parsed so the typechecker can report them
+    if (on_use && CCC_OK != ht_insert(&lex->tunit->lazy_fdefns,
+                                      &gdecl->fdefn.lazy.link)) {
+        return false;
+    }
+
+    lex->tokens = iter;
+    return true;
+}
+
+typetab_entry_t *par_typedef_lookup(lex_wrap_t *lex, char *name) {
+    if (lex->bindings != NULL) {
+        return tt_binding(lex->bindings, name);
+    }
+
+    // Variables are only in the type tables when a body is parsed after
+    // typechecking, and they hide typedefs with the same name. A deferred body
+    // must not see typedefs declared after it
+    typetab_entry_t *entry =
+        tt_lookup_before(lex->typetab, name, lex->scope_limit);
+    if (entry != NULL && entry->entry_type != TT_TYPEDEF &&
+        entry->entry_type != TT_PRIM) {
+        return NULL;
+    }
+    return entry;
+}
+
+status_t parser_parse_lazy(trans_unit_t *tunit, gdecl_t *gdecl) {
+    assert(gdecl->type == GDECL_FDEFN && gdecl->fdefn.stmt == NULL);
+
+    lex_wrap_t lex;
+    lex.tunit = tunit;
+    lex.typetab = gdecl->fdefn.lazy.typetab;
+    lex.tokens = gdecl->fdefn.lazy.body;
+    lex.scope_limit = gdecl->fdefn.lazy.scope_limit;
+
+    // The bindings are those of the end of the unit, so the body's names are
+    // looked up in its scopes
+    lex.bindings = NULL;
+    lex.function = gdecl->fdefn.lazy.name;
+
+    char *log_save = log_function;
+    log_function = lex.function;
+    status_t status = par_compound_statement(&lex, &gdecl->fdefn.stmt);
+    log_function = log_save;
+
+    return status;
+}
+
 status_t par_declaration_specifiers(lex_wrap_t *lex, type_t **type) {
     status_t status = CCC_OK;;
     *type = NULL; // Set to NULL so sub functions will allocate
@@ -288,7 +385,7 @@ status_t par_declaration_specifiers(lex_wrap_t *lex, type_t **type) {
         case ID: {
             // Type specifier only if its a typedef name
             typetab_entry_t *entry =
-                tt_lookup(lex->typetab, LEX_CUR(lex)->id_name);
+                par_typedef_lookup(lex, LEX_CUR(lex)->id_name);
             if (entry == NULL) {
                 return CCC_BACKTRACK;
             }
@@ -515,7 +612,7 @@ status_t par_type_specifier(lex_wrap_t *lex, type_t **type) {
     case ID: { // typedef name
         // Type specifier only if its a typedef name
         typetab_entry_t *entry =
-            tt_lookup(lex->typetab, LEX_CUR(lex)->id_name);
+            par_typedef_lookup(lex, LEX_CUR(lex)->id_name);
         assert(entry != NULL); // Must be checked before calling
         new_node = ast_type_create(lex->tunit, LEX_CUR(lex)->mark,
                                    TYPE_TYPEDEF);
@@ -624,7 +721,8 @@ status_t par_struct_or_union_or_enum_specifier(lex_wrap_t *lex, type_t **type) {
     type_t *entry_type;
     if (LEX_CUR(lex)->type == ID) {
         name = LEX_CUR(lex)->id_name;
-        entry = tt_lookup_compound(lex->typetab, name);
+        entry = tt_lookup_compound_before(lex->typetab, name,
+                                          lex->scope_limit);
 
         LEX_ADVANCE(lex);
 
@@ -759,7 +857,7 @@ status_t par_specifier_qualifiers(lex_wrap_t *lex, bool compound,
             // Type specifiers:
         case ID:
             // Type specifier only if its a typedef name
-            if (tt_lookup(lex->typetab, LEX_CUR(lex)->id_name) == NULL) {
+            if (par_typedef_lookup(lex, LEX_CUR(lex)->id_name) == NULL) {
                 goto done;
             }
 
@@ -891,13 +989,18 @@ status_t par_declarator_base(lex_wrap_t *lex, decl_t *decl) {
             typedef_base->mod.type_mod =
                 decl_node->type->mod.type_mod & ~TMOD_TYPEDEF;
         }
-        if (CCC_OK !=
+        typetab_entry_t *entry;
+        if (CCC_OK ==
             (status = tt_insert(lex->typetab, typedef_base, TT_TYPEDEF,
-                                decl_node->id, NULL))) {
+                                decl_node->id, &entry))) {
+            if (lex->bindings != NULL) {
+                tt_bind(lex->bindings, entry);
+            }
+        } else {
             if (status != CCC_DUPLICATE) {
                 goto fail;
             } else {
-                typetab_entry_t *entry = tt_lookup(lex->typetab, decl_node->id);
+                entry = tt_lookup(lex->typetab, decl_node->id);
                 if (typecheck_type_equal(entry->type, decl_node->type)) {
                     status = CCC_OK;
                 } else {
@@ -1065,7 +1168,7 @@ status_t par_direct_declarator(lex_wrap_t *lex, decl_node_t *node,
             last_node = &func_type->func.type;
 
             if (LEX_CUR(lex)->type == ID &&
-                NULL == tt_lookup(lex->typetab, LEX_CUR(lex)->id_name)) {
+                NULL == par_typedef_lookup(lex, LEX_CUR(lex)->id_name)) {
                 // Handle old style function declaration
                 bool first = true;
 
@@ -1077,8 +1180,8 @@ status_t par_direct_declarator(lex_wrap_t *lex, decl_node_t *node,
                     }
 
                     LEX_CHECK(lex, ID);
-                    if (tt_lookup(lex->typetab,
-                                  LEX_CUR(lex)->id_name) != NULL) {
+                    if (par_typedef_lookup(lex,
+                                           LEX_CUR(lex)->id_name) != NULL) {
                         logger_log(LEX_CUR(lex)->mark, LOG_ERR,
                                    "expected ')' before '%s'",
                                    LEX_CUR(lex)->id_name);
@@ -1711,9 +1814,17 @@ status_t par_primary_expression(lex_wrap_t *lex, expr_t **result) {
         LEX_ADVANCE(lex);
         break;
     }
+    case EMBED: {
+        fdir_entry_t *entry = LEX_CUR(lex)->embed;
+        base = ast_expr_create(lex->tunit, LEX_CUR(lex)->mark, EXPR_EMBED);
+        base->embed.data = entry->buf;
+        base->embed.len = entry->end - entry->buf;
+        LEX_ADVANCE(lex);
+        break;
+    }
     case INTLIT: {
         base = ast_expr_create(lex->tunit, LEX_CUR(lex)->mark, EXPR_CONST_INT);
-        unsigned long long intval = LEX_CUR(lex)->int_params->int_val;
+        unsigned long long intval = LEX_CUR(lex)->int_val;
         base->const_val.int_val = intval;
 
         type_t *type;
@@ -1734,9 +1845,9 @@ status_t par_primary_expression(lex_wrap_t *lex, expr_t **result) {
         }
 
         type_t *explicit;
-        if (LEX_CUR(lex)->int_params->hasLL) {
+        if (LEX_CUR(lex)->hasLL) {
             explicit = tt_long_long;
-        } else if (LEX_CUR(lex)->int_params->hasL) {
+        } else if (LEX_CUR(lex)->hasL) {
             explicit = tt_long;
         } else {
             explicit = tt_int;
@@ -1748,7 +1859,7 @@ status_t par_primary_expression(lex_wrap_t *lex, expr_t **result) {
             type = tt_long_long;
             need_u = true;
 
-            if (!LEX_CUR(lex)->int_params->hasU && explicit_size < ll_size) {
+            if (!LEX_CUR(lex)->hasU && explicit_size < ll_size) {
                 logger_log(LEX_CUR(lex)->mark, LOG_WARN,
                            "integer constant is so large that it is unsigned");
             }
@@ -1760,7 +1871,7 @@ status_t par_primary_expression(lex_wrap_t *lex, expr_t **result) {
             type = explicit;
         }
 
-        if (LEX_CUR(lex)->int_params->hasU) {
+        if (LEX_CUR(lex)->hasU) {
             need_u = true;
         }
 
@@ -1778,10 +1889,10 @@ status_t par_primary_expression(lex_wrap_t *lex, expr_t **result) {
     case FLOATLIT: {
         base = ast_expr_create(lex->tunit, LEX_CUR(lex)->mark,
                                EXPR_CONST_FLOAT);
-        base->const_val.float_val = LEX_CUR(lex)->float_params->float_val;
-        if (LEX_CUR(lex)->float_params->hasF) {
+        base->const_val.float_val = token_float_val(LEX_CUR(lex));
+        if (LEX_CUR(lex)->hasF) {
             base->const_val.type = tt_float;
-        } else if (LEX_CUR(lex)->float_params->hasL) {
+        } else if (LEX_CUR(lex)->hasL) {
             base->const_val.type = tt_long_double;
         } else {
             base->const_val.type = tt_double;
@@ -1891,7 +2002,7 @@ status_t par_type_name(lex_wrap_t *lex, bool match_parens, decl_t **result) {
     if (match_parens) {
         switch (LEX_NEXT(lex)->type) {
         case ID: {
-            if (tt_lookup(lex->typetab, LEX_NEXT(lex)->id_name)
+            if (par_typedef_lookup(lex, LEX_NEXT(lex)->id_name)
                 == NULL) {
                 return CCC_BACKTRACK;
             }
@@ -2370,7 +2481,7 @@ status_t par_iteration_statement(lex_wrap_t *lex, stmt_t **result) {
             bool expr = false;
             switch (LEX_CUR(lex)->type) {
             case ID:
-                if (tt_lookup(lex->typetab, LEX_CUR(lex)->id_name) ==
+                if (par_typedef_lookup(lex, LEX_CUR(lex)->id_name) ==
                     NULL) {
                     expr = true;
                     break;
@@ -2496,6 +2607,7 @@ status_t par_compound_statement(lex_wrap_t *lex, stmt_t **result) {
     tt_init(&stmt->compound.typetab, lex->typetab);
     // Add new typetab table to top of stack
     lex->typetab = &stmt->compound.typetab;
+    size_t bind_mark = lex->bindings == NULL ? 0 : vec_size(&lex->bindings->log);
 
     LEX_MATCH(lex, LBRACE);
     while (LEX_CUR(lex)->type != RBRACE) {
@@ -2516,7 +2628,7 @@ status_t par_compound_statement(lex_wrap_t *lex, stmt_t **result) {
                 break;
             }
             // Type specifier only if its a typedef name
-            if (tt_lookup(lex->typetab, LEX_CUR(lex)->id_name) != NULL) {
+            if (par_typedef_lookup(lex, LEX_CUR(lex)->id_name) != NULL) {
                 is_decl = true;
             }
             break;
@@ -2545,6 +2657,10 @@ status_t par_compound_statement(lex_wrap_t *lex, stmt_t **result) {
     *result = stmt;
 
 fail:
+    // Typedefs declared in the block go out of scope
+    if (lex->bindings != NULL) {
+        tt_unbind(lex->bindings, bind_mark);
+    }
     return status;
 }
 
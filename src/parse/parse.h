@@ -48,4 +48,15 @@ status_t parser_parse(vec_t *tokens, trans_unit_t **result);
 status_t parser_parse_expr(vec_t *tokens, trans_unit_t *tunit,
                            expr_t **result);
 
+/**
+ * Parses the body of a function definition skipped with -lazy-parse or
+ * -parse-jobs. The function's tokens must still be alive. Bodies of different
+ * functions may be parsed concurrently with different units.
+ *
+ * @param tunit Translation unit to allocate the body's nodes from
+ * @param gdecl The function definition, its body is set on success
+ * @return CCC_OK on success, error code on error
+ */
+status_t parser_parse_lazy(trans_unit_t *tunit, gdecl_t *gdecl);
+
 #endif /* _PARSE_H_ */
@@ -41,6 +41,11 @@ typedef struct lex_wrap_t {
     typetab_t *typetab;  /**< Type table on top of stack */
     vec_iter_t tokens;   /**< Token stream */
     char *function;      /**< Current function. NULL if none */
+    tt_bindings_t *bindings; /**< Typedef bindings names are looked up in.
+                                  NULL to search the type tables */
+    size_t scope_limit;  /**< File scope names declared from this point on, as
+                              given by tt_file_seq, are hidden. SIZE_MAX
+                              unless parsing a deferred body */
 } lex_wrap_t;
 
 /**
@@ -151,6 +156,27 @@ status_t par_external_declaration(lex_wrap_t *lex, gdecl_t **result);
  */
 status_t par_function_definition(lex_wrap_t *lex, gdecl_t *gdecl);
 
+/**
+ * Skips the body of a function definition, recording its tokens so it can be
+ * parsed with parser_parse_lazy if it is used, or on a worker thread with
+ * -parse-jobs
+ *
+ * @param lex Lexer wrapper at the body's LBRACE
+ * @param gdecl The function definition
+ * @return true if the body was skipped, false if it should be parsed now
+ */
+bool par_defer_body(lex_wrap_t *lex, gdecl_t *gdecl);
+
+/**
+ * Looks up a typedef name in the current scope. This only loads the name's
+ * binding, unless the body is parsed on a worker thread.
+ *
+ * @param lex Lexer wrapper with the scope
+ * @param name Name to look up
+ * @return The typedef's entry, or NULL if name isn't a type
+ */
+typetab_entry_t *par_typedef_lookup(lex_wrap_t *lex, char *name);
+
 /**
  * Parses declaration specifers until there are none left. This function
  * allocates a new type object.
@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/wait.h>
@@ -31,9 +32,11 @@
 
 #include "ast/ast.h"
 #include "ir/ir.h"
+#include "lex/cpp.h"
 #include "manager.h"
 #include "optman.h"
 #include "util/file_directory.h"
+#include "util/file_mark.h"
 #include "util/logger.h"
 #include "util/tempfile.h"
 #include "util/string_store.h"
@@ -42,6 +45,8 @@
 #define LLVM_EXT "ll"
 #define ASM_EXT "s"
 #define OBJ_EXT "o"
+#define DEP_EXT "d"
+#define PCH_EXT "pch"
 
 #define AS "as"
 #define LLC "llc"
@@ -55,6 +60,7 @@ static slist_t temp_files;
 
 status_t main_setup(int argc, char **argv);
 void main_destroy(void);
+void main_write_deps(char *filename, vec_t *deps);
 char *main_compile_llvm(char *filepath, ir_trans_unit_t *ir, char *asm_path);
 void main_assemble(char *filename, char *asm_path, char *obj_path);
 void main_link(void);
@@ -74,10 +80,56 @@ int main(int argc, char **argv) {
         manager_t manager;
         man_init(&manager);
 
+        if (optman.output_opts & OUTPUT_PCH) {
+            // By default, the precompiled header is named after the header
+            char *outname = optman.output;
+            if (outname == NULL) {
+                outname = format_basename_ext(filename, PCH_EXT);
+            }
+            if (outname == NULL) {
+                logger_log(FMARK_NONE, LOG_ERR, "%s: Invalid file name",
+                           filename);
+                goto next;
+            }
+
+            status = man_write_pch(&manager, filename, outname);
+            if (status == CCC_OK && optman.pp_deps & PP_DEP_MMD) {
+                main_write_deps(filename, &manager.deps);
+            }
+            goto next;
+        }
+
+        if (optman.output_opts & OUTPUT_PREPROC) {
+            // Output of every file goes to the same place
+            FILE *output = stdout;
+            if (optman.output != NULL) {
+                output = fopen(optman.output, cur == 0 ? "w" : "a");
+                if (output == NULL) {
+                    logger_log(FMARK_NONE, LOG_ERR, "%s: %s", optman.output,
+                               strerror(errno));
+                    goto next;
+                }
+            }
+
+            status = man_preprocess(&manager, filename, output);
+            if (output != stdout && EOF == fclose(output)) {
+                logger_log(FMARK_NONE, LOG_ERR, "%s: %s", optman.output,
+                           strerror(errno));
+            }
+            if (status == CCC_OK && optman.pp_deps & PP_DEP_MMD) {
+                main_write_deps(filename, &manager.deps);
+            }
+            goto next;
+        }
+
         if (CCC_OK != (status = man_lex(&manager, filename))) {
             goto next;
         }
 
+        if (optman.pp_deps & PP_DEP_MMD) {
+            main_write_deps(filename, &manager.deps);
+        }
+
         if (optman.dump_opts & DUMP_TOKENS) {
             printf("//@ Tokens %s\n", filename);
             man_dump_tokens(&manager);
@@ -86,7 +138,7 @@ int main(int argc, char **argv) {
 
         trans_unit_t *ast;
         if (CCC_OK != (status = man_parse(&manager, &ast))) {
-            logger_log(NULL, LOG_ERR, "Failed to parse %s", filename);
+            logger_log(FMARK_NONE, LOG_ERR, "Failed to parse %s", filename);
             goto next;
         }
 
@@ -96,7 +148,7 @@ int main(int argc, char **argv) {
         }
 
         if (!typecheck_ast(ast)) {
-            logger_log(NULL, LOG_ERR, "Failed to typecheck %s", filename);
+            logger_log(FMARK_NONE, LOG_ERR, "Failed to typecheck %s", filename);
             goto next;
         }
 
@@ -121,13 +173,13 @@ int main(int argc, char **argv) {
             }
             FILE *output = fopen(outname, "w");
             if (output == NULL) {
-                logger_log(NULL, LOG_ERR, "%s: %s", outname, strerror(errno));
+                logger_log(FMARK_NONE, LOG_ERR, "%s: %s", outname, strerror(errno));
                 goto next;
             }
 
             ir_print(output, ir, filename);
             if (EOF == fclose(output)) {
-                logger_log(NULL, LOG_ERR, "%s: %s", outname, strerror(errno));
+                logger_log(FMARK_NONE, LOG_ERR, "%s: %s", outname, strerror(errno));
                 goto next;
             }
 
@@ -192,6 +244,7 @@ status_t main_setup(int argc, char **argv) {
     logger_init();
     fdir_init();
     sstore_init();
+    fmark_init();
 
     sl_init(&temp_files, offsetof(tempfile_t, link));
 
@@ -199,13 +252,88 @@ status_t main_setup(int argc, char **argv) {
 }
 
 void main_destroy(void) {
+    cpp_predef_destroy();
     optman_destroy();
+    fmark_destroy();
     sstore_destroy();
     fdir_destroy();
 
     SL_DESTROY_FUNC(&temp_files, tempfile_destroy);
 }
 
+/**
+ * Prints a path escaped for make
+ */
+static void main_print_dep_path(FILE *file, char *path) {
+    for (char *cur = path; *cur != '\0'; ++cur) {
+        switch (*cur) {
+        case ' ':
+        case '#':
+            fputc('\\', file);
+            break;
+        case '$':
+            fputc('$', file);
+            break;
+        default:
+            break;
+        }
+        fputc(*cur, file);
+    }
+}
+
+void main_write_deps(char *filename, vec_t *deps) {
+    // The target is the object file. The dependency file replaces its
+    // extension
+    char *target = optman.output;
+    if (target == NULL &&
+        NULL == (target = format_basename_ext(filename, OBJ_EXT))) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: Invalid file name", filename);
+        return;
+    }
+    if (strlen(target) + strlen(DEP_EXT) + 1 > PATH_MAX) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: File name too long", target);
+        return;
+    }
+
+    char dep_path[PATH_MAX + 1];
+    strcpy(dep_path, target);
+    char *base = ccc_basename(dep_path);
+    char *ext = strrchr(base, '.');
+    if (ext == NULL) {
+        ext = base + strlen(base);
+    }
+    *ext = '.';
+    strcpy(ext + 1, DEP_EXT);
+
+    FILE *file = fopen(dep_path, "w");
+    if (file == NULL) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", dep_path, strerror(errno));
+        return;
+    }
+
+    main_print_dep_path(file, target);
+    fputs(": ", file);
+    main_print_dep_path(file, filename);
+    VEC_FOREACH(cur, deps) {
+        fputs(" \\\n ", file);
+        main_print_dep_path(file, vec_get(deps, cur));
+    }
+    fputc('\n', file);
+
+    // Phony targets so make doesn't fail when a header is removed
+    if (optman.pp_deps & PP_DEP_MP) {
+        VEC_FOREACH(cur, deps) {
+            fputc('\n', file);
+            main_print_dep_path(file, vec_get(deps, cur));
+            fputs(":\n", file);
+        }
+    }
+
+    if (EOF == fclose(file)) {
+        logger_log(FMARK_NONE, LOG_ERR, "%s: %s", dep_path, strerror(errno));
+    }
+}
+
 char *main_compile_llvm(char *filepath, ir_trans_unit_t *ir, char *asm_path) {
     tempfile_t *llvm_tempfile = tempfile_create(filepath, LLVM_EXT);
     sl_append(&temp_files, &llvm_tempfile->link);
@@ -230,7 +358,7 @@ char *main_compile_llvm(char *filepath, ir_trans_unit_t *ir, char *asm_path) {
     } else if (pid == 0) {
         execlp(LLC, LLC, tempfile_path(llvm_tempfile), "-o", outpath,
                (char *)NULL);
-        logger_log(NULL, LOG_ERR, "Failed to exec %s", strerror(errno));
+        logger_log(FMARK_NONE, LOG_ERR, "Failed to exec %s", strerror(errno));
         exit(EXIT_FAILURE);
     }
     int child_status;
@@ -260,7 +388,7 @@ void main_assemble(char *filename, char *asm_path, char *obj_path) {
         exit_err("fork failed");
     } else if (pid == 0) {
         execlp(AS, AS, asm_path, "-o", objpath, NULL);
-        logger_log(NULL, LOG_ERR, "Failed to exec %s", strerror(errno));
+        logger_log(FMARK_NONE, LOG_ERR, "Failed to exec %s", strerror(errno));
         exit(EXIT_FAILURE);
     }
 
@@ -302,13 +430,13 @@ void main_link(void) {
         vec_push_back(&argv, (char *)NULL);
 
         execvp(LD, (char **)vec_elems(&argv));
-        logger_log(NULL, LOG_ERR, "Failed to exec %s", strerror(errno));
+        logger_log(FMARK_NONE, LOG_ERR, "Failed to exec %s", strerror(errno));
         exit(EXIT_FAILURE);
     }
     int ld_status;
     waitpid(pid, &ld_status, 0);
     if (ld_status != 0) {
-        logger_log(NULL, LOG_ERR, "ld returned %d exit status",
+        logger_log(FMARK_NONE, LOG_ERR, "ld returned %d exit status",
                    WEXITSTATUS(ld_status));
     }
 }
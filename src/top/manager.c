@@ -24,6 +24,7 @@
 
 #include <assert.h>
 
+#include "optman.h"
 #include "ast/ast.h"
 #include "lex/cpp.h"
 #include "lex/lex.h"
@@ -35,14 +36,13 @@ void man_init(manager_t *manager) {
     assert(manager != NULL);
 
     vec_init(&manager->tokens, 0);
+    vec_init(&manager->deps, 0);
 
     st_init(&manager->symtab, true);
 
-    fmark_man_init(&manager->mark_man);
     token_man_init(&manager->token_man);
 
-    lexer_init(&manager->lexer, &manager->token_man, &manager->mark_man,
-               &manager->symtab);
+    lexer_init(&manager->lexer, &manager->token_man, &manager->symtab);
 
     manager->ast = NULL;
     manager->ir = NULL;
@@ -66,10 +66,10 @@ void man_destroy_parse(manager_t *manager) {
     manager->parse_destroyed = true;
 
     vec_destroy(&manager->tokens);
+    vec_destroy(&manager->deps);
     st_destroy(&manager->symtab);
     lexer_destroy(&manager->lexer);
     token_man_destroy(&manager->token_man);
-    fmark_man_destroy(&manager->mark_man);
     ast_destroy(manager->ast);
 }
 
@@ -78,9 +78,26 @@ void man_destroy_ir(manager_t *manager) {
     manager->ir = NULL;
 }
 
+/**
+ * Returns where the headers a file includes should be recorded
+ */
+static vec_t *man_deps(manager_t *manager) {
+    return optman.pp_deps & PP_DEP_MMD ? &manager->deps : NULL;
+}
+
 status_t man_lex(manager_t *manager, char *filepath) {
     return cpp_process(&manager->token_man, &manager->lexer, filepath,
-                       &manager->tokens);
+                       &manager->tokens, man_deps(manager));
+}
+
+status_t man_preprocess(manager_t *manager, char *filepath, FILE *file) {
+    return cpp_preprocess(&manager->token_man, &manager->lexer, filepath,
+                          file, man_deps(manager));
+}
+
+status_t man_write_pch(manager_t *manager, char *filepath, char *pch_path) {
+    return cpp_write_pch(&manager->token_man, &manager->lexer, filepath,
+                         pch_path, man_deps(manager));
 }
 
 status_t man_parse(manager_t *manager, trans_unit_t **ast) {
@@ -34,10 +34,10 @@
  */
 typedef struct manager_t {
     vec_t tokens;
+    vec_t deps; /**< (char *) User headers included, with -MMD */
     symtab_t symtab;
     lexer_t lexer;
     token_man_t token_man;
-    fmark_man_t mark_man;
     trans_unit_t *ast;
     ir_trans_unit_t *ir;
     bool parse_destroyed;
@@ -79,6 +79,26 @@ void man_destroy_ir(manager_t *manager);
 
 status_t man_lex(manager_t *manager, char *filepath);
 
+/**
+ * Preprocess a file, printing the result as text
+ *
+ * @param manager The compilation mananger to use
+ * @param filepath Path to file to preprocess
+ * @param file File to print to
+ * @return CCC_OK on success, error code on error.
+ */
+status_t man_preprocess(manager_t *manager, char *filepath, FILE *file);
+
+/**
+ * Write a precompiled header
+ *
+ * @param manager The compilation mananger to use
+ * @param filepath Path to the header
+ * @param pch_path Path to write the precompiled header to
+ * @return CCC_OK on success, error code on error.
+ */
+status_t man_write_pch(manager_t *manager, char *filepath, char *pch_path);
+
 /**
  * Parse a translation unit from a compilation manager.
  *
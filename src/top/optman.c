@@ -41,6 +41,9 @@ typedef enum long_opt_idx_t {
     LOPT_DUMP_AST,
     LOPT_DUMP_IR,
     LOPT_EMIT_LLVM,
+    LOPT_INCLUDE_PCH,
+    LOPT_LAZY_PARSE,
+    LOPT_PARSE_JOBS,
     LOPT_NUM_ITEMS,
 } long_opt_idx_t;
 
@@ -70,8 +73,10 @@ status_t optman_init(int argc, char **argv) {
     optman.olevel = 0;
     optman.std = DEFAULT_STD;
     optman.misc = 0;
+    optman.parse_jobs = 1;
     optman.pp_deps = 0;
     optman.output_opts = 0;
+    optman.include_pch = NULL;
 
     return optman_parse(argc, argv);
 }
@@ -101,12 +106,15 @@ static status_t optman_parse(int argc, char **argv) {
             { "dump_ast"   , no_argument      , 0, 0 },
             { "dump_ir"    , no_argument      , 0, 0 },
             { "emit-llvm"  , no_argument      , 0, 0 },
+            { "include-pch", required_argument, 0, 0 },
+            { "lazy-parse" , no_argument      , 0, 0 },
+            { "parse-jobs" , required_argument, 0, 0 },
 
             { 0            , 0                , 0, 0 } // Terminator
         };
 
         int c = getopt_long_only(argc, argv,
-                                 "W:O:l:I:o:M::D:Sscg",
+                                 "W:O:l:I:o:M::D:x:ESscg",
                                  long_options, &opt_idx);
 
         if (c == -1) {
@@ -138,6 +146,23 @@ static status_t optman_parse(int argc, char **argv) {
             case LOPT_EMIT_LLVM:
                 optman.output_opts |= OUTPUT_EMIT_LLVM;
                 break;
+            case LOPT_INCLUDE_PCH:
+                optman.include_pch = optarg;
+                break;
+            case LOPT_LAZY_PARSE:
+                optman.misc |= MISC_LAZY_PARSE;
+                break;
+            case LOPT_PARSE_JOBS: {
+                char *end;
+                long jobs = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || jobs < 1 ||
+                    jobs > 256) {
+                    opt_err = true;
+                } else {
+                    optman.parse_jobs = jobs;
+                }
+                break;
+            }
             default:
                 break;
             }
@@ -203,6 +228,18 @@ static status_t optman_parse(int argc, char **argv) {
             optman.output_opts |= OUTPUT_ASM;
             break;
 
+        case 'x': // Language of the input files
+            if (strcmp("c-header", optarg) == 0) {
+                optman.output_opts |= OUTPUT_PCH;
+            } else if (strcmp("c", optarg) != 0) {
+                opt_err = true;
+            }
+            break;
+
+        case 'E': // Stop after preprocessing
+            optman.output_opts |= OUTPUT_PREPROC;
+            break;
+
         case 'c': // Don't link
             optman.output_opts |= OUTPUT_OBJ;
             break;
@@ -218,7 +255,7 @@ static status_t optman_parse(int argc, char **argv) {
         }
 
         if (opt_err) {
-            logger_log(NULL, LOG_ERR,
+            logger_log(FMARK_NONE, LOG_ERR,
                        "unrecognized command line option '%s'",
                        argv[optind - 1]);
         }
@@ -236,10 +273,26 @@ static status_t optman_parse(int argc, char **argv) {
         case 'S':
             vec_push_back(&optman.asm_files, param);
             break;
+        case 'h':
+        case 'H':
+            // Headers are only compiled into precompiled headers
+            if (optman.output_opts & OUTPUT_PCH) {
+                vec_push_back(&optman.src_files, param);
+            } else {
+                vec_push_back(&optman.obj_files, param);
+            }
+            break;
         default:
             vec_push_back(&optman.obj_files, param);
         }
     }
 
+    if (optman.output_opts & OUTPUT_PCH && optman.include_pch != NULL) {
+        logger_log(FMARK_NONE, LOG_ERR,
+                   "-include-pch cannot be used to write a precompiled "
+                   "header");
+        status = CCC_ESYNTAX;
+    }
+
     return status;
 }
@@ -71,7 +71,8 @@ typedef enum std_t {
  * Misc flags
  */
 typedef enum misc_flags_t {
-    MISC_MISC = 1 << 0, // TODO2: Remove if unused
+    MISC_MISC       = 1 << 0, // TODO2: Remove if unused
+    MISC_LAZY_PARSE = 1 << 1, // -lazy-parse Parse static function bodies on use
 } misc_flags_t;
 
 /**
@@ -87,6 +88,8 @@ typedef enum output_opts_t {
     OUTPUT_ASM       = 1 << 1, // -S Stop after asm generated
     OUTPUT_OBJ       = 1 << 2, // -c Stop after object files generated
     OUTPUT_DBG_SYM   = 1 << 3, // -g Generate debug symbols
+    OUTPUT_PREPROC   = 1 << 4, // -E Stop after preprocessing
+    OUTPUT_PCH       = 1 << 5, // -x c-header Write precompiled headers
 } output_opts_t;
 
 /**
@@ -103,11 +106,13 @@ typedef struct optman_t {
     vec_t asm_files;           /**< Assember files */
     vec_t obj_files;           /**< All other files assumed for linker */
     vec_t macros;              /**< Parameter defined macros */
+    char *include_pch;         /**< Precompiled header to include */
     dump_opts_t dump_opts;     /**< Dump options */
     warn_opts_t warn_opts;     /**< Warn options */
     olevel_t olevel;           /**< Optimization level */
     std_t std;                 /**< Standard used */
     misc_flags_t misc;         /**< Misc flags */
+    int parse_jobs;            /**< Threads for function bodies */
     pp_dep_opts_t pp_deps;     /**< Preprocessor dependency ops */
     output_opts_t output_opts; /**< Output options */
 } optman_t;
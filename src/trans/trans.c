@@ -194,7 +194,7 @@ ir_trans_unit_t *trans_trans_unit(trans_state_t *ts, trans_unit_t *ast) {
     // Add this translation unit's function declaration to symbol table
     SL_FOREACH(cur, &ast->gdecls) {
         gdecl_t *gdecl = GET_ELEM(&ast->gdecls, cur);
-        if (gdecl->type != GDECL_FDEFN) {
+        if (gdecl->type != GDECL_FDEFN || gdecl->fdefn.stmt == NULL) {
             continue;
         }
         decl_node_t *node = sl_head(&gdecl->decl->decls);
@@ -212,6 +212,10 @@ ir_trans_unit_t *trans_trans_unit(trans_state_t *ts, trans_unit_t *ast) {
 void trans_gdecl(trans_state_t *ts, gdecl_t *gdecl, slist_t *ir_gdecls) {
     switch (gdecl->type) {
     case GDECL_FDEFN: {
+        // Skipped bodies which were never used aren't translated
+        if (gdecl->fdefn.stmt == NULL) {
+            break;
+        }
         decl_node_t *node = sl_head(&gdecl->decl->decls);
 
         assert(node != NULL);
@@ -63,7 +63,7 @@ ir_expr_t *trans_expr(trans_state_t *ts, bool addrof, expr_t *expr,
                 }
             }
 
-            tt = tt->last;
+            tt = tt_ent->typetab->last;
         } while(true);
 
         // If this is an enum id, just return the integer value
@@ -133,7 +133,7 @@ ir_expr_t *trans_expr(trans_state_t *ts, bool addrof, expr_t *expr,
             val = trans_expr(ts, false, expr->assign.expr, ir_stmts);
             src_type = expr->assign.expr->etype;
         } else {
-            bool result = typecheck_type_max(ts->ast_tunit, NULL,
+            bool result = typecheck_type_max(ts->ast_tunit, FMARK_NONE,
                                              expr->assign.expr->etype,
                                              expr->etype, &src_type);
             assert(result && src_type != NULL);
@@ -603,6 +603,7 @@ ir_expr_t *trans_expr(trans_state_t *ts, bool addrof, expr_t *expr,
         return trans_assign_temp(ts, ir_stmts, result);
     }
     case EXPR_DESIG_INIT:
+    case EXPR_EMBED:
     default:
         assert(false);
     }
@@ -916,6 +917,7 @@ ir_expr_t *trans_expr_bool(trans_state_t *ts, ir_expr_t *expr,
             break;
 
         case IR_CONST_STRUCT:
+        case IR_CONST_BYTES:
         case IR_CONST_ARR:
         case IR_CONST_UNDEF:
         default:
@@ -1143,7 +1145,7 @@ ir_expr_t *trans_binop(trans_state_t *ts, expr_t *left, ir_expr_t *left_addr,
     // Comparisons need to be handled separately
     if (is_cmp) {
         type_t *max_type;
-        bool success = typecheck_type_max(ts->ast_tunit, NULL, left->etype,
+        bool success = typecheck_type_max(ts->ast_tunit, FMARK_NONE, left->etype,
                                           right->etype, &max_type);
         // Must be valid if typechecked
         assert(success && max_type != NULL);
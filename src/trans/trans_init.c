@@ -76,7 +76,15 @@ void trans_initializer(trans_state_t *ts, ir_inst_stream_t *ir_stmts,
         ir_type_t *elem_type = trans_type(ts, ast_type->arr.base);
 
         size_t nelem = 0;
-        if (val != NULL) {
+        expr_t *head = val == NULL || vec_size(&val->init_list.exprs) != 1 ?
+            NULL : vec_front(&val->init_list.exprs);
+        if (head != NULL && head->type == EXPR_EMBED) {
+            // Copy the bytes in, and zero the rest below
+            ir_expr_t *bytes = trans_embed(ts, head);
+            bytes = trans_assign_temp(ts, ir_stmts, bytes);
+            trans_memcpy(ts, ir_stmts, addr, bytes, head->embed.len, 1, false);
+            nelem = head->embed.len;
+        } else if (val != NULL) {
             VEC_FOREACH(cur, &val->init_list.exprs) {
                 ir_expr_t *cur_addr = ir_expr_create(ts->tunit,
                                                      IR_EXPR_GETELEMPTR);
@@ -265,6 +273,37 @@ ir_expr_t *trans_string(trans_state_t *ts, char *str) {
     arr_lit->const_params.type = type;
     arr_lit->const_params.str_val = unescaped;
 
+    elem = emalloc(sizeof(*elem));
+    elem->key = str;
+    elem->val = trans_const_arr_ptr(ts, ptr_type, arr_lit);
+    ht_insert(&ts->tunit->strings, &elem->link);
+
+    return elem->val;
+}
+
+ir_expr_t *trans_embed(trans_state_t *ts, expr_t *expr) {
+    assert(expr->type == EXPR_EMBED);
+
+    ir_type_t *type = ir_type_create(ts->tunit, IR_TYPE_ARR);
+    type->arr.nelems = expr->embed.len;
+    type->arr.elem_type = &ir_type_i8;
+    ir_type_t *ptr_type = ir_type_create(ts->tunit, IR_TYPE_PTR);
+    ptr_type->ptr.base = type;
+
+    ir_expr_t *arr_lit = ir_expr_create(ts->tunit, IR_EXPR_CONST);
+    arr_lit->const_params.ctype = IR_CONST_BYTES;
+    arr_lit->const_params.type = type;
+    arr_lit->const_params.bytes_val.data = expr->embed.data;
+    arr_lit->const_params.bytes_val.len = expr->embed.len;
+
+    return trans_const_arr_ptr(ts, ptr_type, arr_lit);
+}
+
+ir_expr_t *trans_const_arr_ptr(trans_state_t *ts, ir_type_t *ptr_type,
+                               ir_expr_t *arr_lit) {
+    ir_type_t *type = ptr_type->ptr.base;
+    assert(type->type == IR_TYPE_ARR);
+
     ir_expr_t *var =
         trans_create_anon_global(ts, type, arr_lit, 1, IR_LINKAGE_PRIVATE,
                                  IR_GDATA_CONSTANT | IR_GDATA_UNNAMED_ADDR);
@@ -284,11 +323,6 @@ ir_expr_t *trans_string(trans_state_t *ts, char *str) {
     zero = ir_expr_zero(ts->tunit, &ir_type_i32);
     sl_append(&elem_ptr->getelemptr.idxs, &zero->link);
 
-    elem = emalloc(sizeof(*elem));
-    elem->key = str;
-    elem->val = elem_ptr;
-    ht_insert(&ts->tunit->strings, &elem->link);
-
     return elem_ptr;
 }
 
@@ -302,6 +336,19 @@ ir_expr_t *trans_array_init(trans_state_t *ts, expr_t *expr) {
     type_t *ast_elem_type = expr->etype->arr.base;
 
     ir_expr_t *arr_lit = ir_expr_create(ts->tunit, IR_EXPR_CONST);
+
+    // A lone #embed becomes a byte string, zero padded to the array's size
+    if (vec_size(&expr->init_list.exprs) == 1) {
+        expr_t *head = vec_front(&expr->init_list.exprs);
+        if (head != NULL && head->type == EXPR_EMBED) {
+            arr_lit->const_params.ctype = IR_CONST_BYTES;
+            arr_lit->const_params.type = type;
+            arr_lit->const_params.bytes_val.data = head->embed.data;
+            arr_lit->const_params.bytes_val.len = head->embed.len;
+            return arr_lit;
+        }
+    }
+
     sl_init(&arr_lit->const_params.arr_val, offsetof(ir_expr_t, link));
     arr_lit->const_params.ctype = IR_CONST_ARR;
     arr_lit->const_params.type = type;
@@ -36,6 +36,14 @@ void trans_initializer_struct(trans_state_t *ts, ir_inst_stream_t *ir_stmts,
 
 ir_expr_t *trans_string(trans_state_t *ts, char *str);
 
+// Returns an i8 pointer to a private constant holding an #embed's bytes
+ir_expr_t *trans_embed(trans_state_t *ts, expr_t *expr);
+
+// Stores constant array arr_lit in an anonymous global, returns pointer to the
+// first element
+ir_expr_t *trans_const_arr_ptr(trans_state_t *ts, ir_type_t *ptr_type,
+                               ir_expr_t *arr_lit);
+
 ir_expr_t *trans_array_init(trans_state_t *ts, expr_t *expr);
 
 ir_expr_t *trans_union_init(trans_state_t *ts, type_t *type, expr_t *expr);
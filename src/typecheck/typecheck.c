@@ -26,6 +26,8 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include "parse/parse.h"
+#include "top/optman.h"
 #include "typecheck_init.h"
 #include "util/logger.h"
 
@@ -39,12 +41,17 @@ void tc_state_init(tc_state_t *tcs) {
     tcs->last_loop = NULL;
     tcs->last_break = NULL;
     tcs->ignore_undef = false;
+    vec_init(&tcs->lazy_fdefns, 0);
+    tcs->scope_limit = SIZE_MAX;
+    vec_init(&tcs->implicit_calls, 0);
 }
 
 void tc_state_destroy(tc_state_t *tcs) {
     // Use free rather than ast_type_destroy because we don't want to
     // recursively free other nodes
     SL_DESTROY_FUNC(&tcs->etypes, free);
+    vec_destroy(&tcs->lazy_fdefns);
+    vec_destroy(&tcs->implicit_calls);
 }
 
 bool typecheck_ast(trans_unit_t *ast) {
@@ -189,6 +196,7 @@ void typecheck_const_expr_eval(typetab_t *typetab, expr_t *expr,
     case EXPR_ARR_IDX:
     case EXPR_INIT_LIST:
     case EXPR_DESIG_INIT:
+    case EXPR_EMBED:
     default:
         assert(false);
     }
@@ -293,6 +301,11 @@ bool typecheck_type_equal(type_t *t1, type_t *t2) {
     return true;
 }
 
+bool typecheck_type_incomplete(tc_state_t *tcs, type_t *type) {
+    return type->struct_params.esize == (size_t)-1 ||
+        type->struct_params.complete_seq >= tcs->scope_limit;
+}
+
 bool typecheck_expr_lvalue(tc_state_t *tcs, expr_t *expr) {
     switch (expr->type) {
     case EXPR_PAREN:
@@ -328,7 +341,7 @@ bool typecheck_expr_lvalue(tc_state_t *tcs, expr_t *expr) {
     return false;
 }
 
-bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from) {
+bool typecheck_type_assignable(fmark_t mark, type_t *to, type_t *from) {
     to = ast_type_untypedef(to);
     from = ast_type_untypedef(from);
 
@@ -336,14 +349,14 @@ bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from) {
     type_t *umod_from = ast_type_unmod(from);
 
     if (umod_to->type == TYPE_VOID) {
-        if (mark != NULL) {
+        if (mark != FMARK_NONE) {
             logger_log(mark, LOG_ERR, "invalid use of void expression");
         }
         return false;
     }
 
     if (umod_from->type == TYPE_VOID) {
-        if (mark != NULL) {
+        if (mark != FMARK_NONE) {
             logger_log(mark, LOG_ERR,
                        "void value not ignored as it ought to be");
         }
@@ -366,7 +379,7 @@ bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from) {
 
     switch (umod_to->type) {
     case TYPE_VOID:
-        if (mark != NULL) {
+        if (mark != FMARK_NONE) {
             logger_log(mark, LOG_ERR, "can't assign to void");
         }
         return false;
@@ -385,7 +398,7 @@ bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from) {
         }
 
         if (is_ptr_from) {
-            if (mark != NULL) {
+            if (mark != FMARK_NONE) {
                 logger_log(mark, LOG_WARN, "initialization makes integer from"
                            " pointer without a cast");
             }
@@ -427,7 +440,7 @@ bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from) {
                 }
             }
         }
-        if (mark != NULL) {
+        if (mark != FMARK_NONE) {
             logger_log(mark, LOG_ERR,
                        "assignment to expression with array type");
         }
@@ -479,14 +492,14 @@ bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from) {
     }
 
 fail:
-    if (mark != NULL) {
+    if (mark != FMARK_NONE) {
         logger_log(mark, LOG_ERR,
                    "incompatible types when assigning");
     }
     return false;
 }
 
-bool typecheck_types_binop(fmark_t *mark, oper_t op, type_t *t1, type_t *t2) {
+bool typecheck_types_binop(fmark_t mark, oper_t op, type_t *t1, type_t *t2) {
     t1 = ast_type_untypedef(t1);
     t2 = ast_type_untypedef(t2);
     type_t *umod1 = ast_type_unmod(t1);
@@ -571,7 +584,7 @@ bool typecheck_types_binop(fmark_t *mark, oper_t op, type_t *t1, type_t *t2) {
     return false;
 }
 
-bool typecheck_type_unaryop(fmark_t *mark, oper_t op, type_t *type) {
+bool typecheck_type_unaryop(fmark_t mark, oper_t op, type_t *type) {
     type = ast_type_unmod(type);
     bool is_numeric = TYPE_IS_NUMERIC(type);
     bool is_int = TYPE_IS_INTEGRAL(type);
@@ -624,7 +637,7 @@ bool typecheck_type_unaryop(fmark_t *mark, oper_t op, type_t *type) {
     return false;
 }
 
-bool typecheck_type_max(trans_unit_t *tunit, fmark_t *mark, type_t *t1,
+bool typecheck_type_max(trans_unit_t *tunit, fmark_t mark, type_t *t1,
                         type_t *t2, type_t **result) {
     t1 = ast_type_untypedef(t1);
     t2 = ast_type_untypedef(t2);
@@ -751,7 +764,7 @@ bool typecheck_type_max(trans_unit_t *tunit, fmark_t *mark, type_t *t1,
     return false;
 }
 
-bool typecheck_type_cast(fmark_t *mark, type_t *to, type_t *from) {
+bool typecheck_type_cast(fmark_t mark, type_t *to, type_t *from) {
     to = ast_type_untypedef(to);
     from = ast_type_untypedef(from);
 
@@ -781,7 +794,7 @@ bool typecheck_type_cast(fmark_t *mark, type_t *to, type_t *from) {
     return true;
 }
 
-bool typecheck_type_integral(fmark_t *mark, type_t *type) {
+bool typecheck_type_integral(fmark_t mark, type_t *type) {
     switch (type->type) {
     case TYPE_BOOL:
     case TYPE_CHAR:
@@ -821,7 +834,7 @@ bool typecheck_type_integral(fmark_t *mark, type_t *type) {
     return false;
 }
 
-bool typecheck_type_conditional(fmark_t *mark, type_t *type) {
+bool typecheck_type_conditional(fmark_t mark, type_t *type) {
     switch (type->type) {
     case TYPE_BOOL:
     case TYPE_CHAR:
@@ -946,6 +959,22 @@ bool typecheck_trans_unit(tc_state_t *tcs, trans_unit_t *trans_unit) {
         retval &= typecheck_gdecl(tcs, GET_ELEM(&trans_unit->gdecls, cur));
     }
 
+    if (optman.parse_jobs > 1) {
+        retval &= typecheck_parallel_bodies(tcs, trans_unit);
+    }
+
+    // Parse and check the skipped bodies of functions which were used. This
+    // may find more used functions
+    while (vec_size(&tcs->lazy_fdefns) > 0) {
+        gdecl_t *gdecl = vec_pop_back(&tcs->lazy_fdefns);
+        if (CCC_OK != parser_parse_lazy(trans_unit, gdecl)) {
+            retval = false;
+            continue;
+        }
+        retval &= typecheck_fdefn_body(tcs, gdecl);
+    }
+    retval &= typecheck_implicit_calls(tcs);
+
     tcs->typetab = save_tab;
     return retval;
 }
@@ -966,22 +995,22 @@ bool typecheck_gdecl(tc_state_t *tcs, gdecl_t *gdecl) {
         log_function = node->id;
 
         retval &= typecheck_decl(tcs, gdecl->decl, TYPE_VOID);
-        retval &= typecheck_stmt(tcs, gdecl->fdefn.stmt);
-        SL_FOREACH(cur, &gdecl->fdefn.gotos) {
-            stmt_t *goto_stmt = GET_ELEM(&gdecl->fdefn.gotos, cur);
-            stmt_t *label = ht_lookup(&tcs->func->fdefn.labels,
-                                      &goto_stmt->goto_params.label);
-            if (label == NULL) {
-                logger_log(goto_stmt->mark, LOG_ERR,
-                           "label %s used but not defined",
-                           goto_stmt->goto_params.label);
-                retval = false;
-            }
-        }
 
         // Restore old state
         log_function = NULL;
         tcs->func = func_save;
+
+        // Until its body is parsed, a function is only declared. The type is
+        // checked again with the body, to add the parameters to its scope.
+        // The body only sees the file scope up to this point
+        if (gdecl->fdefn.stmt == NULL) {
+            node->type->typechecked = false;
+            gdecl->fdefn.lazy.check_limit = tt_file_advance(tcs->typetab);
+            break;
+        }
+        gdecl->fdefn.lazy.check_limit = SIZE_MAX;
+
+        retval &= typecheck_fdefn_body(tcs, gdecl);
         break;
     }
     case GDECL_DECL:
@@ -995,6 +1024,216 @@ bool typecheck_gdecl(tc_state_t *tcs, gdecl_t *gdecl) {
     return retval;
 }
 
+bool typecheck_fdefn_body(tc_state_t *tcs, gdecl_t *gdecl) {
+    bool retval = true;
+
+    gdecl_t *func_save = tcs->func;
+    assert(func_save == NULL); // Can't have nested functions in C
+    tcs->func = gdecl;
+
+    decl_node_t *node = sl_head(&gdecl->decl->decls);
+    char *log_save = log_function;
+    log_function = node->id;
+    size_t limit_save = tcs->scope_limit;
+    tcs->scope_limit = gdecl->fdefn.lazy.check_limit;
+
+    // No-op unless the body was parsed after the declaration was checked
+    retval &= typecheck_type(tcs, node->type);
+
+    retval &= typecheck_stmt(tcs, gdecl->fdefn.stmt);
+    SL_FOREACH(cur, &gdecl->fdefn.gotos) {
+        stmt_t *goto_stmt = GET_ELEM(&gdecl->fdefn.gotos, cur);
+        stmt_t *label = ht_lookup(&tcs->func->fdefn.labels,
+                                  &goto_stmt->goto_params.label);
+        if (label == NULL) {
+            logger_log(goto_stmt->mark, LOG_ERR,
+                       "label %s used but not defined",
+                       goto_stmt->goto_params.label);
+            retval = false;
+        }
+    }
+
+    // Restore old state
+    log_function = log_save;
+    tcs->scope_limit = limit_save;
+    tcs->func = func_save;
+
+    return retval;
+}
+
+/**
+ * Orders implicit calls by name, then in the order they would have been
+ * checked in if every body had been checked in place
+ */
+static int typecheck_implicit_cmp(const void *v1, const void *v2) {
+    const tc_implicit_t *c1 = *(tc_implicit_t * const *)v1;
+    const tc_implicit_t *c2 = *(tc_implicit_t * const *)v2;
+    int cmp = strcmp(c1->call->call.func->var_id, c2->call->call.func->var_id);
+    if (cmp != 0) {
+        return cmp;
+    }
+    size_t limit1 = c1->func->fdefn.lazy.check_limit;
+    size_t limit2 = c2->func->fdefn.lazy.check_limit;
+    if (limit1 != limit2) {
+        return limit1 < limit2 ? -1 : 1;
+    }
+    return c1->order < c2->order ? -1 : c1->order > c2->order;
+}
+
+bool typecheck_implicit_calls(tc_state_t *tcs) {
+    bool retval = true;
+    qsort(vec_elems(&tcs->implicit_calls), vec_size(&tcs->implicit_calls),
+          sizeof(void *), typecheck_implicit_cmp);
+
+    char *log_save = log_function;
+    char *last_name = NULL;
+    for (size_t i = 0; i < vec_size(&tcs->implicit_calls); ++i) {
+        tc_implicit_t *implicit = vec_get(&tcs->implicit_calls, i);
+        char *name = implicit->call->call.func->var_id;
+
+        // Only the first call declares the function, the others see it
+        if (last_name != NULL && strcmp(name, last_name) == 0) {
+            continue;
+        }
+        last_name = name;
+
+        decl_node_t *node = sl_head(&implicit->func->decl->decls);
+        log_function = node->id;
+        logger_log(implicit->call->mark, LOG_WARN,
+                   "implicit declaration of function '%s'", name);
+
+        typetab_entry_t *entry;
+        status_t status = tt_insert(&tcs->tunit->typetab, tt_implicit_func,
+                                    TT_VAR, name, &entry);
+        if (status != CCC_DUPLICATE) {
+            assert(status == CCC_OK);
+            continue;
+        }
+
+        // Declared later in the file. Like when the declaration is checked
+        // after the call, it must be compatible with the implicit one
+        entry = tt_lookup(&tcs->tunit->typetab, name);
+        if (entry->type == tt_implicit_func) {
+            continue;
+        }
+        if (entry->entry_type != TT_VAR || entry->type->type != TYPE_FUNC ||
+            entry->type->func.type->type != TYPE_INT) {
+            // Report it at the declaration which got the entry's type
+            fmark_t mark = entry->type->mark;
+            SL_FOREACH(cur, &tcs->tunit->gdecls) {
+                gdecl_t *gdecl = GET_ELEM(&tcs->tunit->gdecls, cur);
+                SL_FOREACH(cur_node, &gdecl->decl->decls) {
+                    decl_node_t *node =
+                        GET_ELEM(&gdecl->decl->decls, cur_node);
+                    if (node->id != NULL && strcmp(node->id, name) == 0 &&
+                        ast_type_untypedef(node->type) == entry->type) {
+                        mark = node->mark;
+                    }
+                }
+            }
+            log_function = entry->entry_type == TT_VAR &&
+                entry->var.var_defined ? name : NULL;
+            logger_log(mark, LOG_ERR, "conflicting types for '%s'", name);
+            retval = false;
+        }
+    }
+    log_function = log_save;
+
+    while (vec_size(&tcs->implicit_calls) > 0) {
+        free(vec_pop_back(&tcs->implicit_calls));
+    }
+
+    return retval;
+}
+
+void *typecheck_worker(void *arg) {
+    tc_worker_t *worker = arg;
+
+    size_t idx;
+    while ((idx = atomic_fetch_add(worker->next, 1)) <
+           vec_size(worker->bodies)) {
+        gdecl_t *gdecl = vec_get(worker->bodies, idx);
+        if (CCC_OK != parser_parse_lazy(&worker->tunit, gdecl)) {
+            worker->retval = false;
+            continue;
+        }
+        worker->retval &= typecheck_fdefn_body(&worker->tcs, gdecl);
+    }
+
+    return NULL;
+}
+
+bool typecheck_parallel_bodies(tc_state_t *tcs, trans_unit_t *trans_unit) {
+    vec_t bodies;
+    vec_init(&bodies, 0);
+    SL_FOREACH(cur, &trans_unit->gdecls) {
+        gdecl_t *gdecl = GET_ELEM(&trans_unit->gdecls, cur);
+        if (gdecl->type == GDECL_FDEFN && gdecl->fdefn.stmt == NULL &&
+            !gdecl->fdefn.lazy.on_use) {
+            vec_push_back(&bodies, gdecl);
+        }
+    }
+
+    size_t num_workers = optman.parse_jobs;
+    if (num_workers > vec_size(&bodies)) {
+        num_workers = vec_size(&bodies);
+    }
+
+    // Workers only read the global scope and the tokens. Each allocates nodes
+    // from its own copy of the translation unit
+    atomic_size_t next = 0;
+    tc_worker_t *workers = emalloc(num_workers * sizeof(tc_worker_t));
+    for (size_t i = 0; i < num_workers; ++i) {
+        tc_worker_t *worker = &workers[i];
+        tc_state_init(&worker->tcs);
+        worker->tunit = *trans_unit;
+        arena_init(&worker->tunit.arena);
+        sl_init(&worker->tunit.gdecl_nodes, offsetof(gdecl_t, heap_link));
+        sl_init(&worker->tunit.stmts, offsetof(stmt_t, heap_link));
+        sl_init(&worker->tunit.exprs, offsetof(expr_t, heap_link));
+        worker->tunit.bindings = NULL; // Bindings are shared by all threads
+        worker->tcs.tunit = &worker->tunit;
+        worker->tcs.typetab = tcs->typetab;
+        worker->bodies = &bodies;
+        worker->next = &next;
+        worker->retval = true;
+    }
+
+    // The calling thread is the first worker. If a thread can't be started,
+    // the others take its share
+    bool *started = ecalloc(num_workers, sizeof(bool));
+    for (size_t i = 1; i < num_workers; ++i) {
+        started[i] = 0 == pthread_create(&workers[i].thread, NULL,
+                                         typecheck_worker, &workers[i]);
+    }
+    if (num_workers > 0) {
+        typecheck_worker(&workers[0]);
+    }
+
+    bool retval = true;
+    for (size_t i = 0; i < num_workers; ++i) {
+        tc_worker_t *worker = &workers[i];
+        if (started[i]) {
+            pthread_join(worker->thread, NULL);
+        }
+        retval &= worker->retval;
+
+        arena_merge(&trans_unit->arena, &worker->tunit.arena);
+        sl_concat_front(&trans_unit->gdecl_nodes, &worker->tunit.gdecl_nodes);
+        sl_concat_front(&trans_unit->stmts, &worker->tunit.stmts);
+        sl_concat_front(&trans_unit->exprs, &worker->tunit.exprs);
+        vec_append_vec(&tcs->lazy_fdefns, &worker->tcs.lazy_fdefns);
+        vec_append_vec(&tcs->implicit_calls, &worker->tcs.implicit_calls);
+        tc_state_destroy(&worker->tcs);
+    }
+
+    free(started);
+    free(workers);
+    vec_destroy(&bodies);
+
+    return retval;
+}
+
 bool typecheck_stmt(tc_state_t *tcs, stmt_t *stmt) {
     status_t status;
     bool retval = true;
@@ -1215,7 +1454,7 @@ bool typecheck_decl_node(tc_state_t *tcs, decl_node_t *decl_node,
 
     // TODO1: Incomplete types are allowed for function declarations
     if ((unmod->type == TYPE_STRUCT || unmod->type == TYPE_UNION) &&
-        unmod->struct_params.esize == (size_t)-1 &&
+        typecheck_type_incomplete(tcs, unmod) &&
         !(node_type->type == TYPE_MOD &&
           node_type->mod.type_mod & TMOD_EXTERN)) {
         logger_log(decl_node->mark, LOG_ERR,
@@ -1230,7 +1469,7 @@ bool typecheck_decl_node(tc_state_t *tcs, decl_node_t *decl_node,
     }
     if ((type == TYPE_STRUCT || type == TYPE_UNION) &&
         (unmod->type == TYPE_STRUCT || unmod->type == TYPE_UNION) &&
-        unmod->struct_params.esize == (size_t)-1) {
+        typecheck_type_incomplete(tcs, unmod)) {
         logger_log(decl_node->mark, LOG_ERR, "field '%s' has incomplete type",
                    decl_node->id);
         return false;
@@ -1407,7 +1646,8 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
             expr->etype = tt_int;
             return retval;
         }
-        typetab_entry_t *entry = tt_lookup(tcs->typetab, expr->var_id);
+        typetab_entry_t *entry =
+            tt_lookup_before(tcs->typetab, expr->var_id, tcs->scope_limit);
         if (entry == NULL ||
             (entry->entry_type != TT_VAR && entry->entry_type != TT_ENUM_ID)) {
             logger_log(expr->mark, LOG_ERR, "'%s' undeclared.", expr->var_id);
@@ -1419,12 +1659,26 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
         }
 
         if (entry->type->type == TYPE_FUNC) {
+            // Queue the body of a used function if it hasn't been parsed
+            gdecl_t *lazy = tcs->tunit == NULL ? NULL :
+                ht_lookup(&tcs->tunit->lazy_fdefns, &expr->var_id);
+            if (lazy != NULL &&
+                !atomic_exchange(&lazy->fdefn.lazy.referenced, true)) {
+                vec_push_back(&tcs->lazy_fdefns, lazy);
+            }
+
             // If we're using a function as a variable, etype is function
-            // pointer
-            type_t *ptr_type = ast_type_create(tcs->tunit, expr->mark,
-                                               TYPE_PTR);
-            ptr_type->ptr.base = entry->type;
-            expr->etype = ptr_type;
+            // pointer. An implicit declaration keeps its type when the
+            // function is declared later, so all of its calls are translated
+            // the same way
+            if (entry->type == tt_implicit_func) {
+                expr->etype = tt_implicit_func_ptr;
+            } else {
+                type_t *ptr_type = ast_type_create(tcs->tunit, expr->mark,
+                                                   TYPE_PTR);
+                ptr_type->ptr.base = entry->type;
+                expr->etype = ptr_type;
+            }
         } else {
             expr->etype = entry->type;
         }
@@ -1547,12 +1801,12 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
                 break;
             }
 
-            expr->etype = emalloc(sizeof(type_t));
             // If we have a translation unit, save etypes on it because we'll
             // need them later
             if (tcs->tunit != NULL) {
-                sl_append(&tcs->tunit->types, &expr->etype->heap_link);
+                expr->etype = arena_alloc(&tcs->tunit->arena, sizeof(type_t));
             } else {
+                expr->etype = emalloc(sizeof(type_t));
                 sl_append(&tcs->etypes, &expr->etype->heap_link);
             }
             expr->etype->mark = expr->mark;
@@ -1574,7 +1828,7 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
                            "dereferencing a 'void *' pointer");
             }
             if ((unmod->type == TYPE_STRUCT || unmod->type == TYPE_VOID) &&
-                unmod->struct_params.esize == (size_t)-1) {
+                typecheck_type_incomplete(tcs, unmod)) {
                 logger_log(expr->mark, LOG_ERR,
                            "dereferencing pointer to incomplete type");
                 retval = false;
@@ -1638,17 +1892,29 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
         expr_t *func_expr = expr->call.func;
 
         if (func_expr->type == EXPR_VAR &&
-            tt_lookup(tcs->typetab, func_expr->var_id) == NULL) {
-            logger_log(expr->mark, LOG_WARN,
-                       "implicit declaration of function '%s'",
-                       func_expr->var_id);
-
-            typetab_t *tt_save = tcs->typetab;
-            tcs->typetab = &tcs->tunit->typetab;
-            status_t status = tt_insert(tcs->typetab, tt_implicit_func, TT_VAR,
-                                        func_expr->var_id, NULL);
-            assert(status == CCC_OK);
-            tcs->typetab = tt_save;
+            tt_lookup_before(tcs->typetab, func_expr->var_id,
+                             tcs->scope_limit) == NULL) {
+            if (tcs->scope_limit != SIZE_MAX) {
+                // Later declarations are hidden from this body, and other
+                // threads may be using the file scope, so the function is
+                // declared once every body is checked
+                tc_implicit_t *implicit = emalloc(sizeof(tc_implicit_t));
+                implicit->func = tcs->func;
+                implicit->call = expr;
+                implicit->order = vec_size(&tcs->implicit_calls);
+                vec_push_back(&tcs->implicit_calls, implicit);
+            } else {
+                logger_log(expr->mark, LOG_WARN,
+                           "implicit declaration of function '%s'",
+                           func_expr->var_id);
+
+                typetab_t *tt_save = tcs->typetab;
+                tcs->typetab = &tcs->tunit->typetab;
+                status_t status = tt_insert(tcs->typetab, tt_implicit_func,
+                                            TT_VAR, func_expr->var_id, NULL);
+                assert(status == CCC_OK);
+                tcs->typetab = tt_save;
+            }
             func_expr->etype = tt_implicit_func_ptr;
         } else if (!(retval &= typecheck_expr(tcs, func_expr, TC_NOCONST))) {
             return false;
@@ -1674,7 +1940,7 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
             retval &= typecheck_expr(tcs, arg, TC_NOCONST);
             type_t *param_type = param == NULL ? decl->type : param->type;
             if (arg->etype != NULL &&
-                !typecheck_type_assignable(NULL, param_type,
+                !typecheck_type_assignable(FMARK_NONE, param_type,
                                            arg->etype)) {
                 logger_log(arg->mark, LOG_ERR,
                            "incompatible type for argument %d of function",
@@ -1757,7 +2023,7 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
             }
             if (type->type == TYPE_STRUCT || type->type == TYPE_UNION) {
                 // If the type hasn't been defined yet, then return an error
-                if (type->struct_params.esize == (size_t)-1) {
+                if (typecheck_type_incomplete(tcs, type)) {
                     logger_log(expr->mark, LOG_ERR,
                                "invalid application to incomplete type");
                     return false;
@@ -1811,7 +2077,7 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
                        "or union", expr->mem_acc.name);
             return false;
         }
-        if (compound->struct_params.esize == (size_t)-1) {
+        if (typecheck_type_incomplete(tcs, compound)) {
             logger_log(expr->mark, LOG_ERR,
                        "dereferencing pointer to incomplete type");
             return false;
@@ -1873,6 +2139,12 @@ bool typecheck_expr(tc_state_t *tcs, expr_t *expr, bool constant) {
         // Don't know what etype is
         return retval;
 
+    case EXPR_EMBED:
+        // Initializer lists expand or consume #embed before getting here
+        logger_log(expr->mark, LOG_ERR,
+                   "#embed is only supported in initializers");
+        return false;
+
     case EXPR_VA_START: {
         retval &= typecheck_expr_va_list(tcs, expr->vastart.ap);
         gdecl_t *func = tcs->func;
@@ -2000,6 +2272,12 @@ bool typecheck_type(tc_state_t *tcs, type_t *type) {
         } while (struct_iter_advance(&cur));
 
         ast_type_size(type); // Take size to mark as being a complete type
+
+        // Bodies checked later see the type as defined from here on. Types
+        // defined in them are local, so complete for the whole body
+        if (tcs->scope_limit == SIZE_MAX && tcs->typetab != NULL) {
+            type->struct_params.complete_seq = tt_file_advance(tcs->typetab);
+        }
         return retval;
     }
     case TYPE_ENUM: {
@@ -2109,7 +2387,7 @@ bool typecheck_type(tc_state_t *tcs, type_t *type) {
         retval &= typecheck_type(tcs, type->func.type);
 
         typetab_t *save_tab = NULL;
-        if (tcs->func != NULL) {
+        if (tcs->func != NULL && tcs->func->fdefn.stmt != NULL) {
             decl_node_t *func_node = sl_head(&tcs->func->decl->decls);
             if (func_node->type == type) {
                 // Make sure to enter the scope of the function's body before
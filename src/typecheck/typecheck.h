@@ -71,14 +71,14 @@ bool typecheck_type_equal(type_t *t1, type_t *t2);
  * Verifies that t1 and t2 are compatible, and the returns the "higher" type of
  * the two.
  *
- * @param mark Location of usage. NULL if none, no errors will be reported
+ * @param mark Location of usage. FMARK_NONE if none, no errors will be reported
  * @param t1 Type 1
  * @param t2 Type 2
  * @param result The wider of t1 and t2 otherwise.
  *     NULL if they are not compatible
  * @return true if the node typechecks, false otherwise
  */
-bool typecheck_type_max(trans_unit_t *tunit, fmark_t *mark, type_t *t1,
+bool typecheck_type_max(trans_unit_t *tunit, fmark_t mark, type_t *t1,
                         type_t *t2, type_t **result);
 
 #endif /* _TYPECHECK_H_ */
@@ -127,6 +127,12 @@ bool typecheck_init_list_helper(tc_state_t *tcs, type_t *type, expr_t *expr) {
             if (cur_expr == NULL) {
                 continue;
             }
+            // A lone #embed in a char array is kept as a single blob
+            if (cur_expr->type == EXPR_EMBED) {
+                cur_expr->etype = type;
+                len += cur_expr->embed.len - 1;
+                continue;
+            }
             if (cur_expr->type == EXPR_INIT_LIST) {
                 retval &= typecheck_init_list_helper(tcs, type->arr.base,
                                                      cur_expr);
@@ -309,7 +315,7 @@ expr_t *typecheck_canon_init_struct(tc_state_t *tcs, type_t *type,
     }
 
     if (expr == NULL) {
-        fmark_t *mark = NULL;
+        fmark_t mark = FMARK_NONE;
         if (vec_size(&new_vec) > 0) {
             expr_t *front = vec_front(&new_vec);
             if (front != NULL) {
@@ -346,6 +352,9 @@ expr_t *typecheck_canon_init_union(tc_state_t *tcs, type_t *type,
 
     expr_t *head = NULL;
     if (vec_iter_has_next(iter)) {
+        if (((expr_t *)vec_iter_get(iter))->type == EXPR_EMBED) {
+            typecheck_canon_expand_embed(tcs, iter);
+        }
         head = vec_iter_get(iter);
         vec_iter_advance(iter);
     }
@@ -388,7 +397,7 @@ expr_t *typecheck_canon_init_union(tc_state_t *tcs, type_t *type,
     }
 
     if (expr == NULL) {
-        fmark_t *mark = head == NULL ? NULL : head->mark;
+        fmark_t mark = head == NULL ? FMARK_NONE : head->mark;
         expr = ast_expr_create(tcs->tunit, mark, EXPR_INIT_LIST);
         vec_push_back(&expr->init_list.exprs, head);
     } else {
@@ -469,6 +478,21 @@ expr_t *typecheck_canon_init_arr(tc_state_t *tcs, type_t *type,
             break;
         }
 
+        // If an #embed is the only initializer of a char array, keep the
+        // bytes as one blob rather than creating an expression per byte
+        if (cur->type == EXPR_EMBED && expr != NULL && index == 0 &&
+            vec_size(iter->vec) == 1 &&
+            ast_type_unmod(elem_type)->type == TYPE_CHAR &&
+            (nelems == 0 || cur->embed.len <= nelems)) {
+            if (vec_size(&idx_map) == 0) {
+                vec_push_back(&idx_map, NULL);
+            }
+            vec_set(&idx_map, 0, cur);
+            vec_iter_advance(iter);
+            ++iters;
+            continue;
+        }
+
         if (index > max_idx) {
             max_idx = index;
         }
@@ -510,7 +534,7 @@ expr_t *typecheck_canon_init_arr(tc_state_t *tcs, type_t *type,
     vec_resize(&idx_map, max_idx + 1);
 
     if (expr == NULL) {
-        fmark_t *mark = NULL;
+        fmark_t mark = FMARK_NONE;
         if (vec_size(&idx_map) > 0) {
             expr_t *front = vec_front(&idx_map);
             if (front != NULL) {
@@ -550,6 +574,9 @@ expr_t *typecheck_canon_init_helper(tc_state_t *tcs, type_t *type,
         if (!vec_iter_has_next(iter)) {
             return NULL;
         }
+        if (((expr_t *)vec_iter_get(iter))->type == EXPR_EMBED) {
+            typecheck_canon_expand_embed(tcs, iter);
+        }
         expr_t *result = vec_iter_get(iter);
         vec_iter_advance(iter);
 
@@ -599,3 +626,26 @@ bool typecheck_canon_init(tc_state_t *tcs, type_t *type, expr_t *expr) {
 
     return result != NULL;
 }
+
+void typecheck_canon_expand_embed(tc_state_t *tcs, vec_iter_t *iter) {
+    expr_t *embed = vec_iter_get(iter);
+    assert(embed->type == EXPR_EMBED);
+    assert(embed->embed.len > 0);
+
+    // Make room for the bytes after the #embed, which they replace
+    size_t off = iter->off;
+    size_t old_size = vec_size(iter->vec);
+    size_t extra = embed->embed.len - 1;
+    vec_resize(iter->vec, old_size + extra);
+    void **elems = vec_elems(iter->vec);
+    memmove(elems + off + 1 + extra, elems + off + 1,
+            (old_size - off - 1) * sizeof(*elems));
+
+    for (size_t i = 0; i < embed->embed.len; ++i) {
+        expr_t *byte = ast_expr_create(tcs->tunit, embed->mark,
+                                       EXPR_CONST_INT);
+        byte->const_val.type = tt_int;
+        byte->const_val.int_val = (unsigned char)embed->embed.data[i];
+        vec_set(iter->vec, off + i, byte);
+    }
+}
@@ -41,4 +41,13 @@ expr_t *typecheck_canon_init_helper(tc_state_t *tcs, type_t *type,
 
 bool typecheck_canon_init(tc_state_t *tcs, type_t *type, expr_t *expr);
 
+/**
+ * Replaces the #embed expression at the iterator's position with one int
+ * constant per byte of the embedded file
+ *
+ * @param tcs Typechecker state
+ * @param iter Iterator pointing to an EXPR_EMBED
+ */
+void typecheck_canon_expand_embed(tc_state_t *tcs, vec_iter_t *iter);
+
 #endif /* _TYPECHECK_INIT_PRIV_H_ */
@@ -25,6 +25,9 @@
 
 #include "typecheck.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+
 #define TC_CONST true
 #define TC_NOCONST false
 
@@ -43,8 +46,34 @@ typedef struct tc_state_t {
     stmt_t *last_loop;
     stmt_t *last_break;
     bool ignore_undef;
+    vec_t lazy_fdefns; /*< Used functions whose bodies still need parsing */
+    size_t scope_limit; /*< File scope names from this point on are hidden */
+    vec_t implicit_calls; /*< (tc_implicit_t) Calls in later checked bodies */
 } tc_state_t;
 
+/**
+ * Call of an undeclared function in a body checked after the rest of the file.
+ * The function is declared once all bodies are checked, in the order the
+ * calls would have been checked in
+ */
+typedef struct tc_implicit_t {
+    gdecl_t *func;   /*< Function containing the call */
+    expr_t *call;    /*< The call */
+    size_t order;    /*< Order the calls were checked in */
+} tc_implicit_t;
+
+/**
+ * Thread parsing and checking deferred function bodies
+ */
+typedef struct tc_worker_t {
+    pthread_t thread;
+    tc_state_t tcs;
+    trans_unit_t tunit;    /*< Copy of the unit with its own node storage */
+    vec_t *bodies;         /*< Function definitions to parse */
+    atomic_size_t *next;   /*< Index of the next body to take */
+    bool retval;
+} tc_worker_t;
+
 /**
  * Initializes a type checker context
  *
@@ -59,6 +88,16 @@ void tc_state_init(tc_state_t *tcs);
  */
 void tc_state_destroy(tc_state_t *tcs);
 
+/**
+ * Returns true if a struct or union is not defined in the file scope the
+ * current function body is checked against
+ *
+ * @param tcs The typechecking state
+ * @param type The struct or union
+ * @return true if the type is incomplete, false otherwise
+ */
+bool typecheck_type_incomplete(tc_state_t *tcs, type_t *type);
+
 /**
  * Checks whether an expression is a suitable lvalue. The expression must be
  * typechecked first.
@@ -76,7 +115,7 @@ bool typecheck_expr_lvalue(tc_state_t *tcs, expr_t *expr);
  * @param from Type to assign from
  * @return true if the node typechecks, false otherwise
  */
-bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from);
+bool typecheck_type_assignable(fmark_t mark, type_t *to, type_t *from);
 
 /**
  * Returns true if types t1 and t2 can be combined with given binop
@@ -87,7 +126,7 @@ bool typecheck_type_assignable(fmark_t *mark, type_t *to, type_t *from);
  * @param t2 The second type
  * @return true if the node typechecks, false otherwise
  */
-bool typecheck_types_binop(fmark_t *mark, oper_t op, type_t *t1, type_t *t2);
+bool typecheck_types_binop(fmark_t mark, oper_t op, type_t *t1, type_t *t2);
 
 /**
  * Returns true if given unary op can be applied to given type
@@ -97,7 +136,7 @@ bool typecheck_types_binop(fmark_t *mark, oper_t op, type_t *t1, type_t *t2);
  * @param type The type
  * @return true if the node typechecks, false otherwise
  */
-bool typecheck_type_unaryop(fmark_t *mark, oper_t op, type_t *type);
+bool typecheck_type_unaryop(fmark_t mark, oper_t op, type_t *type);
 
 /**
  * Returns true if from can be cast to to.
@@ -107,7 +146,7 @@ bool typecheck_type_unaryop(fmark_t *mark, oper_t op, type_t *type);
  * @param from Type being casted from
  * @return true if the the cast can be completed, false otherwise
  */
-bool typecheck_type_cast(fmark_t *mark, type_t *to, type_t *from);
+bool typecheck_type_cast(fmark_t mark, type_t *to, type_t *from);
 
 /**
  * Returns true if type can be used in a conditional
@@ -116,7 +155,7 @@ bool typecheck_type_cast(fmark_t *mark, type_t *to, type_t *from);
  * @param type The type to check
  * @return true if the node typechecks, false otherwise
  */
-bool typecheck_type_conditional(fmark_t *mark, type_t *type);
+bool typecheck_type_conditional(fmark_t mark, type_t *type);
 
 /**
  * Returns true if type is integral, false otherwise
@@ -125,7 +164,7 @@ bool typecheck_type_conditional(fmark_t *mark, type_t *type);
  * @param type The type to check
  * @return true if the node typechecks, false otherwise
  */
-bool typecheck_type_integral(fmark_t *mark, type_t *type);
+bool typecheck_type_integral(fmark_t mark, type_t *type);
 
 bool typecheck_designator_list(tc_state_t *tcs, type_t *type,
                                designator_list_t *list);
@@ -184,6 +223,43 @@ bool typecheck_trans_unit(tc_state_t *tcs, trans_unit_t *trans_unit);
  */
 bool typecheck_gdecl(tc_state_t *tcs, gdecl_t *gdecl);
 
+/**
+ * Typechecks the body of a function definition whose declaration was already
+ * checked.
+ *
+ * @param tcs The typechecking state
+ * @param gdecl The function definition
+ * @return true if the node type checks, false otherwise
+ */
+bool typecheck_fdefn_body(tc_state_t *tcs, gdecl_t *gdecl);
+
+/**
+ * Declares the functions called without a declaration in bodies checked after
+ * the rest of the file, as if each body had been checked in place.
+ *
+ * @param tcs The typechecking state
+ * @return true if the declarations type check, false otherwise
+ */
+bool typecheck_implicit_calls(tc_state_t *tcs);
+
+/**
+ * Thread entry which parses and typechecks function bodies until none are left
+ *
+ * @param arg The tc_worker_t of the thread
+ * @return NULL
+ */
+void *typecheck_worker(void *arg);
+
+/**
+ * Parses and typechecks the function bodies deferred for -parse-jobs on a pool
+ * of threads. Their nodes are moved to the translation unit afterwards.
+ *
+ * @param tcs The typechecking state
+ * @param trans_unit Translation unit with the function definitions
+ * @return true if the bodies type check, false otherwise
+ */
+bool typecheck_parallel_bodies(tc_state_t *tcs, trans_unit_t *trans_unit);
+
 /**
  * Typechecks a stmt_t.
  *
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Bump pointer arena implementation
+ */
+
+#include "arena.h"
+
+#include <stdalign.h>
+
+#include "util/util.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk_t {
+    arena_chunk_t *next;
+    alignas(max_align_t) char data[];
+};
+
+void arena_init(arena_t *arena) {
+    arena->chunks = NULL;
+    arena->cur = NULL;
+    arena->end = NULL;
+}
+
+void arena_destroy(arena_t *arena) {
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena_init(arena);
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if ((size_t)(arena->end - arena->cur) >= size) {
+        void *result = arena->cur;
+        arena->cur += size;
+        return result;
+    }
+
+    // Oversized allocations get their own chunk behind the current one, so
+    // the rest of the current chunk can still be used
+    if (size > ARENA_CHUNK_SIZE / 4) {
+        arena_chunk_t *chunk = ecalloc(1, sizeof(*chunk) + size);
+        if (arena->chunks == NULL) {
+            arena->chunks = chunk;
+            chunk->next = NULL;
+        } else {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        }
+        return chunk->data;
+    }
+
+    arena_chunk_t *chunk = ecalloc(1, sizeof(*chunk) + ARENA_CHUNK_SIZE);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->cur = chunk->data + size;
+    arena->end = chunk->data + ARENA_CHUNK_SIZE;
+
+    return chunk->data;
+}
+
+void arena_merge(arena_t *dest, arena_t *src) {
+    if (src->chunks == NULL) {
+        return;
+    }
+
+    // Keep dest's current chunk at the front so it is still bumped from
+    arena_chunk_t *tail = src->chunks;
+    while (tail->next != NULL) {
+        tail = tail->next;
+    }
+    if (dest->chunks == NULL) {
+        dest->chunks = src->chunks;
+    } else {
+        tail->next = dest->chunks->next;
+        dest->chunks->next = src->chunks;
+    }
+    arena_init(src);
+}
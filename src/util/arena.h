@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Bump pointer arena interface
+ *
+ * Allocations are zeroed and live until the arena is destroyed, which frees
+ * every chunk at once.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+typedef struct arena_chunk_t arena_chunk_t;
+
+typedef struct arena_t {
+    arena_chunk_t *chunks; /**< Chunks, most recently allocated first */
+    char *cur;             /**< Next free byte in the current chunk */
+    char *end;             /**< End of the current chunk */
+} arena_t;
+
+void arena_init(arena_t *arena);
+
+void arena_destroy(arena_t *arena);
+
+/**
+ * Allocates zeroed, maximally aligned memory from an arena
+ *
+ * @param arena The arena to allocate from
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * Moves all of the chunks of one arena into another
+ *
+ * @param dest Arena to take ownership of the allocations
+ * @param src Arena to empty
+ */
+void arena_merge(arena_t *dest, arena_t *src);
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Block character scanning implementation
+ *
+ * When SSE2 is available, 16 bytes are classified at a time, with the
+ * remainder handled a character at a time.
+ */
+
+#include "char_scan.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#define SCAN_BLOCK_SIZE 16
+
+/** Bytes of v in the range [lo, hi]. Only valid for lo, hi < 0x80 */
+#define SCAN_RANGE(v, lo, hi)                                   \
+    _mm_and_si128(_mm_cmpgt_epi8((v), _mm_set1_epi8((lo) - 1)),  \
+                  _mm_cmplt_epi8((v), _mm_set1_epi8((hi) + 1)))
+
+#define SCAN_EQ(v, c) _mm_cmpeq_epi8((v), _mm_set1_epi8(c))
+
+#endif /* __SSE2__ */
+
+extern bool scan_is_hspace(int c);
+extern bool scan_is_id(int c);
+
+const char *scan_hspace(const char *p, const char *end) {
+#ifdef __SSE2__
+    while (end - p >= SCAN_BLOCK_SIZE) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(SCAN_EQ(v, ' '), SCAN_EQ(v, '\t'));
+        m = _mm_or_si128(m, SCAN_RANGE(v, '\v', '\r'));
+
+        unsigned miss = ~(unsigned)_mm_movemask_epi8(m) & 0xffff;
+        if (miss != 0) {
+            return p + __builtin_ctz(miss);
+        }
+        p += SCAN_BLOCK_SIZE;
+    }
+#endif /* __SSE2__ */
+
+    while (p < end && scan_is_hspace(*p)) {
+        ++p;
+    }
+
+    return p;
+}
+
+const char *scan_id(const char *p, const char *end) {
+#ifdef __SSE2__
+    while (end - p >= SCAN_BLOCK_SIZE) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+
+        // Setting bit 5 maps upper case letters onto lower case
+        __m128i m = SCAN_RANGE(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        m = _mm_or_si128(m, SCAN_RANGE(v, '0', '9'));
+        m = _mm_or_si128(m, SCAN_EQ(v, '_'));
+        m = _mm_or_si128(m, SCAN_EQ(v, '$'));
+
+        unsigned miss = ~(unsigned)_mm_movemask_epi8(m) & 0xffff;
+        if (miss != 0) {
+            return p + __builtin_ctz(miss);
+        }
+        p += SCAN_BLOCK_SIZE;
+    }
+#endif /* __SSE2__ */
+
+    while (p < end && scan_is_id(*p)) {
+        ++p;
+    }
+
+    return p;
+}
+
+const char *scan_group_text(const char *p, const char *end) {
+#ifdef __SSE2__
+    while (end - p >= SCAN_BLOCK_SIZE) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(SCAN_EQ(v, '\n'), SCAN_EQ(v, '/'));
+        m = _mm_or_si128(m, _mm_or_si128(SCAN_EQ(v, '"'), SCAN_EQ(v, '\'')));
+
+        unsigned hits = (unsigned)_mm_movemask_epi8(m);
+        if (hits != 0) {
+            return p + __builtin_ctz(hits);
+        }
+        p += SCAN_BLOCK_SIZE;
+    }
+#endif /* __SSE2__ */
+
+    for (; p < end; ++p) {
+        if (*p == '\n' || *p == '/' || *p == '"' || *p == '\'') {
+            break;
+        }
+    }
+
+    return p;
+}
+
+size_t scan_newlines(const char *p, const char *end, const char **last_nl) {
+    size_t count = 0;
+
+#ifdef __SSE2__
+    while (end - p >= SCAN_BLOCK_SIZE) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned hits = (unsigned)_mm_movemask_epi8(SCAN_EQ(v, '\n'));
+        if (hits != 0) {
+            count += __builtin_popcount(hits);
+            *last_nl = p + (31 - __builtin_clz(hits));
+        }
+        p += SCAN_BLOCK_SIZE;
+    }
+#endif /* __SSE2__ */
+
+    for (; p < end; ++p) {
+        if (*p == '\n') {
+            ++count;
+            *last_nl = p;
+        }
+    }
+
+    return count;
+}
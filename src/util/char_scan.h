@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2015 Bailey Forrest <baileycforrest@gmail.com>
+ *
+ * This file is part of CCC.
+ *
+ * CCC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CCC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CCC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Block character scanning interface
+ *
+ * Scans runs of characters of a given class a block at a time. Used by the
+ * lexer to skip over the bodies of tokens without fetching one character at a
+ * time.
+ */
+
+#ifndef _CHAR_SCAN_H_
+#define _CHAR_SCAN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Returns whether a character is horizontal whitespace, i.e. isspace(c) &&
+ * c != '\n'
+ *
+ * @param c The character to test
+ */
+inline bool scan_is_hspace(int c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/**
+ * Returns whether a character may appear in an identifier
+ *
+ * @param c The character to test
+ */
+inline bool scan_is_id(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || c == '_' || c == '$';
+}
+
+/**
+ * Skips a run of horizontal whitespace
+ *
+ * @param p Position to start scanning from
+ * @param end End of the buffer
+ * @return Pointer to first non horizontal whitespace character, or end
+ */
+const char *scan_hspace(const char *p, const char *end);
+
+/**
+ * Skips a run of identifier characters
+ *
+ * @param p Position to start scanning from
+ * @param end End of the buffer
+ * @return Pointer to first non identifier character, or end
+ */
+const char *scan_id(const char *p, const char *end);
+
+/**
+ * Skips characters of a line in an inactive conditional group which can't
+ * start a comment or literal or end the line
+ *
+ * @param p Position to start scanning from
+ * @param end End of the buffer
+ * @return Pointer to the first newline, quote or slash, or end
+ */
+const char *scan_group_text(const char *p, const char *end);
+
+/**
+ * Counts the newlines in a range
+ *
+ * @param p Position to start scanning from
+ * @param end End of range to scan
+ * @param last_nl Set to the last newline found. Unchanged if none are found
+ * @return The number of newlines in the range
+ */
+size_t scan_newlines(const char *p, const char *end, const char **last_nl);
+
+#endif /* _CHAR_SCAN_H_ */
@@ -24,9 +24,12 @@
 
 #include "file_directory.h"
 
+#include <assert.h>
+#include <limits.h>
 #include <stddef.h>
 #include <string.h>
 
+#include <dirent.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -48,12 +51,43 @@
  */
 static status_t fdir_entry_destroy(fdir_entry_t *entry);
 
+/**
+ * Cached path. Used both for files known to exist and for include resolutions
+ */
+typedef struct fdir_path_t {
+    sl_link_t link; /**< Table link */
+    char *key;      /**< Path, or include key */
+    char *path;     /**< Resolved path of an include, NULL if not found */
+} fdir_path_t;
+
 typedef struct fdir_t {
-    htable_t table;
+    htable_t table;    /**< char * -> fdir_entry_t */
+    htable_t files;    /**< fdir_id_t -> fdir_entry_t, first entry of a file */
+
+    /**
+     * char * -> fdir_path_t. Contains each listed directory, with a trailing
+     * slash, and every name in each of them
+     */
+    htable_t listing;
+    htable_t includes; /**< char * -> fdir_path_t include resolutions */
 } fdir_t;
 
 static fdir_t s_fdir;
 
+/** Buffer used for empty files, which mmap rejects */
+static char s_empty_file[1];
+
+uint32_t fdir_id_hash(const void *key) {
+    const fdir_id_t *id = key;
+    return (uint32_t)id->ino * 31 + (uint32_t)id->dev;
+}
+
+bool fdir_id_eq(const void *key1, const void *key2) {
+    const fdir_id_t *id1 = key1;
+    const fdir_id_t *id2 = key2;
+    return id1->dev == id2->dev && id1->ino == id2->ino;
+}
+
 void fdir_init(void) {
     static const ht_params_t s_params = {
         0,                                // No Size estimate
@@ -63,7 +97,52 @@ void fdir_init(void) {
         ind_str_eq,                       // void string compare
     };
 
+    static const ht_params_t s_id_params = {
+        0,                                // No Size estimate
+        offsetof(fdir_entry_t, id),       // Offset of key
+        offsetof(fdir_entry_t, id_link),  // Offset of ht link
+        fdir_id_hash,                     // Hash function
+        fdir_id_eq,                       // Identity compare
+    };
+
+    static const ht_params_t s_path_params = {
+        0,                               // No Size estimate
+        offsetof(fdir_path_t, key),      // Offset of key
+        offsetof(fdir_path_t, link),     // Offset of ht link
+        ind_str_hash,                    // Hash function
+        ind_str_eq,                      // void string compare
+    };
+
     ht_init(&s_fdir.table, &s_params);
+    ht_init(&s_fdir.files, &s_id_params);
+    ht_init(&s_fdir.listing, &s_path_params);
+    ht_init(&s_fdir.includes, &s_path_params);
+}
+
+/**
+ * Creates a cached path, with key and path stored in the same allocation
+ *
+ * @param key Key of the entry, len bytes long
+ * @param len Length of key
+ * @param path Resolved path, or NULL
+ */
+static fdir_path_t *fdir_path_create(const char *key, size_t len,
+                                     const char *path) {
+    size_t path_len = path == NULL ? 0 : strlen(path) + 1;
+    fdir_path_t *entry = emalloc(sizeof(*entry) + len + 1 + path_len);
+
+    entry->key = (char *)entry + sizeof(*entry);
+    memcpy(entry->key, key, len);
+    entry->key[len] = '\0';
+
+    if (path == NULL) {
+        entry->path = NULL;
+    } else {
+        entry->path = entry->key + len + 1;
+        memcpy(entry->path, path, path_len);
+    }
+
+    return entry;
 }
 
 static status_t fdir_entry_destroy(fdir_entry_t *entry) {
@@ -72,7 +151,9 @@ static status_t fdir_entry_destroy(fdir_entry_t *entry) {
         return status;
     }
 
-    if (entry->buf != MAP_FAILED &&
+    // Only the first entry of a file owns its buffer
+    if (entry->file == entry && entry->buf != MAP_FAILED &&
+        entry->buf != s_empty_file &&
         (-1 == munmap(entry->buf, (size_t)(entry->end - entry->buf)))) {
         status = CCC_FILEERR;
     }
@@ -86,7 +167,10 @@ static status_t fdir_entry_destroy(fdir_entry_t *entry) {
 }
 
 void fdir_destroy(void) {
+    ht_destroy(&s_fdir.files);
     HT_DESTROY_FUNC(&s_fdir.table, fdir_entry_destroy);
+    HT_DESTROY_FUNC(&s_fdir.listing, free);
+    HT_DESTROY_FUNC(&s_fdir.includes, free);
 }
 
 status_t fdir_insert(const char *filename, fdir_entry_t **result) {
@@ -102,6 +186,9 @@ status_t fdir_insert(const char *filename, fdir_entry_t **result) {
     // Initialize to safe values for destructor
     entry->buf = MAP_FAILED;
     entry->fd = -1;
+    entry->file = entry;
+    entry->guard_set = false;
+    entry->guard = NULL;
 
     entry->filename = sstore_lookup(filename);
 
@@ -117,16 +204,39 @@ status_t fdir_insert(const char *filename, fdir_entry_t **result) {
     }
     size_t size = st.st_size;
 
-    if (MAP_FAILED ==
+    // A file reached by another path is only read once
+    entry->id.dev = st.st_dev;
+    entry->id.ino = st.st_ino;
+    fdir_entry_t *file = ht_lookup(&s_fdir.files, &entry->id);
+    if (file != NULL) {
+        close(entry->fd);
+        entry->fd = -1;
+        entry->file = file;
+        entry->buf = file->buf;
+        entry->end = file->end;
+        entry->mark = file->mark;
+        if (CCC_OK != (status = ht_insert(&s_fdir.table, &entry->link))) {
+            goto fail;
+        }
+        goto done;
+    }
+
+    // Empty files can't be mapped
+    if (size == 0) {
+        entry->buf = s_empty_file;
+    } else if (MAP_FAILED ==
         (entry->buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, entry->fd, 0))) {
         status = CCC_FILEERR;
         goto fail;
     }
     entry->end = entry->buf + size;
+    entry->mark = fmark_register(entry->filename, entry->buf, entry->end);
 
     if (CCC_OK != (status = ht_insert(&s_fdir.table, &entry->link))) {
         goto fail;
     }
+    status = ht_insert(&s_fdir.files, &entry->id_link);
+    assert(status == CCC_OK);
 
 done:
     *result = entry;
@@ -140,3 +250,88 @@ fail:
 fdir_entry_t *fdir_lookup(const char *filename) {
     return ht_lookup(&s_fdir.table, &filename);
 }
+
+/**
+ * Adds the names in a directory to the listing cache
+ *
+ * @param dir Directory to list, with a trailing slash
+ * @param len Length of dir
+ */
+static void fdir_list(const char *dir, size_t len) {
+    char path[PATH_MAX + 1];
+    memcpy(path, dir, len);
+    path[len] = '\0';
+
+    // Directories which can't be opened are recorded as empty
+    fdir_path_t *entry = fdir_path_create(path, len, NULL);
+    status_t status = ht_insert(&s_fdir.listing, &entry->link);
+    assert(status == CCC_OK);
+
+    DIR *dirp = opendir(path);
+    if (dirp == NULL) {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dirp)) != NULL) {
+        size_t name_len = strlen(ent->d_name);
+        if (len + name_len > PATH_MAX) {
+            continue;
+        }
+        memcpy(path + len, ent->d_name, name_len + 1);
+
+        if (ht_lookup(&s_fdir.listing, &(const char *){ path }) == NULL) {
+            entry = fdir_path_create(path, len + name_len, NULL);
+            status = ht_insert(&s_fdir.listing, &entry->link);
+            assert(status == CCC_OK);
+        }
+    }
+
+    closedir(dirp);
+}
+
+bool fdir_exists(const char *path) {
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL || slash - path >= PATH_MAX) {
+        return access(path, R_OK) == 0;
+    }
+
+    char dir[PATH_MAX + 1];
+    size_t len = slash - path + 1;
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+
+    if (ht_lookup(&s_fdir.listing, &(const char *){ dir }) == NULL) {
+        fdir_list(dir, len);
+    }
+
+    // The listing may include directories and unreadable files
+    return ht_lookup(&s_fdir.listing, &path) != NULL &&
+        access(path, R_OK) == 0;
+}
+
+bool fdir_include_lookup(const char *key, char **result) {
+    fdir_path_t *entry = ht_lookup(&s_fdir.includes, &key);
+    if (entry == NULL) {
+        return false;
+    }
+
+    *result = entry->path;
+    return true;
+}
+
+void fdir_include_insert(const char *key, const char *path) {
+    fdir_path_t *entry = fdir_path_create(key, strlen(key), path);
+    status_t status = ht_insert(&s_fdir.includes, &entry->link);
+    assert(status == CCC_OK);
+}
+
+void fdir_include_key(string_builder_t *sb, const char *file_dir,
+                      const char *filename, bool bracket) {
+    sb_clear(sb);
+    if (bracket) {
+        sb_append_printf(sb, "<%s", filename);
+    } else {
+        sb_append_printf(sb, "%s\"%s", file_dir, filename);
+    }
+}
@@ -23,21 +23,59 @@
 #ifndef _FILE_DIRECTORY_H_
 #define _FILE_DIRECTORY_H_
 
+#include <sys/types.h>
+
+#include "util/file_mark.h"
+#include "util/string_builder.h"
 #include "util/util.h"
 
+/**
+ * Identity of a file, the same for every path naming it
+ */
+typedef struct fdir_id_t {
+    dev_t dev; /**< Device containing the file */
+    ino_t ino; /**< Inode of the file */
+} fdir_id_t;
+
 /**
  * File directory entry.
  *
- * Contains a filename and buffer of file contents
+ * Contains a filename and buffer of file contents. There is an entry for each
+ * path a file is opened by. Paths naming a file which is already open share
+ * the first entry's buffer, and refer to that entry as file.
  */
 typedef struct fdir_entry_t {
-    sl_link_t link; /**< List link */
-    char *filename; /**< Filename */
-    char *buf;      /**< Buffer of file */
-    char *end;      /**< Max location */
-    int fd;         /**< File descriptor of open file */
+    sl_link_t link;    /**< List link */
+    sl_link_t id_link; /**< Link in the table of files by identity */
+    char *filename;    /**< Filename */
+    char *buf;         /**< Buffer of file */
+    char *end;         /**< Max location */
+    fmark_t mark;      /**< Mark of start of buffer */
+    int fd;            /**< File descriptor of open file */
+    fdir_id_t id;      /**< Identity of the file */
+    struct fdir_entry_t *file; /**< First entry of the file, may be itself */
+
+    // Multiple include optimization, recorded by the preprocessor in file
+    bool guard_set; /**< guard has been determined */
+    char *guard;    /**< Include guard macro. NULL if file has none */
 } fdir_entry_t;
 
+/**
+ * Hash function for tables keyed by fdir_id_t
+ *
+ * @param key The fdir_id_t to hash
+ */
+uint32_t fdir_id_hash(const void *key);
+
+/**
+ * Compares two fdir_id_t, for tables keyed by them
+ *
+ * @param key1 First identity
+ * @param key2 Second identity
+ * @return true if they identify the same file
+ */
+bool fdir_id_eq(const void *key1, const void *key2);
+
 /**
  * Initializes the file directiory
  */
@@ -50,6 +88,8 @@ void fdir_destroy(void);
 
 /**
  * Add a file to the file directory. Returns the current entry if it exists.
+ * If the file is already open under another path, the new entry shares its
+ * buffer.
  *
  * @param filename Name of the file to add. Note that this function will
  *     reallocate its own copy of the same string.
@@ -70,4 +110,45 @@ status_t fdir_insert(const char *filename, fdir_entry_t **result);
  */
 fdir_entry_t *fdir_lookup(const char *filename);
 
+/**
+ * Checks whether a file exists and is readable. The directory containing the
+ * file is listed once and cached, so looking up names which don't exist
+ * doesn't touch the filesystem.
+ *
+ * @param path Path of the file to check
+ * @return true if the file exists and is readable, false otherwise
+ */
+bool fdir_exists(const char *path);
+
+/**
+ * Looks up a memoized include resolution
+ *
+ * @param key Key identifying the include, see fdir_include_key
+ * @param result Location to store the resolved path. Set to NULL if the
+ *     include was previously not found
+ * @return true if the include has been resolved before, false otherwise
+ */
+bool fdir_include_lookup(const char *key, char **result);
+
+/**
+ * Memoizes the resolution of an include
+ *
+ * @param key Key identifying the include, see fdir_include_key
+ * @param path Resolved path of the include, or NULL if it wasn't found. A copy
+ *     is stored
+ */
+void fdir_include_insert(const char *key, const char *path);
+
+/**
+ * Builds the key for an include. Includes with brackets don't depend on the
+ * directory of the including file.
+ *
+ * @param sb String builder to store the key in. Must be initialized
+ * @param file_dir Directory of the including file
+ * @param filename Name of the include as spelled
+ * @param bracket true if the include used brackets
+ */
+void fdir_include_key(string_builder_t *sb, const char *file_dir,
+                      const char *filename, bool bracket);
+
 #endif /* _FILE_DIRECTORY_H_ */
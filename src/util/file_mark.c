@@ -18,41 +18,197 @@
  */
 /**
  * File mark implementation
+ *
+ * Buffers are kept in order of their first mark, so the buffer containing a
+ * mark is found with a binary search. Each buffer's line index is built the
+ * first time a line number in it is needed.
  */
 
 #include "file_mark.h"
 
+#include <assert.h>
+#include <string.h>
+
+#include "util/char_scan.h"
 #include "util/util.h"
+#include "util/vector.h"
+
+/**
+ * A buffer registered with the mark table
+ */
+typedef struct fmark_buf_t {
+    fmark_t base;          /**< Mark of the start of the buffer */
+    uint32_t len;          /**< Length of the buffer */
+    char *filename;        /**< Filename */
+    const char *start;     /**< Start of the buffer */
+    int first;             /**< Number of the first line and column */
+    uint32_t *lines;       /**< Offsets of line starts. NULL until needed */
+    size_t nlines;         /**< Number of lines */
+} fmark_buf_t;
+
+#define FMARK_BUF_LIT(base, filename, start, first) \
+    { base, 0, filename, start, first, NULL, 0 }
+
+/**
+ * Buffers for marks which are not in any source file
+ */
+static fmark_buf_t s_none_buf = FMARK_BUF_LIT(FMARK_NONE, NULL, NULL, 0);
+static fmark_buf_t s_built_in_buf =
+    FMARK_BUF_LIT(FMARK_BUILT_IN, BUILT_IN_FILENAME, BUILT_IN_FILENAME, 1);
+static fmark_buf_t s_prim_type_buf =
+    FMARK_BUF_LIT(FMARK_PRIM_TYPE, PRIM_TYPE_FILENAME, PRIM_TYPE_FILENAME, 0);
+
+typedef struct fmark_table_t {
+    vec_t bufs;         /**< Registered buffers, in order of base */
+    fmark_t next;       /**< Next unused mark */
+    fmark_buf_t *last;  /**< Buffer of the last lookup */
+} fmark_table_t;
+
+static fmark_table_t s_fmark;
+
+/**
+ * Finds the buffer containing a mark
+ *
+ * @param mark The mark to look up
+ * @return The buffer containing mark
+ */
+static fmark_buf_t *fmark_lookup(fmark_t mark);
+
+/**
+ * Returns the index of the line containing an offset in a buffer, building the
+ * buffer's line index if necessary
+ *
+ * @param buf The buffer to search
+ * @param offset Offset into the buffer
+ * @return Index of the line containing offset
+ */
+static size_t fmark_buf_line(fmark_buf_t *buf, uint32_t offset);
+
+void fmark_init(void) {
+    vec_init(&s_fmark.bufs, 0);
+    vec_push_back(&s_fmark.bufs, &s_none_buf);
+    vec_push_back(&s_fmark.bufs, &s_built_in_buf);
+    vec_push_back(&s_fmark.bufs, &s_prim_type_buf);
+    s_fmark.next = FMARK_PRIM_TYPE + 1;
+    s_fmark.last = &s_none_buf;
+}
 
-fmark_t fmark_built_in =
-    FMARK_LIT(NULL, BUILT_IN_FILENAME, BUILT_IN_FILENAME, 1, 1);
+void fmark_destroy(void) {
+    VEC_FOREACH(cur, &s_fmark.bufs) {
+        fmark_buf_t *buf = vec_get(&s_fmark.bufs, cur);
+        free(buf->lines);
+        buf->lines = NULL;
+        if (buf->base > FMARK_PRIM_TYPE) {
+            free(buf);
+        }
+    }
+    vec_destroy(&s_fmark.bufs);
+}
+
+fmark_t fmark_register(char *filename, const char *start, const char *end) {
+    size_t len = end - start;
+    if (len >= UINT32_MAX - s_fmark.next) {
+        exit_err("source location space exhausted");
+    }
 
-#define FMARK_NUM_NODES 256
+    fmark_buf_t *buf = emalloc(sizeof(fmark_buf_t));
+    buf->base = s_fmark.next;
+    buf->len = len;
+    buf->filename = filename;
+    buf->start = start;
+    buf->first = 1;
+    buf->lines = NULL;
+    buf->nlines = 0;
 
-typedef struct fmark_node_t {
-    sl_link_t link;
-    fmark_t marks[FMARK_NUM_NODES];
-} fmark_node_t;
+    // One extra mark for the end of the buffer
+    s_fmark.next += len + 1;
+    vec_push_back(&s_fmark.bufs, buf);
 
-void fmark_man_init(fmark_man_t *man) {
-    sl_init(&man->list, offsetof(fmark_node_t, link));
-    man->offset = FMARK_NUM_NODES;
+    return buf->base;
 }
 
-void fmark_man_destroy(fmark_man_t *man) {
-    SL_DESTROY_FUNC(&man->list, free);
-    man->offset = 0;
+static fmark_buf_t *fmark_lookup(fmark_t mark) {
+    fmark_buf_t *buf = s_fmark.last;
+    if (mark >= buf->base && mark <= buf->base + buf->len) {
+        return buf;
+    }
+
+    size_t lo = 0;
+    size_t hi = vec_size(&s_fmark.bufs);
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        fmark_buf_t *cur = vec_get(&s_fmark.bufs, mid);
+        if (cur->base <= mark) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    buf = vec_get(&s_fmark.bufs, lo);
+    assert(mark <= buf->base + buf->len);
+    s_fmark.last = buf;
+
+    return buf;
 }
 
-fmark_t *fmark_man_insert(fmark_man_t *man, fmark_t *copy_from) {
-    if (man->offset == FMARK_NUM_NODES) {
-        fmark_node_t *node = emalloc(sizeof(fmark_node_t));
-        man->offset = 0;
-        sl_append(&man->list, &node->link);
+static size_t fmark_buf_line(fmark_buf_t *buf, uint32_t offset) {
+    if (buf->lines == NULL) {
+        const char *end = buf->start + buf->len;
+        const char *last_nl;
+        buf->nlines = scan_newlines(buf->start, end, &last_nl) + 1;
+        buf->lines = emalloc(buf->nlines * sizeof(*buf->lines));
+
+        buf->lines[0] = 0;
+        const char *cur = buf->start;
+        for (size_t i = 1; i < buf->nlines; ++i) {
+            cur = memchr(cur, '\n', end - cur);
+            buf->lines[i] = ++cur - buf->start;
+        }
     }
 
-    fmark_node_t *tail = sl_tail(&man->list);
-    memcpy(&tail->marks[man->offset], copy_from, sizeof(fmark_t));
+    size_t lo = 0;
+    size_t hi = buf->nlines;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (buf->lines[mid] <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+void fmark_decode(fmark_t mark, fmark_loc_t *loc) {
+    assert(mark != FMARK_NONE);
+    fmark_buf_t *buf = fmark_lookup(mark);
+    uint32_t offset = mark - buf->base;
+    size_t line = fmark_buf_line(buf, offset);
+
+    loc->filename = buf->filename;
+    loc->line_start = buf->start + buf->lines[line];
+    loc->line = line + buf->first;
+    loc->col = offset - buf->lines[line] + buf->first;
+}
+
+char *fmark_filename(fmark_t mark) {
+    assert(mark != FMARK_NONE);
+    return fmark_lookup(mark)->filename;
+}
+
+int fmark_line(fmark_t mark) {
+    fmark_loc_t loc;
+    fmark_decode(mark, &loc);
+    return loc.line;
+}
+
+fmark_t fmark_buffer(fmark_t mark, const char **start, size_t *len) {
+    assert(mark > FMARK_PRIM_TYPE);
+    fmark_buf_t *buf = fmark_lookup(mark);
+    *start = buf->start;
+    *len = buf->len;
 
-    return &tail->marks[man->offset++];
+    return buf->base;
 }
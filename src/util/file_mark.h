@@ -18,58 +18,117 @@
  */
 /**
  * File mark interface
+ *
+ * A file mark is a 32 bit offset into a global table of registered source
+ * buffers. Every buffer is given a range of marks, one for each of its
+ * characters plus one for its end. The file name, line and column of a mark are
+ * only computed when they are requested.
  */
 
 #ifndef _FILE_MARK_H_
 #define _FILE_MARK_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
-#include "util/slist.h"
+/**
+ * Location in a registered buffer
+ */
+typedef uint32_t fmark_t;
 
 /**
- * Structure for representing a location in a file
+ * Structure for representing a decoded location in a file
  */
-typedef struct fmark_t {
-    struct fmark_t *last;   /**< Last mark in stack */
+typedef struct fmark_loc_t {
     char *filename;         /**< Filename */
     const char *line_start; /**< Start of current line */
     int line;               /**< Line number */
     int col;                /**< Column number */
-} fmark_t;
+} fmark_loc_t;
 
 /**
  * Name of "file" for built in objects
  */
 #define BUILT_IN_FILENAME "<built in>"
 
+/**
+ * Name of "file" for primitive types
+ */
+#define PRIM_TYPE_FILENAME "<primitive_type>"
+
 /**
  * Name of "file" for command line
  */
 #define COMMAND_LINE_FILENAME "<command-line>"
 
 /**
- * File mark literal
+ * Mark for no location
+ */
+#define FMARK_NONE ((fmark_t)0)
+
+/**
+ * Mark for built in objects
+ */
+#define FMARK_BUILT_IN ((fmark_t)1)
+
+/**
+ * Mark for primitive types
+ */
+#define FMARK_PRIM_TYPE ((fmark_t)2)
+
+/**
+ * Initializes the file mark table
+ */
+void fmark_init(void);
+
+/**
+ * Destroys the file mark table, freeing its memory
+ */
+void fmark_destroy(void);
+
+/**
+ * Registers a buffer with the file mark table. The buffer must remain valid
+ * until the table is destroyed.
  *
- * @param file Filename
- * @param line_start Pointer to start of current line
- * @param last Last file mark on stack
- * @param line Current line number
- * @param col Current column number
+ * @param filename Name of the file the buffer is from
+ * @param start Start of the buffer
+ * @param end End of the buffer
+ * @return Mark of the start of the buffer
  */
-#define FMARK_LIT(last, file, line_start, line, col) \
-    { last, file, line_start, line, col }
+fmark_t fmark_register(char *filename, const char *start, const char *end);
 
-extern fmark_t fmark_built_in;
+/**
+ * Decodes a mark into its file name, line and column
+ *
+ * @param mark The mark to decode. Must not be FMARK_NONE
+ * @param loc Location to store the result
+ */
+void fmark_decode(fmark_t mark, fmark_loc_t *loc);
 
-typedef struct fmark_man_t {
-    slist_t list;
-    size_t offset;
-} fmark_man_t;
+/**
+ * Returns the name of the file a mark is in
+ *
+ * @param mark The mark to look up. Must not be FMARK_NONE
+ * @return The file name
+ */
+char *fmark_filename(fmark_t mark);
 
-void fmark_man_init(fmark_man_t *man);
-void fmark_man_destroy(fmark_man_t *man);
+/**
+ * Returns the line number of a mark
+ *
+ * @param mark The mark to look up. Must not be FMARK_NONE
+ * @return The line number
+ */
+int fmark_line(fmark_t mark);
 
-fmark_t *fmark_man_insert(fmark_man_t *man, fmark_t *copy_from);
+/**
+ * Returns the buffer containing a mark
+ *
+ * @param mark The mark to look up. Must be in a registered buffer
+ * @param start Location to store the start of the buffer
+ * @param len Location to store the length of the buffer
+ * @return Mark of the start of the buffer
+ */
+fmark_t fmark_buffer(fmark_t mark, const char **start, size_t *len);
 
 #endif /* _FILE_MARK_H_ */
@@ -24,15 +24,16 @@
 
 #include "logger.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdarg.h>
 
 #include "top/optman.h"
 
-void logger_log_line(fmark_t *mark);
+void logger_log_line(fmark_loc_t *loc);
 
 
-char *log_function = NULL;
+_Thread_local char *log_function = NULL;
 
 typedef struct logger_t {
     bool has_error;
@@ -41,34 +42,38 @@ typedef struct logger_t {
 
 static logger_t logger;
 
+// Serializes messages from threads checking function bodies
+static pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 void logger_init(void) {
     logger.has_error = false;
     logger.has_warning = false;
 }
 
-void logger_log_line(fmark_t *mark) {
-    if (mark->line_start == NULL) {
+void logger_log_line(fmark_loc_t *loc) {
+    if (loc->line_start == NULL) {
         return;
     }
     // Print the line
-    for (const char *c = mark->line_start; *c && *c != '\n'; ++c) {
+    for (const char *c = loc->line_start; *c && *c != '\n'; ++c) {
         fputc(*c, stderr);
     }
     fputc('\n', stderr);
 
     // Print the error marker
-    for (int i = 1; i < mark->col - 1; ++i) {
+    for (int i = 1; i < loc->col - 1; ++i) {
         fputc(' ', stderr);
     }
     fputc('^', stderr);
     fputc('\n', stderr);
 }
 
-void logger_log(fmark_t *mark, log_type_t type, const char *fmt, ...) {
+void logger_log(fmark_t mark, log_type_t type, const char *fmt, ...) {
     char *header;
 
     va_list ap;
     va_start(ap, fmt);
+    pthread_mutex_lock(&logger_mutex);
 
     switch (type) {
     case LOG_ERR:
@@ -86,33 +91,30 @@ void logger_log(fmark_t *mark, log_type_t type, const char *fmt, ...) {
         break;
     }
 
-    if (mark == NULL) {
+    if (mark == FMARK_NONE) {
         fprintf(stderr, "%s: %s ", optman.exec_name, header);
         vfprintf(stderr, fmt, ap);
         fprintf(stderr, "\n");
         goto done;
     }
 
+    fmark_loc_t loc;
+    fmark_decode(mark, &loc);
+
     static char *last_func = NULL;
     if (log_function != NULL && last_func != log_function) {
-        fprintf(stderr, "%s: In function '%s':\n", mark->filename,
+        fprintf(stderr, "%s: In function '%s':\n", loc.filename,
                 log_function);
         last_func = log_function;
     }
 
-    fprintf(stderr, "%s:%d:%d %s ", mark->filename, mark->line, mark->col,
-            header);
+    fprintf(stderr, "%s:%d:%d %s ", loc.filename, loc.line, loc.col, header);
     vfprintf(stderr, fmt, ap);
     fprintf(stderr, "\n");
-    logger_log_line(mark);
-
-    for (fmark_t *cur = mark->last; cur != NULL; cur = cur->last) {
-        fprintf(stderr, "%s:%d:%d note: %s\n", cur->filename, cur->line,
-                cur->col, "In expansion of macro");
-        logger_log_line(cur);
-    }
+    logger_log_line(&loc);
 
 done:
+    pthread_mutex_unlock(&logger_mutex);
     va_end(ap);
     return;
 }
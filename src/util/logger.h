@@ -37,11 +37,11 @@ typedef enum log_type_t {
 } log_type_t;
 
 /**
- * Name of current function
+ * Name of current function, per thread
  *
  * NULL if none
  */
-extern char *log_function;
+extern _Thread_local char *log_function;
 
 /**
  * Initializes logger
@@ -49,12 +49,12 @@ extern char *log_function;
 void logger_init(void);
 
 /**
- * Log a message
+ * Log a message. May be called from multiple threads
  *
- * @param mark File mark to log from
+ * @param mark File mark to log from. FMARK_NONE if none
  * @param type Type of log
  */
-void logger_log(fmark_t *mark, log_type_t type, const char *fmt, ...);
+void logger_log(fmark_t mark, log_type_t type, const char *fmt, ...);
 
 /**
  * @return Returns true if an error message has been logged
@@ -100,7 +100,14 @@ bool sl_remove(slist_t *slist, sl_link_t *link) {
 }
 
 void sl_concat_front(slist_t *list1, slist_t *list2) {
-    list2->tail->next = list1->head;
+    if (list2->head == NULL) {
+        return;
+    }
+    if (list1->head == NULL) {
+        list1->tail = list2->tail;
+    } else {
+        list2->tail->next = list1->head;
+    }
     list1->head = list2->head;
 
     list2->head = NULL;
@@ -23,6 +23,7 @@
 #include "string_builder.h"
 
 #include <stdarg.h>
+#include <string.h>
 
 #include "util/util.h"
 
@@ -73,6 +74,17 @@ void sb_append_char(string_builder_t *sb, char val) {
     sb->buf[sb->len] = '\0';
 }
 
+void sb_append_len(string_builder_t *sb, const char *str, size_t len) {
+    if (sb->len + len > sb->capacity) {
+        size_t capacity = GROWTH_FUNC(sb->capacity);
+        sb_reserve(sb, capacity > sb->len + len ? capacity : sb->len + len);
+    }
+
+    memcpy(sb->buf + sb->len, str, len);
+    sb->len += len;
+    sb->buf[sb->len] = '\0';
+}
+
 void sb_append_printf(string_builder_t *sb, char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
@@ -52,6 +52,8 @@ void sb_clear(string_builder_t *sb);
 
 void sb_append_char(string_builder_t *sb, char val);
 
+void sb_append_len(string_builder_t *sb, const char *str, size_t len);
+
 void sb_append_printf(string_builder_t *sb, char *fmt, ...);
 
 void sb_append_vprintf(string_builder_t *sb, char *fmt, va_list ap);
@@ -33,7 +33,7 @@ typedef struct sstore_t {
 
 typedef struct sstore_entry_t {
     sl_link_t link;
-    char *str;
+    len_str_t key;
     bool free_string;
 } sstore_entry_t;
 
@@ -42,10 +42,10 @@ sstore_t strings;
 void sstore_init(void) {
     static const ht_params_t ht_params = {
         0,                              // Size estimate
-        offsetof(sstore_entry_t, str),  // Offset of key
+        offsetof(sstore_entry_t, key),  // Offset of key
         offsetof(sstore_entry_t, link), // Offset of ht link
-        ind_str_hash,                   // Hash function
-        ind_str_eq,                     // void string compare
+        len_str_hash,                   // Hash function
+        len_str_eq,                     // void string compare
     };
 
     ht_init(&strings.table, &ht_params);
@@ -53,7 +53,7 @@ void sstore_init(void) {
 
 void sstore_entry_destroy(sstore_entry_t *entry) {
     if (entry->free_string) {
-        free(entry->str);
+        free((char *)entry->key.str);
     }
     free(entry);
 }
@@ -63,31 +63,46 @@ void sstore_destroy(void) {
 }
 
 char *sstore_lookup(const char *str) {
-    sstore_entry_t *node = ht_lookup(&strings.table, &str);
+    size_t len = strlen(str);
+    len_str_t key = { str, len, strn_hash(str, len) };
+
+    return sstore_lookup_len(&key);
+}
+
+char *sstore_lookup_len(const len_str_t *key) {
+    sstore_entry_t *node = ht_lookup(&strings.table, key);
     if (node != NULL) {
-        return node->str;
+        return (char *)node->key.str;
     }
 
-    node = emalloc(sizeof(*node) + strlen(str) + 1);
-    node->str = (char *)node + sizeof(*node);
+    node = emalloc(sizeof(*node) + key->len + 1);
+    char *str = (char *)node + sizeof(*node);
+    memcpy(str, key->str, key->len);
+    str[key->len] = '\0';
+
+    node->key.str = str;
+    node->key.len = key->len;
+    node->key.hash = key->hash;
     node->free_string = false;
-    strcpy(node->str, str);
 
     status_t status = ht_insert(&strings.table, &node->link);
     assert(status == CCC_OK);
 
-    return node->str;
+    return str;
 }
 
 char *sstore_insert(char *str) {
-    sstore_entry_t *node = ht_lookup(&strings.table, &str);
+    size_t len = strlen(str);
+    len_str_t key = { str, len, strn_hash(str, len) };
+
+    sstore_entry_t *node = ht_lookup(&strings.table, &key);
     if (node != NULL) {
         free(str);
-        return node->str;
+        return (char *)node->key.str;
     }
 
     node = emalloc(sizeof(*node));
-    node->str = str;
+    node->key = key;
     node->free_string = true;
 
     status_t status = ht_insert(&strings.table, &node->link);
@@ -23,10 +23,22 @@
 #ifndef _STRING_STORE_H_
 #define _STRING_STORE_H_
 
+#include "util/util.h"
+
 void sstore_init(void);
 void sstore_destroy(void);
 
 char *sstore_lookup(const char *str);
+
+/**
+ * Looks up a string which may not be null terminated, adding a null terminated
+ * copy if it does not exist
+ *
+ * @param key The string to look up. Its hash must be set
+ * @return The stored string
+ */
+char *sstore_lookup_len(const len_str_t *key);
+
 char *sstore_insert(char *str);
 
 #endif /* _STRING_STORE_H_ */
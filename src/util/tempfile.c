@@ -69,7 +69,7 @@ tempfile_t *tempfile_create(char *path, char *ext) {
     return tf;
 
 fail:
-    logger_log(NULL, LOG_ERR, "Failed to create tempfile: %s", strerror(errno));
+    logger_log(FMARK_NONE, LOG_ERR, "Failed to create tempfile: %s", strerror(errno));
     tempfile_destroy(tf);
     return NULL;
 }
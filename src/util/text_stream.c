@@ -24,60 +24,23 @@
 
 #include <assert.h>
 
-int ts_peek(tstream_t *ts) {
-    if (ts->last != EOF) {
-        return ts->last;
-    }
-
-    if (ts->cur == ts->end) {
-        return EOF;
-    }
-
-    return *ts->cur;
-}
-
-char *ts_pos(tstream_t *ts) {
-    if (ts->last != EOF) {
-        return ts->cur - 1;
-    }
-
-    return ts->cur;
-}
-
-void ts_init(tstream_t *ts, char *start, char *end, char *file, fmark_t *last) {
+extern fmark_t ts_mark(tstream_t *ts);
+extern int ts_peek(tstream_t *ts);
+extern char *ts_pos(tstream_t *ts);
+extern int ts_getc(tstream_t *ts);
+extern void ts_ungetc(int c, tstream_t *ts);
+extern char *ts_splice(tstream_t *ts);
+extern void ts_skip(tstream_t *ts, char *pos);
+
+void ts_init(tstream_t *ts, char *start, char *end, fmark_t mark) {
     assert(ts != NULL);
     ts->cur = start;
     ts->end = end;
-    ts->mark.filename = file;
-    ts->mark.line_start = start;
-    ts->mark.last = last;
-    ts->mark.line = 1;
-    ts->mark.col = 1;
-    ts->last = EOF;
-}
-
-int ts_getc(tstream_t *ts) {
-    if (ts->last != EOF) {
-        int retval = ts->last;
-        ts->last = EOF;
-        return retval;
-    }
-
-    if (ts->cur == ts->end) {
-        return EOF;
-    }
-
-    if (*ts->cur == '\n') {
-        ts->mark.line++;
-        ts->mark.col = 1;
-        ts->mark.line_start = ts->cur + 1;
-    } else {
-        ts->mark.col++;
+    ts->splice = memchr(start, '\\', end - start);
+    if (ts->splice == NULL) {
+        ts->splice = end;
     }
-
-    return *(ts->cur++);
-}
-
-void ts_ungetc(int c, tstream_t *ts) {
-    ts->last = c;
+    ts->start = start;
+    ts->mark = mark;
+    ts->last = EOF;
 }
@@ -26,8 +26,10 @@
 #ifndef _TEXT_STREAM_H_
 #define _TEXT_STREAM_H_
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "util/file_mark.h"
 
@@ -38,7 +40,9 @@
 typedef struct tstream_t {
     char *cur;
     char *end;
-    fmark_t mark; /**< Mark of current location in the stream */
+    char *splice; /**< Next backslash at or after cur, or end */
+    char *start;  /**< Start of the stream */
+    fmark_t mark; /**< Mark of start of the stream */
     int last;
 } tstream_t;
 
@@ -46,12 +50,41 @@ typedef struct tstream_t {
  * Initializes a text stream
  *
  * @param ts Text stream to initalize
+ * @param start Start of the stream
+ * @param end End of the stream
+ * @param mark Mark of start. Must be registered to the range [start, end]
  */
-void ts_init(tstream_t *ts, char *start, char *end, char *file, fmark_t *last);
+void ts_init(tstream_t *ts, char *start, char *end, fmark_t mark);
 
-int ts_peek(tstream_t *ts);
+/**
+ * Returns the mark of the current location in the stream
+ *
+ * @param ts Text stream to get the mark of
+ * @return The mark
+ */
+inline fmark_t ts_mark(tstream_t *ts) {
+    return ts->mark + (fmark_t)(ts->cur - ts->start);
+}
+
+inline int ts_peek(tstream_t *ts) {
+    if (ts->last != EOF) {
+        return ts->last;
+    }
+
+    if (ts->cur == ts->end) {
+        return EOF;
+    }
 
-char *ts_pos(tstream_t *ts);
+    return *ts->cur;
+}
+
+inline char *ts_pos(tstream_t *ts) {
+    if (ts->last != EOF) {
+        return ts->cur - 1;
+    }
+
+    return ts->cur;
+}
 
 /**
  * Retrieves a character from the text stream
@@ -59,7 +92,19 @@ char *ts_pos(tstream_t *ts);
  * @param ts Text stream to fetch from
  * @return the next character
  */
-int ts_getc(tstream_t *ts);
+inline int ts_getc(tstream_t *ts) {
+    if (ts->last != EOF) {
+        int retval = ts->last;
+        ts->last = EOF;
+        return retval;
+    }
+
+    if (ts->cur == ts->end) {
+        return EOF;
+    }
+
+    return *(ts->cur++);
+}
 
 /**
  * Returns a character to the text stream
@@ -67,6 +112,39 @@ int ts_getc(tstream_t *ts);
  * @param ts Text stream to fetch from
  * @return the next character
  */
-void ts_ungetc(int c, tstream_t *ts);
+inline void ts_ungetc(int c, tstream_t *ts) {
+    ts->last = c;
+}
+
+/**
+ * Returns the position of the next backslash in the stream, or the end of the
+ * stream. Characters before this position cannot be part of a line splice.
+ *
+ * @param ts Text stream to search
+ * @return Pointer to the next backslash, or end
+ */
+inline char *ts_splice(tstream_t *ts) {
+    if (ts->splice < ts->cur) {
+        ts->splice = memchr(ts->cur, '\\', ts->end - ts->cur);
+        if (ts->splice == NULL) {
+            ts->splice = ts->end;
+        }
+    }
+
+    return ts->splice;
+}
+
+/**
+ * Consumes all characters up to a position in the stream. The stream must not
+ * have a returned character.
+ *
+ * @param ts Text stream to advance
+ * @param pos Position to advance to. Must be between cur and end
+ */
+inline void ts_skip(tstream_t *ts, char *pos) {
+    assert(ts->last == EOF);
+    assert(pos >= ts->cur && pos <= ts->end);
+    ts->cur = pos;
+}
 
 #endif /* _TEXT_STREAM_H_ */
@@ -39,11 +39,12 @@
 
 extern uint32_t ind_str_hash(const void *vstr);
 extern bool ind_str_eq(const void *vstr1, const void *vstr2);
+extern uint32_t strn_hash(const char *str, size_t len);
 extern uint32_t len_str_hash(const void *vstr);
 extern bool len_str_eq(const void *vstr1, const void *vstr2);
 
 void exit_err(const char *msg) {
-    logger_log(NULL, LOG_ERR, msg);
+    logger_log(FMARK_NONE, LOG_ERR, msg);
     exit(EXIT_FAILURE);
 }
 
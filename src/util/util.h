@@ -136,6 +136,56 @@ inline bool ind_str_eq(const void *vstr1, const void *vstr2) {
     return strcmp(str1, str2) == 0;
 }
 
+/**
+ * String with a length and precomputed hash. The string does not need to be
+ * null terminated.
+ */
+typedef struct len_str_t {
+    const char *str; /**< The string */
+    size_t len;      /**< Length of the string */
+    uint32_t hash;   /**< Hash of the string from strn_hash */
+} len_str_t;
+
+/**
+ * djb2 String hash function for a string of a given length. Gives the same
+ * result as ind_str_hash on a null terminated string of the same length.
+ *
+ * @param str The string to hash
+ * @param len Length of str
+ */
+inline uint32_t strn_hash(const char *str, size_t len) {
+    uint32_t hash = 5381;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash = ((hash << 5) + hash) + str[i]; /* hash * 33 + c */
+    }
+
+    return hash;
+}
+
+/**
+ * Hash function on len_str_t for the hash table interface
+ *
+ * @param vstr The len_str_t to hash
+ */
+inline uint32_t len_str_hash(const void *vstr) {
+    return ((const len_str_t *)vstr)->hash;
+}
+
+/**
+ * Compare function on len_str_t for the hash table interface
+ *
+ * @param vstr1 First string
+ * @param vstr2 Second string
+ */
+inline bool len_str_eq(const void *vstr1, const void *vstr2) {
+    const len_str_t *str1 = vstr1;
+    const len_str_t *str2 = vstr2;
+
+    return str1->hash == str2->hash && str1->len == str2->len &&
+        memcmp(str1->str, str2->str, str1->len) == 0;
+}
+
 char *escape_str(char *str);
 
 char *unescape_str(char *str);
@@ -37,6 +37,7 @@ extern size_t vec_capacity(const vec_t *vec);
 extern void *vec_front(vec_t *vec);
 extern void *vec_back(vec_t *vec);
 extern void *vec_pop_back(vec_t *vec);
+extern void vec_view(vec_t *dest, vec_t *src, size_t begin, size_t end);
 extern bool vec_iter_has_next(vec_iter_t *iter);
 extern void *vec_iter_get(vec_iter_t *iter);
 extern void *vec_iter_advance(vec_iter_t *iter);
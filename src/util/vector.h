@@ -84,6 +84,21 @@ inline void *vec_back(vec_t *vec) {
     return vec->elems[vec->size - 1];
 }
 
+/**
+ * Makes dest a view of elements [begin, end) of src without copying them. The
+ * view must not be modified or destroyed, and is invalid once src is modified.
+ *
+ * @param dest Vector to make a view
+ * @param src Vector to view
+ * @param begin Index of first element in the view
+ * @param end Index past the last element in the view
+ */
+inline void vec_view(vec_t *dest, vec_t *src, size_t begin, size_t end) {
+    dest->elems = src->elems + begin;
+    dest->size = end - begin;
+    dest->capacity = 0;
+}
+
 void vec_push_back(vec_t *vec, void *elem);
 
 void vec_resize(vec_t *vec, size_t size);
@@ -14,6 +14,16 @@ CC="./bin/ccc"
 # Run tests
 $SCRIPT_DIR/test_runner.py -r $RUNTIME -j$JOBS "$CC" $TESTS/*/*.c
 
+# Run parser tests again with bodies of static functions parsed on use
+$SCRIPT_DIR/test_runner.py -r $RUNTIME -j$JOBS "$CC -lazy-parse" $TESTS/parse/*.c
+
+# And with function bodies parsed and typechecked in parallel
+$SCRIPT_DIR/test_runner.py -r $RUNTIME -j$JOBS "$CC -parse-jobs 4" $TESTS/parse/*.c
+$SCRIPT_DIR/test_parse_jobs.bash
+
+# Make sure lookups don't slow down with the number of closed scopes
+$SCRIPT_DIR/test_scope_scaling.bash
+
 # Run 15411 Tests if present
 if [ -d "$TEST_15411" ]; then
     $SCRIPT_DIR/test_runner.py -r $RUNTIME_15411 --llvm -j$JOBS "$CC -S -emit-llvm" $TEST_15411/*/*.c
@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Checks that checking function bodies in parallel reports the same
+# diagnostics as checking them in order. Threads report in any order, so only
+# the sorted diagnostics are compared
+
+TESTS=test/tests
+RUNTIME=test/runtime
+BIN_NAME=./bin/ccc
+JOBS=4
+
+diagnostics() {
+    $BIN_NAME "$@" -I$RUNTIME -S -emit-llvm -o /dev/null 2>&1 |
+        grep -E '^[^ ]+:[0-9]+:[0-9]+ ' | sort
+}
+
+status=0
+for i in $TESTS/parse/*.c $TESTS/error/*.c
+do
+    if ! diff <(diagnostics $i) <(diagnostics -parse-jobs $JOBS $i) > /dev/null
+    then
+        echo "$i: Diagnostics differ with -parse-jobs $JOBS!"
+        status=1
+    fi
+done
+
+exit $status
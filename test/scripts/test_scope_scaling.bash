@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Checks that the time to compile a function grows linearly with the number of
+# sibling scopes declaring the same name. Compiling 4 times as many scopes
+# must take less than 8 times as long
+
+BIN_NAME=./bin/ccc
+SMALL=4000
+LARGE=16000
+
+# Prints a function with the given number of sibling loops
+generate() {
+    echo "int f(void) {"
+    echo "    int s = 0;"
+    for ((i = 0; i < $1; ++i))
+    do
+        echo "    for (int i = 0; i < 2; ++i) { s += i; }"
+    done
+    echo "    return s;"
+    echo "}"
+}
+
+# Prints the milliseconds taken to compile the given number of loops
+compile_time() {
+    local src=$(mktemp --suffix=.c)
+    generate $1 > $src
+    local start=$(date +%s%N)
+    $BIN_NAME -S -emit-llvm -o /dev/null $src
+    local end=$(date +%s%N)
+    rm -f $src
+    echo $(( (end - start) / 1000000 ))
+}
+
+small=$(compile_time $SMALL)
+large=$(compile_time $LARGE)
+if [ $large -ge $(( small * 8 + 100 )) ]
+then
+    echo "Scopes: $SMALL loops took ${small}ms, $LARGE loops took ${large}ms!"
+    exit 1
+fi
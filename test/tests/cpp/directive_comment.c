@@ -0,0 +1,18 @@
+//test return 7
+/**
+ * Make sure a line comment after a directive doesn't hide the next line, and
+ * that spaces between macro arguments are kept when stringifying
+ */
+
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define ONE 1
+
+#ifdef ONE // comment
+int a = 2;
+#endif // comment
+int b = 5;
+
+int __test() {
+    return a + b + sizeof(XSTR(x ONE)) - sizeof("x 1");
+}
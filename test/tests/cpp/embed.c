@@ -0,0 +1,27 @@
+//test return 543
+/**
+ * Make sure #embed initializes arrays with a file's bytes
+ */
+
+unsigned char data[] = {
+#embed "embed_data.txt"
+};
+
+int mixed[] = {
+#embed "embed_data.txt"
+    , 1
+};
+
+int __test() {
+    char local[8] = {
+#embed "embed_data.txt"
+    };
+
+    int sum = 0;
+    for (int i = 0; i < sizeof(data); ++i) {
+        sum += data[i];
+    }
+
+    return sizeof(data) + sizeof(mixed) / sizeof(mixed[0]) + sum + local[5] +
+        local[7] + mixed[6];
+}
@@ -0,0 +1,27 @@
+//test return 15
+/**
+ * Make sure #if expressions follow C arithmetic, including unsigned
+ * conversions and short circuiting
+ */
+
+#if -1 < 0u
+int a = 0;
+#else
+int a = 1;
+#endif
+
+#if 0 && 1 / 0 || (1 ? 2 : 1 / 0) == 2
+int b = 2;
+#endif
+
+#if (2 + 3) * 4 == 20 && -7 / 2 == -3 && -8 >> 1 == -4 && UNDEFINED + 1 == 1
+int c = 4;
+#endif
+
+#if 0xffffffffffffffff == -1 && 1 ? 0 ? 3 : 4 : 5
+int d = 8;
+#endif
+
+int __test() {
+    return a + b + c + d;
+}
@@ -0,0 +1,14 @@
+//test return 1
+/**
+ * Make sure a file with #pragma once is only included once, including when it
+ * is named by different paths
+ */
+
+#include "pragma_once.h"
+#include "pragma_once.h"
+#include "./pragma_once.h"
+#include "../cpp/pragma_once.h"
+
+int __test() {
+    return once_count;
+}
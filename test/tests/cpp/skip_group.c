@@ -0,0 +1,27 @@
+//test return 3
+/**
+ * Make sure inactive groups are skipped up to the right directive, even when
+ * they contain comments, unterminated literals and nested conditionals
+ */
+
+#if 0
+don't stop here
+/* #endif */
+"#else"
+#if 1
+#else
+#endif
+#else
+int a = 1;
+#endif
+
+#ifdef UNDEFINED
+#elif 1
+int b = 2;
+#else
+int b = 4;
+#endif
+
+int __test() {
+    return a + b;
+}
@@ -0,0 +1,8 @@
+//test return 6
+#define STR(x) #x
+#define PASTE(a, b) a ## b
+
+int __test() {
+    int xy = 5;
+    return sizeof(STR()) + PASTE(, xy) PASTE(,);
+}
@@ -0,0 +1,20 @@
+//test return 9
+// Tests calls of functions which are only declared later in the file. Bodies
+// checked after the rest of the file with -lazy-parse or -parse-jobs must get
+// the same implicit declarations as when each body is checked in place
+
+int first(void) {
+    return add(1, 2);
+}
+
+static int second(void) {
+    return add(2, 2) + add(1, 1);
+}
+
+int add(int a, int b) {
+    return a + b;
+}
+
+int __test() {
+    return first() + second();
+}
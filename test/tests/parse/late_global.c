@@ -0,0 +1,14 @@
+//test error
+// Tests a function body using a variable which is only declared later in the
+// file. Bodies checked after the rest of the file with -lazy-parse or
+// -parse-jobs must not see the later variable
+
+static int get(void) {
+    return value;
+}
+
+int value = 5;
+
+int __test() {
+    return get();
+}
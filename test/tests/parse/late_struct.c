@@ -0,0 +1,19 @@
+//test error
+// Tests a function body using a struct which is only defined later in the
+// file. Bodies checked after the rest of the file with -lazy-parse or
+// -parse-jobs must see the struct as incomplete
+
+struct later;
+
+static int size(void) {
+    struct later *p = 0;
+    return sizeof(*p);
+}
+
+struct later {
+    int x;
+};
+
+int __test() {
+    return size();
+}
@@ -0,0 +1,26 @@
+//test return 16
+// Tests function bodies using names which are only declared as typedefs later
+// in the file. Bodies parsed after the rest of the file with -lazy-parse or
+// -parse-jobs must not see the later typedefs
+
+static int local(void) {
+    int len = 3;
+    return (len) - 1;
+}
+
+static int param(int len) {
+    return (len) - 1;
+}
+
+int global(int size) {
+    int count = size;
+    return (count) * 2;
+}
+
+typedef unsigned len;
+typedef long count;
+
+int __test() {
+    len l = param(4);
+    return local() + l + global(2) + (int)sizeof(count) - 1;
+}
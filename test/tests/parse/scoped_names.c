@@ -0,0 +1,29 @@
+//test return 42
+// Tests typedef, tag, and variable names shadowed in nested and sibling scopes
+
+typedef int T;
+struct s { char c; };
+
+int __test() {
+    int x = 0;
+    {
+        typedef char T;
+        struct s { int a; int b; };
+        x += sizeof(T) + sizeof(struct s);
+        {
+            T T = 2;
+            x += T;
+        }
+        x += sizeof(T);
+    }
+    {
+        T y = 3;
+        x += y + sizeof(struct s);
+    }
+    for (T i = 0; i < 4; ++i) {
+        int T = i;
+        x += T;
+    }
+    T z = 20;
+    return x + z + sizeof(T) - 4;
+}
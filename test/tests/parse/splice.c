@@ -0,0 +1,19 @@
+//test return 42
+/**
+ * Make sure line splices are handled inside of identifiers, comments, and
+ * string literals
+ */
+
+/* comment with stars ** / * and a splice *\
+/
+
+int __test() {
+    int long_identifier_name_spanning_a_line_\
+splice = 20;
+    // line comment continued with a splice \
+    return 0;
+    char *str = "abc\"def\\" "gh\
+i";
+    return long_identifier_name_spanning_a_line_splice + sizeof("abc\"def\\ghi")
+        + str[10] - 'i' + 10;
+}